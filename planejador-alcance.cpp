@@ -0,0 +1,94 @@
+#include <iostream>
+#include <vector>
+
+#include "planejador.h"
+
+using namespace std;
+
+/* *************************
+ * PONTOS ALCANCAVEIS    *
+ ************************* */
+
+// A busca de Dijkstra fecha os pontos em ordem crescente de distancia a
+// partir da origem: basta parar no primeiro ponto alem do limite para obter
+// todos os pontos alcancaveis, sem examinar o resto do mapa. Com varias
+// origens, todas comecam no aberto com distancia 0 (busca de varias fontes),
+// e cada ponto eh fechado com a distancia ateh a origem mais proxima.
+
+/// Retorna os pontos alcancaveis a partir da origem ateh o limite
+vector<PontoAlcancavel> Planejador::pontosAlcancaveis(const IDPonto &origem,
+                                                      double limite) {
+  return pontosAlcancaveis(origem, limite, espaco);
+}
+
+/// Versao reentrante de pontosAlcancaveis
+vector<PontoAlcancavel> Planejador::pontosAlcancaveis(const IDPonto &origem,
+                                                      double limite,
+                                                      EspacoBusca &E) const {
+  return pontosAlcancaveis(vector<IDPonto>(1, origem), limite, E);
+}
+
+/// Versao de pontosAlcancaveis com varias origens
+vector<PontoAlcancavel>
+Planejador::pontosAlcancaveis(const vector<IDPonto> &origens, double limite,
+                              EspacoBusca &E) const {
+  vector<PontoAlcancavel> R;
+  try {
+    // Mapa vazio
+    if (empty())
+      throw 1;
+    // Limite negativo ou NaN
+    if (!(limite >= 0.0))
+      throw 2;
+  } catch (int i) {
+    cerr << "Erro " << i << " na busca de pontos alcancaveis\n";
+    return R;
+  }
+
+  const Adjacencia &adj = mapa.adj;
+  EspacoBusca::Direcao &D = E.ida;
+  D.preparar(mapa.numPontos());
+  for (const IDPonto &id : origens) {
+    Indice o = mapa.id_pontos.find(id.str());
+    if (o == INDICE_INVALIDO) {
+      cerr << "Erro 4 na busca de pontos alcancaveis\n";
+      continue;
+    }
+    if (!D.aberto.contem(o)) {
+      D.g[o] = 0.0;
+      D.pai[o] = INDICE_INVALIDO;
+      D.aberto.push(o, 0.0);
+    }
+  }
+
+  // Os pontos alem do limite nem entram no aberto
+  while (!D.aberto.empty()) {
+    Indice atual = D.aberto.pop();
+    D.fechar(atual);
+    PontoAlcancavel P;
+    P.id.set(string(mapa.id_pontos[atual]));
+    P.distancia = D.g[atual];
+    R.push_back(std::move(P));
+
+    for (Indice e = adj.inicio[atual]; e < adj.fim[atual]; ++e) {
+      Indice suc = adj.vizinho[e];
+      if (D.fechado(suc))
+        continue;
+
+      double g_suc = D.g[atual] + adj.comprimento[e];
+      if (g_suc > limite)
+        continue;
+      if (D.aberto.contem(suc)) {
+        // Soh substitui o noh em aberto se o novo for melhor
+        if (!(g_suc < D.g[suc]))
+          continue;
+        D.aberto.diminuir(suc, g_suc);
+      } else {
+        D.aberto.push(suc, g_suc);
+      }
+      D.g[suc] = g_suc;
+      D.pai[suc] = adj.rota[e];
+    }
+  }
+  return R;
+}
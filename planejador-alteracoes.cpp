@@ -0,0 +1,522 @@
+#include <cmath>
+#include <iostream>
+#include <limits>
+#include <unordered_map>
+
+#include "planejador.h"
+
+using namespace std;
+
+/* *************************
+ * CLASSE TABELATEXTOS   *
+ ************************* */
+
+/// Remove o texto de indice i, que passa a ser o do ultimo texto.
+/// Os caracteres removidos ficam no bloco ateh que ocupem metade dele,
+/// quando o bloco eh compactado.
+void TabelaTextos::remover(Indice i) {
+  const Indice ultimo = size() - 1;
+  descartados += faixas[i].tamanho;
+  faixas.mutavel()[i] = faixas[ultimo];
+  faixas.resize(ultimo);
+
+  if (2 * descartados <= caracteres.size())
+    return;
+  // Compacta o bloco, copiando apenas os textos existentes
+  Arranjo<char> bloco;
+  bloco.reserve(caracteres.size() - descartados);
+  Faixa *F = faixas.mutavel();
+  for (Indice k = 0; k < size(); ++k) {
+    uint32_t inicio = uint32_t(bloco.size());
+    bloco.append(caracteres.data() + F[k].inicio, F[k].tamanho);
+    F[k].inicio = inicio;
+  }
+  caracteres = std::move(bloco);
+  descartados = 0;
+}
+
+/* *************************
+ * CLASSE TABELAIDS      *
+ ************************* */
+
+/// Posicao da tabela hash que guarda o indice i
+size_t TabelaIds::slot(Indice i) const {
+  size_t mascara = slots.size() - 1;
+  size_t k = hash((*this)[i]) & mascara;
+  while (slots[k] != i)
+    k = (k + 1) & mascara;
+  return k;
+}
+
+/// Remove o identificador de indice i, que passa a ser o do ultimo
+void TabelaIds::remover(Indice i) {
+  const Indice ultimo = size() - 1;
+  const size_t mascara = slots.size() - 1;
+  const size_t k_ultimo = slot(ultimo);
+  size_t k = slot(i);
+  Indice *s = slots.mutavel();
+  s[k_ultimo] = i;
+
+  // Libera a posicao k e, como a sondagem eh linear, traz para ela os
+  // identificadores seguintes que nao seriam mais encontrados (remocao sem
+  // marcas de posicao apagada)
+  for (size_t j = (k + 1) & mascara; s[j] != INDICE_INVALIDO;
+       j = (j + 1) & mascara) {
+    // Posicao inicial do identificador em j (o indice ultimo ainda tem o
+    // seu texto em ultimo)
+    Indice id = s[j] == i ? ultimo : s[j];
+    size_t h = hash((*this)[id]) & mascara;
+    // Fica em j se h estah no trecho circular (k, j]
+    bool fica = (k < j) ? (k < h && h <= j) : (k < h || h <= j);
+    if (!fica) {
+      s[k] = s[j];
+      k = j;
+    }
+  }
+  s[k] = INDICE_INVALIDO;
+  TabelaTextos::remover(i);
+}
+
+/* *************************
+ * CLASSE ADJACENCIA     *
+ ************************* */
+
+/// Inclui um ponto sem arestas, de indice igual ao numero de pontos
+void Adjacencia::incluirPonto() {
+  if (inicio.empty())
+    inicio.push_back(0);
+  // As arestas do ponto comecam (vazias) no final dos vetores
+  Indice posicoes = inicio[fim.size()];
+  fim.push_back(posicoes);
+  inicio.push_back(posicoes);
+}
+
+/// Inclui a aresta da rota r a partir do ponto p ateh o ponto viz
+void Adjacencia::incluir(Indice p, Indice viz, Indice r, double compr) {
+  const Indice posicoes = Indice(vizinho.size());
+  Indice *ini = inicio.mutavel();
+  Indice *f = fim.mutavel();
+  if (f[p] == posicoes || vizinho[f[p]] != INDICE_INVALIDO) {
+    // Nao ha posicao livre apos as arestas de p: os vetores crescem e, se as
+    // arestas de p nao estao no final deles, sao transferidas para lah
+    const bool no_final = f[p] == posicoes;
+    const Indice g = f[p] - ini[p];
+    const Indice novas = max<Indice>(4, no_final ? g : 2 * g);
+    vizinho.resize(posicoes + novas);
+    rota.resize(posicoes + novas);
+    comprimento.resize(posicoes + novas);
+    Indice *v = vizinho.mutavel();
+    Indice *rt = rota.mutavel();
+    double *c = comprimento.mutavel();
+    for (Indice k = posicoes; k < posicoes + novas; ++k)
+      v[k] = rt[k] = INDICE_INVALIDO;
+    if (!no_final) {
+      for (Indice k = 0; k < g; ++k) {
+        v[posicoes + k] = v[ini[p] + k];
+        rt[posicoes + k] = rt[ini[p] + k];
+        c[posicoes + k] = c[ini[p] + k];
+        v[ini[p] + k] = rt[ini[p] + k] = INDICE_INVALIDO;
+      }
+      ini[p] = posicoes;
+      f[p] = posicoes + g;
+    }
+    ini[fim.size()] = posicoes + novas;
+  }
+  const Indice e = f[p]++;
+  vizinho.mutavel()[e] = viz;
+  rota.mutavel()[e] = r;
+  comprimento.mutavel()[e] = compr;
+}
+
+/// Remove uma aresta da rota r que parte do ponto p
+void Adjacencia::remover(Indice p, Indice r) {
+  Indice *v = vizinho.mutavel();
+  Indice *rt = rota.mutavel();
+  double *c = comprimento.mutavel();
+  Indice e = inicio[p];
+  while (rt[e] != r)
+    ++e;
+  // A ultima aresta do ponto ocupa o lugar da removida
+  const Indice ultima = --fim.mutavel()[p];
+  v[e] = v[ultima];
+  rt[e] = rt[ultima];
+  c[e] = c[ultima];
+  v[ultima] = INDICE_INVALIDO;
+  rt[ultima] = INDICE_INVALIDO;
+}
+
+/// Refaz os vetores sem posicoes livres, mantendo a ordem das arestas
+void Adjacencia::compactar() {
+  const Indice n = Indice(fim.size());
+  Adjacencia A;
+  A.inicio.assign(size_t(n) + 1, 0);
+  A.fim.assign(n, 0);
+  Indice *ini = A.inicio.mutavel();
+  Indice *f = A.fim.mutavel();
+  for (Indice p = 0; p < n; ++p) {
+    ini[p] = Indice(A.vizinho.size());
+    A.vizinho.append(vizinho.data() + inicio[p], grau(p));
+    A.rota.append(rota.data() + inicio[p], grau(p));
+    A.comprimento.append(comprimento.data() + inicio[p], grau(p));
+    f[p] = Indice(A.vizinho.size());
+  }
+  ini[n] = Indice(A.vizinho.size());
+  *this = std::move(A);
+}
+
+/* *************************
+ * CLASSE MAPA           *
+ ************************* */
+
+/// Inclui o ponto P, retornando seu indice
+Indice Mapa::incluirPonto(const Ponto &P) {
+  const Indice p = id_pontos.insert(P.id.str()).first;
+  nome_pontos.push_back(P.nome);
+  latitude.push_back(P.latitude);
+  longitude.push_back(P.longitude);
+  trig.definir(p, P.latitude, P.longitude);
+  // O ponto novo fica fora da arvore do indice espacial
+  if (espacial.size() == p)
+    espacial.incluir(trig);
+  adj.incluirPonto();
+  // O ponto novo eh uma componente sozinho
+  if (componente.size() == p) {
+    componente.push_back(num_componentes++);
+    tam_componente.push_back(1);
+  }
+  // O ponto novo nao alcanca nenhum marco: distancias NaN
+  for (size_t k = 0; k < marcos.size(); ++k)
+    dist_marcos.push_back(numeric_limits<float>::quiet_NaN());
+  ch.clear();
+  return p;
+}
+
+/// Remove o ponto p, que nao pode ter rotas. O ultimo ponto passa a ter o
+/// indice p.
+void Mapa::removerPonto(Indice p) {
+  const Indice ultimo = numPontos() - 1;
+  const size_t K = marcos.size();
+  for (size_t k = 0; k < K; ++k)
+    if (marcos[k] == p) {
+      // Os limites dados pelo marco continuariam validos, mas ele nao
+      // existe mais
+      marcos.clear();
+      dist_marcos.clear();
+      break;
+    }
+
+  if (p != ultimo) {
+    // As arestas do ultimo ponto passam a ser de p, e as rotas que chegam
+    // ao ultimo ponto passam a chegar a p
+    Indice *ini = adj.inicio.mutavel();
+    Indice *f = adj.fim.mutavel();
+    Indice *viz = adj.vizinho.mutavel();
+    Indice *ext = extremidades.mutavel();
+    for (Indice e = ini[ultimo]; e < f[ultimo]; ++e) {
+      const Indice w = viz[e], r = adj.rota[e];
+      for (Indice a = ini[w]; a < f[w]; ++a)
+        if (adj.rota[a] == r && viz[a] == ultimo)
+          viz[a] = p;
+      for (int k = 0; k < 2; ++k)
+        if (ext[2 * r + k] == ultimo)
+          ext[2 * r + k] = p;
+    }
+    ini[p] = ini[ultimo];
+    f[p] = f[ultimo];
+
+    latitude.mutavel()[p] = latitude[ultimo];
+    longitude.mutavel()[p] = longitude[ultimo];
+    float *d = dist_marcos.mutavel();
+    for (size_t k = 0; k < marcos.size(); ++k) {
+      d[p * K + k] = d[ultimo * K + k];
+      if (marcos[k] == ultimo)
+        marcos.mutavel()[k] = p;
+    }
+  }
+
+  // O ponto nao tem rotas: a sua componente soh tem ele
+  if (componente.size() == size_t(ultimo) + 1) {
+    tam_componente.mutavel()[componente[p]] = 0;
+    componente.mutavel()[p] = componente[ultimo];
+    componente.resize(ultimo);
+  }
+
+  id_pontos.remover(p);
+  nome_pontos.remover(p);
+  latitude.resize(ultimo);
+  longitude.resize(ultimo);
+  trig.remover(p);
+  if (espacial.size() == size_t(ultimo) + 1)
+    espacial.remover(p);
+  adj.inicio.mutavel()[ultimo] = adj.inicio[ultimo + 1];
+  adj.inicio.resize(size_t(ultimo) + 1);
+  adj.fim.resize(ultimo);
+  dist_marcos.resize(ultimo * marcos.size());
+  ch.clear();
+}
+
+/// Inclui a rota R entre os pontos de indices a e b, retornando seu indice
+Indice Mapa::incluirRota(const Rota &R, Indice a, Indice b) {
+  const Indice r = id_rotas.insert(R.id.str()).first;
+  nome_rotas.push_back(R.nome);
+  extremidades.push_back(a);
+  extremidades.push_back(b);
+  comprimento.push_back(R.comprimento);
+  adj.incluir(a, b, r, R.comprimento);
+  adj.incluir(b, a, r, R.comprimento);
+  if (componente.size() == numPontos())
+    unirComponentes(a, b);
+
+  // As posicoes livres deixadas pelas transferencias sao recuperadas
+  // quando passam do numero de arestas e pontos
+  if (adj.vizinho.size() > 2 * (2 * size_t(numRotas()) + numPontos()))
+    adj.compactar();
+
+  // Uma rota nova pode encurtar distancias: os limites dos marcos deixam
+  // de ser validos
+  marcos.clear();
+  dist_marcos.clear();
+  ch.clear();
+  return r;
+}
+
+/// Remove a rota r. A ultima rota passa a ter o indice r.
+void Mapa::removerRota(Indice r) {
+  const Indice ultima = numRotas() - 1;
+  const Indice a = extremidades[2 * r], b = extremidades[2 * r + 1];
+  adj.remover(a, r);
+  adj.remover(b, r);
+
+  if (r != ultima) {
+    Indice *ext = extremidades.mutavel();
+    Indice *rt = adj.rota.mutavel();
+    for (int k = 0; k < 2; ++k) {
+      const Indice p = ext[2 * ultima + k];
+      for (Indice e = adj.inicio[p]; e < adj.fim[p]; ++e)
+        if (rt[e] == ultima)
+          rt[e] = r;
+      ext[2 * r + k] = p;
+    }
+    comprimento.mutavel()[r] = comprimento[ultima];
+  }
+
+  id_rotas.remover(r);
+  nome_rotas.remover(r);
+  extremidades.resize(2 * size_t(ultima));
+  comprimento.resize(ultima);
+  // Distancias soh aumentam: os marcos continuam validos. A componente
+  // pode se dividir.
+  if (componente.size() == numPontos())
+    separarComponentes(a, b);
+  ch.clear();
+}
+
+/// Altera o comprimento da rota r
+void Mapa::alterarComprimento(Indice r, double compr) {
+  // Se a rota encurta, os limites dos marcos deixam de ser validos
+  if (compr < comprimento[r]) {
+    marcos.clear();
+    dist_marcos.clear();
+  }
+  comprimento.mutavel()[r] = compr;
+  double *c = adj.comprimento.mutavel();
+  for (int k = 0; k < 2; ++k) {
+    const Indice p = extremidades[2 * r + k];
+    for (Indice e = adj.inicio[p]; e < adj.fim[p]; ++e)
+      if (adj.rota[e] == r)
+        c[e] = compr;
+  }
+  ch.clear();
+}
+
+/* *************************
+ * CLASSE PLANEJADOR     *
+ ************************* */
+
+/// Aplica ao mapa as alteracoes do lote L, como uma unica operacao: o lote
+/// inteiro eh verificado antes de qualquer alteracao do mapa
+bool Planejador::aplicar(const LoteAlteracoes &L) {
+  using Tipo = LoteAlteracoes::Tipo;
+  if (L.empty())
+    return true;
+
+  // Verificacao: simula o efeito das alteracoes anteriores nas ids usadas.
+  // As ids que o lote nao alterou estao como no mapa.
+  size_t k = 0;
+  try {
+    struct EstadoRota {
+      bool existe;
+      string_view ext[2];
+    };
+    unordered_map<string_view, bool> existe_ponto;
+    unordered_map<string_view, Indice> grau;
+    unordered_map<string_view, EstadoRota> rotas;
+
+    auto ponto_existe = [&](string_view id) {
+      auto it = existe_ponto.find(id);
+      if (it != existe_ponto.end())
+        return it->second;
+      return mapa.id_pontos.find(id) != INDICE_INVALIDO;
+    };
+    // Grau de um ponto existente
+    auto grau_ponto = [&](string_view id) -> Indice & {
+      auto it = grau.find(id);
+      if (it == grau.end())
+        it = grau.emplace(id, mapa.adj.grau(mapa.id_pontos.find(id))).first;
+      return it->second;
+    };
+    auto estado_rota = [&](string_view id) {
+      auto it = rotas.find(id);
+      if (it != rotas.end())
+        return it->second;
+      EstadoRota E = {false, {}};
+      Indice r = mapa.id_rotas.find(id);
+      if (r != INDICE_INVALIDO) {
+        E.existe = true;
+        E.ext[0] = mapa.id_pontos[mapa.extremidades[2 * r]];
+        E.ext[1] = mapa.id_pontos[mapa.extremidades[2 * r + 1]];
+      }
+      return E;
+    };
+    auto comprimento_ok = [](double c) { return std::isfinite(c) && c >= 0.0; };
+
+    for (; k < L.size(); ++k) {
+      const LoteAlteracoes::Alteracao &A = L[k];
+      const string_view id_ponto = A.ponto.id.str();
+      const string_view id_rota = A.rota.id.str();
+      switch (A.tipo) {
+      case Tipo::INCLUIR_PONTO:
+        // Ponto invalido: throw 1; ponto existente: throw 2
+        if (!A.ponto.valid() || A.ponto.nome.size() < 2 ||
+            !(std::fabs(A.ponto.latitude) <= 90.0) ||
+            !(std::fabs(A.ponto.longitude) <= 180.0))
+          throw 1;
+        if (ponto_existe(id_ponto))
+          throw 2;
+        existe_ponto[id_ponto] = true;
+        grau[id_ponto] = 0;
+        break;
+      case Tipo::REMOVER_PONTO:
+        // Ponto inexistente: throw 3; ponto com rotas: throw 4
+        if (!ponto_existe(id_ponto))
+          throw 3;
+        if (grau_ponto(id_ponto) != 0)
+          throw 4;
+        existe_ponto[id_ponto] = false;
+        break;
+      case Tipo::INCLUIR_ROTA: {
+        // Rota invalida: throw 5; rota existente: throw 6; extremidade
+        // inexistente: throw 8; comprimento invalido: throw 9
+        if (!A.rota.valid() || A.rota.nome.size() < 2)
+          throw 5;
+        if (estado_rota(id_rota).existe)
+          throw 6;
+        EstadoRota E = {true, {}};
+        for (int j = 0; j < 2; ++j) {
+          E.ext[j] = A.rota.extremidade[j].str();
+          if (!ponto_existe(E.ext[j]))
+            throw 8;
+        }
+        if (!comprimento_ok(A.rota.comprimento))
+          throw 9;
+        ++grau_ponto(E.ext[0]);
+        ++grau_ponto(E.ext[1]);
+        rotas[id_rota] = E;
+        break;
+      }
+      case Tipo::REMOVER_ROTA: {
+        // Rota inexistente: throw 7
+        EstadoRota E = estado_rota(id_rota);
+        if (!E.existe)
+          throw 7;
+        --grau_ponto(E.ext[0]);
+        --grau_ponto(E.ext[1]);
+        rotas[id_rota] = {false, {}};
+        break;
+      }
+      case Tipo::ALTERAR_COMPRIMENTO:
+        // Rota inexistente: throw 7; comprimento invalido: throw 9
+        if (!estado_rota(id_rota).existe)
+          throw 7;
+        if (!comprimento_ok(A.rota.comprimento))
+          throw 9;
+        break;
+      }
+    }
+  } catch (int i) {
+    cerr << "Erro " << i << " na alteracao " << k << " do lote" << endl;
+    return false;
+  }
+
+  // Soh chega aqui se nao entrou no catch: todas as alteracoes sao validas
+  auto ponto = [this](const IDPonto &Id) {
+    return mapa.id_pontos.find(Id.str());
+  };
+  auto rota = [this](const IDRota &Id) {
+    return mapa.id_rotas.find(Id.str());
+  };
+  for (k = 0; k < L.size(); ++k) {
+    const LoteAlteracoes::Alteracao &A = L[k];
+    switch (A.tipo) {
+    case Tipo::INCLUIR_PONTO:
+      mapa.incluirPonto(A.ponto);
+      break;
+    case Tipo::REMOVER_PONTO:
+      mapa.removerPonto(ponto(A.ponto.id));
+      break;
+    case Tipo::INCLUIR_ROTA:
+      mapa.incluirRota(A.rota, ponto(A.rota.extremidade[0]),
+                       ponto(A.rota.extremidade[1]));
+      break;
+    case Tipo::REMOVER_ROTA:
+      mapa.removerRota(rota(A.rota.id));
+      break;
+    case Tipo::ALTERAR_COMPRIMENTO:
+      mapa.alterarComprimento(rota(A.rota.id), A.rota.comprimento);
+      break;
+    }
+  }
+  // O indice espacial eh reconstruido quando os pontos incluidos e
+  // removidos desde a ultima construcao passam de uma fracao do mapa
+  if (mapa.espacial.size() != mapa.numPontos() ||
+      mapa.espacial.desatualizado())
+    mapa.espacial.construir(mapa.trig);
+  // As componentes sao mantidas pelas alteracoes; os rotulos sao refeitos,
+  // densos, quando os abandonados passam do numero de pontos
+  if (mapa.componente.size() != mapa.numPontos() ||
+      mapa.num_componentes > 2 * size_t(mapa.numPontos()) + 1)
+    mapa.calcularComponentes(PoolThreads::global());
+  cache.clear();
+  return true;
+}
+
+/// Alteracoes avulsas: equivalem a aplicar um lote com uma so alteracao
+bool Planejador::incluirPonto(const Ponto &P) {
+  LoteAlteracoes L;
+  L.incluirPonto(P);
+  return aplicar(L);
+}
+
+bool Planejador::removerPonto(const IDPonto &Id) {
+  LoteAlteracoes L;
+  L.removerPonto(Id);
+  return aplicar(L);
+}
+
+bool Planejador::incluirRota(const Rota &R) {
+  LoteAlteracoes L;
+  L.incluirRota(R);
+  return aplicar(L);
+}
+
+bool Planejador::removerRota(const IDRota &Id) {
+  LoteAlteracoes L;
+  L.removerRota(Id);
+  return aplicar(L);
+}
+
+bool Planejador::alterarComprimento(const IDRota &Id, double comprimento) {
+  LoteAlteracoes L;
+  L.alterarComprimento(Id, comprimento);
+  return aplicar(L);
+}
@@ -0,0 +1,201 @@
+#include <algorithm>
+#include <iostream>
+#include <vector>
+
+#include "planejador.h"
+
+using namespace std;
+
+/* *************************
+ * CAMINHOS ALTERNATIVOS *
+ ************************* */
+
+// Algoritmo de Yen: o caminho de ordem i+1 desvia do de ordem i em algum
+// ponto C[j]. Ele segue o caminho i ateh C[j] (a raiz) e dali segue o
+// caminho mais curto ateh o destino (o desvio) que nao volta aos pontos da
+// raiz nem repete a rota seguinte ao ponto C[j] de nenhum dos caminhos jah
+// escolhidos com a mesma raiz. Os desvios de todos os pontos do caminho i
+// sao candidatos, e o menor candidato ainda nao escolhido eh o caminho i+1.
+// Como em Lawler, os desvios antes do ponto em que o caminho i desviou do
+// seu antecessor nao sao refeitos: geram os mesmos candidatos da iteracao
+// anterior. Os desvios de cada iteracao sao independentes entre si e sao
+// calculados em paralelo.
+
+namespace {
+
+/// Um caminho candidato do algoritmo de Yen
+struct Candidato {
+  double comprimento;
+  CaminhoIndices caminho;
+  size_t desvio; // Posicao do ponto em que desvia do caminho anterior
+};
+
+/// Testa se os n primeiros trechos dos caminhos A e B sao iguais
+bool mesmoInicio(const CaminhoIndices &A, const CaminhoIndices &B, size_t n) {
+  if (A.size() < n || B.size() < n)
+    return false;
+  for (size_t i = 0; i < n; ++i)
+    if (A[i].rota != B[i].rota || A[i].ponto != B[i].ponto)
+      return false;
+  return true;
+}
+
+/// Comprimento do caminho C, somado a partir da origem (na mesma ordem da
+/// busca A*, para que um caminho tenha sempre o mesmo comprimento)
+double comprimentoCaminho(const Mapa &M, const CaminhoIndices &C) {
+  double compr = 0.0;
+  for (size_t i = 1; i < C.size(); ++i)
+    compr += M.comprimento[C[i].rota];
+  return compr;
+}
+
+} // namespace
+
+/// Algoritmo A* de desvio, a partir do ponto C[j]
+double Planejador::buscaDesvio(const CaminhoIndices &C, size_t j, Indice dest,
+                               const vector<Indice> &bloqueadas,
+                               EspacoBusca &E) const {
+  const Adjacencia &adj = mapa.adj;
+  EspacoBusca::Direcao &D = E.ida;
+  D.preparar(mapa.numPontos());
+
+  // Os pontos da raiz comecam fechados: a busca nao passa por eles
+  for (size_t i = 0; i < j; ++i)
+    D.fechar(C[i].ponto);
+
+  const Indice orig = C[j].ponto;
+  D.g[orig] = 0.0;
+  D.aberto.push(orig, mapa.heuristica(orig, dest));
+
+  while (!D.aberto.empty()) {
+    Indice atual = D.aberto.pop();
+    D.fechar(atual);
+    if (atual == dest) {
+      refazerCaminho(D.pai, orig, dest, E.caminho);
+      return D.g[dest];
+    }
+
+    for (Indice e = adj.inicio[atual]; e < adj.fim[atual]; ++e) {
+      // As rotas bloqueadas soh partem da origem do desvio
+      if (atual == orig && find(bloqueadas.begin(), bloqueadas.end(),
+                                adj.rota[e]) != bloqueadas.end())
+        continue;
+      Indice suc = adj.vizinho[e];
+      if (D.fechado(suc))
+        continue;
+
+      double g_suc = D.g[atual] + adj.comprimento[e];
+      double f_suc = g_suc + mapa.heuristica(suc, dest);
+      if (D.aberto.contem(suc)) {
+        // Soh substitui o noh em aberto se o novo for melhor
+        if (!(f_suc < D.aberto.chave(suc)))
+          continue;
+        D.aberto.diminuir(suc, f_suc);
+      } else {
+        D.aberto.push(suc, f_suc);
+      }
+      D.g[suc] = g_suc;
+      D.pai[suc] = adj.rota[e];
+    }
+  }
+  return -1.0;
+}
+
+/// Calcula os k caminhos mais curtos sem ciclos entre origem e destino
+vector<CaminhoAlternativo> Planejador::calculaCaminhosAlternativos(
+    const IDPonto &id_origem, const IDPonto &id_destino, size_t k,
+    PoolThreads &pool) const {
+  vector<CaminhoAlternativo> R;
+  Indice orig = INDICE_INVALIDO, dest = INDICE_INVALIDO;
+  try {
+    // Mapa vazio
+    if (empty())
+      throw 1;
+    orig = mapa.id_pontos.find(id_origem.str());
+    if (orig == INDICE_INVALIDO)
+      throw 4;
+    dest = mapa.id_pontos.find(id_destino.str());
+    if (dest == INDICE_INVALIDO)
+      throw 5;
+  } catch (int i) {
+    cerr << "Erro " << i << " no calculo dos caminhos alternativos\n";
+    return R;
+  }
+  // Sem caminho entre componentes diferentes
+  if (k == 0 || !mapa.mesmaComponente(orig, dest))
+    return R;
+
+  // Uma area de trabalho (emprestada da reserva) e uma lista de rotas
+  // bloqueadas por thread, reaproveitadas por todas as buscas da thread
+  ReservaEspacos::Emprestimo espacos(reserva, pool.size());
+  vector<vector<Indice>> bloqueadas(pool.size());
+
+  // Caminhos escolhidos (A), em ordem crescente de comprimento, e
+  // candidatos ainda nao escolhidos (B)
+  vector<Candidato> A, B, novos;
+
+  // O caminho mais curto eh o desvio do caminho que soh tem a origem
+  Candidato primeiro{0.0, CaminhoIndices(1, Trecho{INDICE_INVALIDO, orig}), 0};
+  if (buscaDesvio(primeiro.caminho, 0, dest, bloqueadas[0], espacos[0]) < 0.0)
+    return R;
+  primeiro.caminho = espacos[0].caminho;
+  primeiro.comprimento = comprimentoCaminho(mapa, primeiro.caminho);
+  A.push_back(std::move(primeiro));
+
+  while (A.size() < k) {
+    const Candidato &ultimo = A.back();
+    const CaminhoIndices &U = ultimo.caminho;
+
+    // Um desvio a partir de cada ponto, do ponto de desvio do ultimo
+    // caminho ateh o penultimo
+    const size_t num_desvios = U.size() - 1 - ultimo.desvio;
+    novos.assign(num_desvios, Candidato{-1.0, CaminhoIndices(), 0});
+    pool.paraCada(num_desvios, [&](size_t i, unsigned t) {
+      const size_t j = ultimo.desvio + i;
+      vector<Indice> &bl = bloqueadas[t];
+      bl.clear();
+      for (const Candidato &c : A)
+        if (c.caminho.size() > j + 1 && mesmoInicio(c.caminho, U, j + 1))
+          bl.push_back(c.caminho[j + 1].rota);
+
+      EspacoBusca &E = espacos[t];
+      if (buscaDesvio(U, j, dest, bl, E) < 0.0)
+        return;
+      Candidato &c = novos[i];
+      c.caminho.assign(U.begin(), U.begin() + j + 1);
+      c.caminho.insert(c.caminho.end(), E.caminho.begin() + 1,
+                       E.caminho.end());
+      c.comprimento = comprimentoCaminho(mapa, c.caminho);
+      c.desvio = j;
+    });
+
+    // Candidatos novos, sem repetir os que jah estao em B
+    for (Candidato &c : novos) {
+      if (c.comprimento < 0.0)
+        continue;
+      bool repetido = any_of(B.begin(), B.end(), [&c](const Candidato &b) {
+        return b.caminho.size() == c.caminho.size() &&
+               mesmoInicio(b.caminho, c.caminho, c.caminho.size());
+      });
+      if (!repetido)
+        B.push_back(std::move(c));
+    }
+    if (B.empty())
+      break;
+
+    // O menor candidato (o primeiro encontrado, em caso de empate)
+    auto menor = min_element(B.begin(), B.end(),
+                             [](const Candidato &a, const Candidato &b) {
+                               return a.comprimento < b.comprimento;
+                             });
+    A.push_back(std::move(*menor));
+    B.erase(menor);
+  }
+
+  R.resize(A.size());
+  for (size_t i = 0; i < A.size(); ++i) {
+    R[i].comprimento = A[i].comprimento;
+    converterCaminho(A[i].caminho, R[i].caminho);
+  }
+  return R;
+}
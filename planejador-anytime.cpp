@@ -0,0 +1,282 @@
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <iostream>
+#include <vector>
+
+#include "planejador.h"
+
+using namespace std;
+
+/* *************************
+ * BUSCA ANYTIME         *
+ ************************* */
+
+// ARA* (Likhachev, Gordon e Thrun): uma sequencia de buscas A* com a
+// heuristica multiplicada por um peso epsilon decrescente. Com peso
+// epsilon, o A* fecha poucos pontos e encontra um caminho no maximo epsilon
+// vezes mais longo que o mais curto. Cada iteracao continua da anterior:
+// os valores de g sao mantidos, e soh voltam ao aberto os pontos fechados
+// cujo g diminuiu depois de fechados (os inconsistentes). Ao fim de cada
+// iteracao, o caminho encontrado eh guardado, com o limite da sua
+// subotimalidade: o seu comprimento dividido pelo menor g + h do aberto e
+// dos inconsistentes, que eh um limite inferior do caminho mais curto.
+
+namespace {
+
+/// Maximo de iteracoes de uma consulta (limita epsilon_inicial e
+/// passo_epsilon)
+constexpr double MAX_ITERACOES_ANYTIME = 1000.0;
+
+/// Expansoes entre duas consultas ao relogio e ao cancelamento
+constexpr uint64_t INTERVALO_VERIFICACAO = 64;
+
+} // namespace
+
+/// Prepara os buffers para uma consulta de ateh num_iteracoes iteracoes.
+/// As marcas soh sao zeradas quando o numero de pontos muda ou quando as
+/// geracoes da consulta chegariam ao maior valor possivel.
+void EspacoBusca::DirecaoAnytime::preparar(Indice num_pontos,
+                                           uint32_t num_iteracoes) {
+  if (marca.size() != num_pontos || geracao >= UINT32_MAX - num_iteracoes) {
+    g.resize(num_pontos);
+    pai.resize(num_pontos, INDICE_INVALIDO);
+    alcance.assign(num_pontos, 0);
+    marca.assign(num_pontos, 0);
+    marca_inc.assign(num_pontos, 0);
+    geracao = 0;
+  }
+  consulta = ++geracao;
+  aberto.reset(num_pontos);
+  incons.clear();
+  num_fechados = 0;
+}
+
+/// Busca anytime (ARA*) entre os pontos de indices orig e dest
+template <class Politica>
+double Planejador::buscaAnytime(Indice orig, Indice dest,
+                                const OpcoesAnytime &O, EspacoBusca &E,
+                                int &NA, int &NF, ResultadoAnytime &R,
+                                Politica &P) const {
+  const uint32_t num_iteracoes =
+      uint32_t(ceil((O.epsilon_inicial - 1.0) / O.passo_epsilon)) + 1;
+
+  const Adjacencia &adj = mapa.adj;
+  EspacoBusca::DirecaoAnytime &D = E.anytime;
+  D.preparar(mapa.numPontos(), num_iteracoes);
+  vector<double> &g = D.g;
+  vector<Indice> &pai = D.pai;
+  HeapIndexado &aberto = D.aberto;
+  E.caminho.clear();
+  P.fimPreparo();
+
+  // Orcamento
+  const auto inicio = chrono::steady_clock::now();
+  uint64_t expansoes = 0;
+  auto esgotado = [&]() {
+    if (O.max_expansoes > 0 && expansoes >= O.max_expansoes)
+      return true;
+    if (expansoes % INTERVALO_VERIFICACAO != 0)
+      return false;
+    if (O.cancelamento && O.cancelamento->cancelado())
+      return true;
+    if (O.prazo_ms <= 0.0)
+      return false;
+    chrono::duration<double, milli> t = chrono::steady_clock::now() - inicio;
+    return t.count() >= O.prazo_ms;
+  };
+
+  double epsilon = O.epsilon_inicial;
+  g[orig] = 0.0;
+  pai[orig] = INDICE_INVALIDO;
+  D.alcance[orig] = D.geracao;
+  aberto.push(orig, epsilon * mapa.heuristica(orig, dest));
+  P.avaliouHeuristica();
+  P.aberto(aberto.size());
+
+  double melhor = -1.0;
+  R = ResultadoAnytime();
+  for (;;) {
+    // Uma iteracao: A* com peso epsilon, ateh que nenhum ponto do aberto
+    // possa levar a um caminho melhor que o atual ateh dest
+    bool interrompida = false;
+    while (!aberto.empty()) {
+      const double g_dest = D.alcancado(dest) ? g[dest] : HUGE_VAL;
+      if (!(g_dest > aberto.chave(aberto.topo())))
+        break;
+      if (esgotado()) {
+        interrompida = true;
+        break;
+      }
+      Indice atual = aberto.pop();
+      D.fechar(atual);
+      ++expansoes;
+      P.expandiu();
+
+      for (Indice e = adj.inicio[atual]; e < adj.fim[atual]; ++e) {
+        Indice suc = adj.vizinho[e];
+        P.relaxou();
+        double g_suc = g[atual] + adj.comprimento[e];
+        if (D.alcancado(suc) && !(g_suc < g[suc]))
+          continue;
+        g[suc] = g_suc;
+        pai[suc] = adj.rota[e];
+        D.alcance[suc] = D.geracao;
+        if (D.fechado(suc)) {
+          // Volta ao aberto soh na proxima iteracao
+          D.incluirIncons(suc);
+          continue;
+        }
+        double f_suc = g_suc + epsilon * mapa.heuristica(suc, dest);
+        P.avaliouHeuristica();
+        if (aberto.contem(suc)) {
+          aberto.diminuir(suc, f_suc);
+          P.diminuiu();
+        } else {
+          aberto.push(suc, f_suc);
+          P.aberto(aberto.size());
+        }
+      }
+    }
+    if (interrompida)
+      break;
+    if (!D.alcancado(dest)) {
+      // Nao existe caminho
+      R.completa = true;
+      break;
+    }
+
+    // Guarda o caminho da iteracao, com o limite da subotimalidade. Os
+    // pontos do caminho podem ter tido o g diminuido depois que o seu
+    // sucessor foi alcancado: o comprimento do caminho pode ser menor que
+    // g(dest), e eh somado ao longo dele.
+    refazerCaminho(pai, orig, dest, E.caminho);
+    melhor = 0.0;
+    for (size_t i = 1; i < E.caminho.size(); ++i)
+      melhor += mapa.comprimento[E.caminho[i].rota];
+    double limite = HUGE_VAL;
+    for (Indice k = 0; k < aberto.size(); ++k) {
+      Indice pt = aberto[k];
+      limite = min(limite, g[pt] + mapa.heuristica(pt, dest));
+    }
+    for (Indice pt : D.incons)
+      limite = min(limite, g[pt] + mapa.heuristica(pt, dest));
+    P.avaliouHeuristica(unsigned(aberto.size() + D.incons.size()));
+    R.subotimalidade =
+        (limite >= melhor) ? 1.0 : min(epsilon, melhor / limite);
+    ++R.iteracoes;
+    if (R.subotimalidade <= 1.0 || epsilon <= 1.0) {
+      R.subotimalidade = 1.0;
+      R.completa = true;
+      break;
+    }
+
+    // Proxima iteracao: peso menor, fechado vazio, e o aberto com os
+    // inconsistentes e as novas chaves
+    epsilon = max(1.0, epsilon - O.passo_epsilon);
+    for (Indice k = 0; k < aberto.size(); ++k)
+      D.incons.push_back(aberto[k]);
+    aberto.reset(mapa.numPontos());
+    ++D.geracao;
+    for (Indice pt : D.incons)
+      aberto.push(pt, g[pt] + epsilon * mapa.heuristica(pt, dest));
+    P.avaliouHeuristica(unsigned(D.incons.size()));
+    P.aberto(aberto.size());
+    D.incons.clear();
+  }
+
+  NA = aberto.size();
+  NF = D.num_fechados;
+  P.fimBusca();
+  return melhor;
+}
+
+/// Implementacao de calculaCaminhoAnytime, com a politica de estatisticas P
+template <class TipoCaminho, class Politica>
+double Planejador::calcularAnytime(const IDPonto &id_origem,
+                                   const IDPonto &id_destino, TipoCaminho &C,
+                                   int &NA, int &NF, EspacoBusca &E,
+                                   const OpcoesAnytime &O,
+                                   ResultadoAnytime &R, Politica &P) const {
+  C.clear();
+  R = ResultadoAnytime();
+
+  try {
+    // Mapa vazio
+    if (empty())
+      throw 1;
+    Indice orig = mapa.id_pontos.find(id_origem.str());
+    if (orig == INDICE_INVALIDO)
+      throw 4;
+    Indice dest = mapa.id_pontos.find(id_destino.str());
+    if (dest == INDICE_INVALIDO)
+      throw 5;
+
+    // Orcamento ou parametros invalidos: throw 7
+    if (!(O.epsilon_inicial >= 1.0) || !(O.passo_epsilon > 0.0) ||
+        !((O.epsilon_inicial - 1.0) / O.passo_epsilon <=
+          MAX_ITERACOES_ANYTIME) ||
+        !(O.prazo_ms >= 0.0))
+      throw 7;
+
+    // Componentes diferentes: nao existe caminho, e nao ha busca
+    if (!mapa.mesmaComponente(orig, dest)) {
+      R.completa = true;
+      NA = NF = 0;
+      return -1.0;
+    }
+
+    // Consulta jah calculada: o caminho mais curto
+    double compr;
+    if (cache.ativo() && cache.buscar(orig, dest, compr, E.caminho, NA, NF)) {
+      R.subotimalidade = 1.0;
+      R.completa = true;
+      converterCaminho(E.caminho, C);
+      P.fimReconstrucao();
+      return compr;
+    }
+
+    compr = buscaAnytime(orig, dest, O, E, NA, NF, R, P);
+    // Soh o caminho mais curto vai para o cache
+    if (R.completa)
+      cache.incluir(orig, dest, compr, E.caminho, NA, NF);
+    converterCaminho(E.caminho, C);
+    P.fimReconstrucao();
+    return compr;
+  } catch (int i) {
+    cerr << "Erro " << i << " no calculo do caminho\n";
+    P.erro(i);
+  }
+
+  NA = NF = -1;
+  return -1.0;
+}
+
+/// Versao de calculaCaminho com orcamento (busca anytime)
+double Planejador::calculaCaminhoAnytime(const IDPonto &id_origem,
+                                         const IDPonto &id_destino,
+                                         Caminho &C, int &NA, int &NF,
+                                         EspacoBusca &E,
+                                         const OpcoesAnytime &O,
+                                         ResultadoAnytime &R) const {
+  SemEstatisticas P;
+  return calcularAnytime(id_origem, id_destino, C, NA, NF, E, O, R, P);
+}
+
+/// Versao de calculaCaminho com orcamento que coleta estatisticas
+double Planejador::calculaCaminhoAnytime(const IDPonto &id_origem,
+                                         const IDPonto &id_destino,
+                                         CaminhoContiguo &C,
+                                         EstatisticasBusca &est,
+                                         EspacoBusca &E,
+                                         const OpcoesAnytime &O,
+                                         ResultadoAnytime &R) const {
+  ComEstatisticas P(est);
+  int NA, NF;
+  double compr =
+      calcularAnytime(id_origem, id_destino, C, NA, NF, E, O, R, P);
+  est.aberto_final = NA;
+  est.fechado_final = NF;
+  TotaisBusca::global().acumular(est);
+  return compr;
+}
@@ -0,0 +1,101 @@
+#include <future>
+#include <memory>
+#include <mutex>
+
+#include "planejador.h"
+
+using namespace std;
+
+/* *************************
+ * CLASSE PLANEJADORAOVIVO *
+ ************************* */
+
+// A troca de instantaneo segue a ideia do RCU (read-copy-update): o
+// instantaneo publicado nunca eh alterado, e uma recarga monta outro
+// (lendo os arquivos ou copiando o atual e aplicando um lote) antes de
+// publica-lo. A contagem de referencias do shared_ptr faz o papel do
+// periodo de carencia: o instantaneo antigo soh eh destruido quando o
+// ultimo Leitor que o referencia passa para o novo.
+
+/// Passa a referenciar o instantaneo publicado
+void PlanejadorAoVivo::Leitor::atualizar() {
+  lock_guard<mutex> trava(fonte.m);
+  atual = fonte.atual;
+  versao = fonte.versao.load(memory_order_relaxed);
+}
+
+/// Instantaneo publicado
+PlanejadorAoVivo::Instantaneo PlanejadorAoVivo::instantaneo() const {
+  lock_guard<mutex> trava(m);
+  return atual;
+}
+
+/// Publica P como o novo instantaneo
+void PlanejadorAoVivo::publicar(Instantaneo P) {
+  Instantaneo antigo;
+  {
+    lock_guard<mutex> trava(m);
+    antigo = std::move(atual);
+    atual = std::move(P);
+    versao.fetch_add(1, memory_order_release);
+  }
+  // Se nenhum Leitor referencia o antigo, ele eh destruido aqui, fora do
+  // mutex
+}
+
+/// Prepara o novo mapa P com a heuristica e o cache do instantaneo
+/// publicado
+void PlanejadorAoVivo::prepararComoAtual(Planejador &P) const {
+  const Instantaneo A = instantaneo();
+  P.ativarCache(A->estatisticasCache().capacidade);
+  // Os marcos de P (ex: gravados no arquivo binario) sao mantidos
+  if (P.numMarcos() == 0 && A->numMarcos() > 0)
+    P.calcularMarcos(A->numMarcos(), A->selecaoMarcos());
+  if (A->temHierarquia() && !P.temHierarquia())
+    P.calcularHierarquia();
+}
+
+/// Leh um novo mapa dos arquivos e o publica
+bool PlanejadorAoVivo::ler(const string &arq_pontos, const string &arq_rotas,
+                           unsigned num_threads) {
+  lock_guard<mutex> trava(m_recarga);
+  auto P = make_shared<Planejador>();
+  if (!P->ler(arq_pontos, arq_rotas, num_threads))
+    return false;
+  prepararComoAtual(*P);
+  publicar(std::move(P));
+  return true;
+}
+
+/// Leh um novo mapa de um arquivo binario e o publica
+bool PlanejadorAoVivo::lerBinario(const string &arq, bool verificar) {
+  lock_guard<mutex> trava(m_recarga);
+  auto P = make_shared<Planejador>();
+  if (!P->lerBinario(arq, verificar))
+    return false;
+  prepararComoAtual(*P);
+  publicar(std::move(P));
+  return true;
+}
+
+/// Leh um novo mapa dos arquivos em segundo plano
+future<bool> PlanejadorAoVivo::lerEmSegundoPlano(const string &arq_pontos,
+                                                 const string &arq_rotas,
+                                                 unsigned num_threads) {
+  return async(launch::async, [this, arq_pontos, arq_rotas, num_threads] {
+    return ler(arq_pontos, arq_rotas, num_threads);
+  });
+}
+
+/// Aplica o lote L a uma copia do mapa atual e a publica
+bool PlanejadorAoVivo::aplicar(const LoteAlteracoes &L) {
+  lock_guard<mutex> trava(m_recarga);
+  // A copia do cache comeca vazia, com a mesma capacidade
+  auto P = make_shared<Planejador>(*instantaneo());
+  if (!P->aplicar(L))
+    return false;
+  // O lote pode ter descartado os marcos e as Contraction Hierarchies
+  prepararComoAtual(*P);
+  publicar(std::move(P));
+  return true;
+}
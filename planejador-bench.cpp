@@ -0,0 +1,628 @@
+#include <linux/perf_event.h>
+#include <sys/ioctl.h>
+#include <sys/resource.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <new>
+#include <random>
+#include <string>
+#include <vector>
+
+#include "planejador.h"
+
+using namespace std;
+
+/* *************************
+ * BENCHMARK             *
+ ************************* */
+
+// Mede o desempenho do planejador em mapas sinteticos (ou em um mapa dado)
+// e imprime os resultados em JSON na saida padrao, para comparacao entre
+// versoes. As mensagens de progresso vao para a saida de erro.
+//
+// Em cada modo, as consultas sao repetidas com o caminho contiguo e uma
+// area de trabalho jah usada por elas, contando as alocacoes de memoria
+// (operator new): em regime, as consultas nao devem alocar. Se alocarem, o
+// benchmark termina com erro.
+//
+// Antes dos modos, o calculo da haversine em lote (TrigPontos::
+// haversineLote) eh conferido em pontos aleatorios, no mundo todo e em uma
+// regiao do tamanho de uma cidade: o resultado com AVX2 (se o processador
+// tiver) deve ter erro relativo de ateh ERRO_LOTE_VETORIZADO em relacao a
+// versao escalar, e as duas, de ateh ERRO_LOTE_HAVERSINE em relacao a
+// ::haversine, nos pares a mais de 1 km (em pontos mais proximos, o erro
+// de arredondamento da propria ::haversine domina). Acima disso, o
+// benchmark termina com erro.
+//
+// Tambem antes dos modos, o lote paralelo eh conferido quando chamado de dentro
+// do laco de outro pool, com mais threads (os dados por thread do lote sao
+// do tamanho do pool interno). Se os resultados diferirem dos das consultas
+// uma de cada vez, o benchmark termina com erro.
+//
+// Quando o processador permite (perf_event_open, em geral nao disponivel em
+// maquinas virtuais), as falhas de cache das consultas tambem sao contadas.
+// Para medir o efeito da reordenacao do mapa, compare um mapa embaralhado
+// com e sem --reordenar 1.
+//
+// Uso: planejador-bench [opcoes]
+//   --pontos N        pontos do mapa sintetico (padrao 20000)
+//   --consultas N     consultas aleatorias por modo (padrao 2000)
+//   --semente N       semente do gerador aleatorio (padrao 1)
+//   --modos LISTA     modos separados por virgula, entre uni, bi, alt,
+//                     altbi, ch, dijkstra, corda, float e metros (padrao
+//                     uni,bi). Os quatro ultimos sao o A* unidirecional com
+//                     outra heuristica (nenhuma ou a corda) ou outro tipo
+//                     de custos (ver HeuristicaBusca e CustoBusca)
+//   --marcos N        marcos dos modos alt e altbi (padrao 16)
+//   --threads N       mede tambem a vazao do lote paralelo com N threads
+//                     (padrao 0: nao mede)
+//   --dir DIR         diretorio dos arquivos gerados (padrao: temporario)
+//   --mapa P R        usa os arquivos de pontos P e de rotas R em vez de
+//                     gerar um mapa
+//   --embaralhar 0|1  grava os pontos e as rotas do mapa gerado em ordem
+//                     aleatoria, como em arquivos sem relacao entre a ordem
+//                     e a posicao dos pontos (padrao 0)
+//   --reordenar 0|1   reordena o mapa (Planejador::reordenarMapa) depois de
+//                     lido (padrao 0)
+
+namespace {
+
+/// Numero de chamadas de operator new no processo
+atomic<size_t> num_alocacoes(0);
+
+/// Erro relativo maximo da haversine em lote com AVX2 em relacao a versao
+/// escalar
+constexpr double ERRO_LOTE_VETORIZADO = 1e-12;
+/// Erro relativo maximo da haversine em lote em relacao a ::haversine, nos
+/// pares a mais de 1 km
+constexpr double ERRO_LOTE_HAVERSINE = 1e-7;
+
+} // namespace
+
+// Alocacao global que conta as chamadas (as demais formas de new usam
+// esta). Como a original, aloca com malloc, e o operator delete original,
+// que libera com free, continua valendo.
+void *operator new(size_t tam) {
+  ++num_alocacoes;
+  if (void *p = malloc(tam > 0 ? tam : 1))
+    return p;
+  throw bad_alloc();
+}
+
+namespace {
+
+/// Um modo de busca medido pelo benchmark
+struct ModoBench {
+  string nome;
+  ModoBusca modo;
+  bool marcos;     // Usa a heuristica ALT
+  bool politicas;  // Escolhe a heuristica e os custos do A* unidirecional
+  HeuristicaBusca heuristica;
+  CustoBusca custo;
+};
+
+const ModoBench MODOS[] = {
+    {"uni", ModoBusca::UNIDIRECIONAL, false, false, HeuristicaBusca::MARCOS,
+     CustoBusca::DOUBLE},
+    {"bi", ModoBusca::BIDIRECIONAL, false, false, HeuristicaBusca::MARCOS,
+     CustoBusca::DOUBLE},
+    {"alt", ModoBusca::UNIDIRECIONAL, true, false, HeuristicaBusca::MARCOS,
+     CustoBusca::DOUBLE},
+    {"altbi", ModoBusca::BIDIRECIONAL, true, false, HeuristicaBusca::MARCOS,
+     CustoBusca::DOUBLE},
+    {"ch", ModoBusca::HIERARQUIA, false, false, HeuristicaBusca::MARCOS,
+     CustoBusca::DOUBLE},
+    {"dijkstra", ModoBusca::UNIDIRECIONAL, false, true, HeuristicaBusca::ZERO,
+     CustoBusca::DOUBLE},
+    {"corda", ModoBusca::UNIDIRECIONAL, false, true, HeuristicaBusca::CORDA,
+     CustoBusca::DOUBLE},
+    {"float", ModoBusca::UNIDIRECIONAL, false, true, HeuristicaBusca::MARCOS,
+     CustoBusca::FLOAT},
+    {"metros", ModoBusca::UNIDIRECIONAL, false, true, HeuristicaBusca::MARCOS,
+     CustoBusca::METROS},
+};
+
+/// Opcoes da linha de comando
+struct Opcoes {
+  size_t num_pontos = 20000;
+  size_t num_consultas = 2000;
+  unsigned semente = 1;
+  vector<ModoBench> modos;
+  unsigned num_marcos = 16;
+  unsigned num_threads = 0;
+  string dir;
+  string arq_pontos, arq_rotas; // Mapa dado (vazios se gerado)
+  bool embaralhar = false;
+  bool reordenar = false;
+};
+
+/// Segundos decorridos desde inicio
+double segundos(chrono::steady_clock::time_point inicio) {
+  return chrono::duration<double>(chrono::steady_clock::now() - inicio)
+      .count();
+}
+
+/// Contador das falhas de cache do processador na thread atual
+class ContadorCache {
+private:
+  int fd; // -1 se o contador nao estiver disponivel
+
+public:
+  ContadorCache() : fd(-1) {
+    perf_event_attr A;
+    memset(&A, 0, sizeof(A));
+    A.type = PERF_TYPE_HARDWARE;
+    A.size = sizeof(A);
+    A.config = PERF_COUNT_HW_CACHE_MISSES;
+    A.disabled = 1;
+    A.exclude_kernel = 1;
+    A.exclude_hv = 1;
+    fd = int(syscall(SYS_perf_event_open, &A, 0, -1, -1, 0));
+  }
+  ContadorCache(const ContadorCache &) = delete;
+  ContadorCache &operator=(const ContadorCache &) = delete;
+  ~ContadorCache() {
+    if (fd >= 0)
+      close(fd);
+  }
+  /// Zera e inicia a contagem
+  void iniciar() {
+    if (fd >= 0) {
+      ioctl(fd, PERF_EVENT_IOC_RESET, 0);
+      ioctl(fd, PERF_EVENT_IOC_ENABLE, 0);
+    }
+  }
+  /// Para a contagem e retorna o numero de falhas (-1 se indisponivel)
+  long long parar() {
+    uint64_t falhas;
+    if (fd < 0)
+      return -1;
+    ioctl(fd, PERF_EVENT_IOC_DISABLE, 0);
+    if (read(fd, &falhas, sizeof(falhas)) != ssize_t(sizeof(falhas)))
+      return -1;
+    return (long long)(falhas);
+  }
+};
+
+/// Pico de memoria residente do processo, em KB
+long picoRSS() {
+  rusage uso;
+  getrusage(RUSAGE_SELF, &uso);
+  return uso.ru_maxrss; // Em KB no Linux
+}
+
+/// Leh as opcoes da linha de comando. Retorna false se forem invalidas.
+bool lerOpcoes(int argc, char *argv[], Opcoes &O) {
+  string modos = "uni,bi";
+  for (int a = 1; a < argc; ++a) {
+    string opcao = argv[a];
+    // Todas as opcoes tem ao menos um valor
+    if (a + 1 >= argc)
+      return false;
+    if (opcao == "--pontos")
+      O.num_pontos = strtoul(argv[++a], nullptr, 10);
+    else if (opcao == "--consultas")
+      O.num_consultas = strtoul(argv[++a], nullptr, 10);
+    else if (opcao == "--semente")
+      O.semente = unsigned(strtoul(argv[++a], nullptr, 10));
+    else if (opcao == "--modos")
+      modos = argv[++a];
+    else if (opcao == "--marcos")
+      O.num_marcos = unsigned(strtoul(argv[++a], nullptr, 10));
+    else if (opcao == "--threads")
+      O.num_threads = unsigned(strtoul(argv[++a], nullptr, 10));
+    else if (opcao == "--dir")
+      O.dir = argv[++a];
+    else if (opcao == "--embaralhar")
+      O.embaralhar = strtoul(argv[++a], nullptr, 10) != 0;
+    else if (opcao == "--reordenar")
+      O.reordenar = strtoul(argv[++a], nullptr, 10) != 0;
+    else if (opcao == "--mapa" && a + 2 < argc) {
+      O.arq_pontos = argv[++a];
+      O.arq_rotas = argv[++a];
+    } else
+      return false;
+  }
+
+  // Modos pedidos, na ordem dada
+  size_t ini = 0;
+  while (ini <= modos.size()) {
+    size_t fim = min(modos.find(',', ini), modos.size());
+    string nome = modos.substr(ini, fim - ini);
+    auto M = find_if(begin(MODOS), end(MODOS),
+                     [&](const ModoBench &B) { return B.nome == nome; });
+    if (M == end(MODOS))
+      return false;
+    O.modos.push_back(*M);
+    ini = fim + 1;
+  }
+
+  if (O.dir.empty())
+    O.dir = filesystem::temp_directory_path().string();
+  return O.num_pontos >= 2 && O.num_consultas >= 1;
+}
+
+/// Gera um mapa sintetico semelhante a uma malha viaria: uma grade de
+/// quadras com as posicoes dos pontos perturbadas, em que algumas ruas
+/// faltam e algumas quadras tem diagonais. A cada 10 linhas e colunas, uma
+/// avenida completa e quase reta; as demais ruas sao mais sinuosas (o
+/// comprimento da rota eh de 5% a 40% maior que a distancia em linha reta).
+/// Se O.embaralhar, os pontos e as rotas sao gravados em ordem aleatoria
+/// (o mapa eh o mesmo). Retorna o numero de rotas geradas.
+size_t gerarMapa(const Opcoes &O, vector<IDPonto> &ids) {
+  static const double LAT0 = -5.8, LON0 = -35.2;
+  static const double PASSO = 0.005; // Distancia entre quadras (em graus)
+
+  mt19937 sorteio(O.semente);
+  uniform_real_distribution<double> U(0.0, 1.0);
+  const size_t n = O.num_pontos;
+  const size_t lado = size_t(ceil(sqrt(double(n))));
+
+  // Pontos: coordenadas arredondadas como no arquivo, para que os
+  // comprimentos das rotas nunca sejam menores que a haversine lida
+  vector<double> lat(n), lon(n);
+  for (size_t k = 0; k < n; ++k) {
+    const size_t i = k / lado, j = k % lado;
+    lat[k] = round((LAT0 + (i + 0.6 * U(sorteio) - 0.3) * PASSO) * 1e6) / 1e6;
+    lon[k] = round((LON0 + (j + 0.6 * U(sorteio) - 0.3) * PASSO) * 1e6) / 1e6;
+  }
+  // Ordem de gravacao (sorteada a parte, para nao alterar o mapa)
+  mt19937 embaralhador(O.semente + 2);
+  vector<size_t> ordem(n);
+  for (size_t k = 0; k < n; ++k)
+    ordem[k] = k;
+  if (O.embaralhar)
+    shuffle(ordem.begin(), ordem.end(), embaralhador);
+  ofstream P(O.arq_pontos, ios::binary);
+  P << "ID;Nome;Latitude;Longitude\n";
+  char linha[128];
+  for (size_t k : ordem) {
+    snprintf(linha, sizeof(linha), "#%zu;Ponto %zu;%.6f;%.6f\n", k, k, lat[k],
+             lon[k]);
+    P << linha;
+  }
+
+  // Rotas para a direita, para baixo e, as vezes, na diagonal (gravadas no
+  // final, se embaralhadas)
+  ofstream R(O.arq_rotas, ios::binary);
+  R << "ID;Nome;Extremidade 1;Extremidade 2;Comprimento\n";
+  size_t num_rotas = 0;
+  vector<string> linhas_rotas;
+  auto rota = [&](size_t a, size_t b, bool avenida) {
+    double fator = avenida ? 1.001 + 0.02 * U(sorteio)
+                           : 1.05 + 0.35 * U(sorteio);
+    double compr = haversine(lat[a], lon[a], lat[b], lon[b]) * fator;
+    snprintf(linha, sizeof(linha), "&%zu;%s %zu;#%zu;#%zu;%.6f\n", num_rotas,
+             avenida ? "Avenida" : "Rua", num_rotas, a, b, compr);
+    if (O.embaralhar)
+      linhas_rotas.push_back(linha);
+    else
+      R << linha;
+    ++num_rotas;
+  };
+  for (size_t k = 0; k < n; ++k) {
+    const size_t i = k / lado, j = k % lado;
+    if (j + 1 < lado && k + 1 < n && (i % 10 == 0 || U(sorteio) < 0.85))
+      rota(k, k + 1, i % 10 == 0);
+    if (k + lado < n && (j % 10 == 0 || U(sorteio) < 0.85))
+      rota(k, k + lado, j % 10 == 0);
+    if (j + 1 < lado && k + lado + 1 < n && U(sorteio) < 0.1)
+      rota(k, k + lado + 1, false);
+  }
+  shuffle(linhas_rotas.begin(), linhas_rotas.end(), embaralhador);
+  for (const string &L : linhas_rotas)
+    R << L;
+
+  ids.resize(n);
+  for (size_t k = 0; k < n; ++k)
+    ids[k].set("#" + to_string(k));
+  return num_rotas;
+}
+
+/// Leh os identificadores dos pontos de um arquivo de pontos
+void lerIds(const string &arq, vector<IDPonto> &ids) {
+  ifstream A(arq);
+  string linha;
+  getline(A, linha); // Cabecalho
+  while (getline(A, linha)) {
+    IDPonto id;
+    id.set(linha.substr(0, linha.find(';')));
+    if (id.valid())
+      ids.push_back(std::move(id));
+  }
+}
+
+/// Maiores erros relativos da haversine em lote
+struct ErrosLote {
+  double vetorizado = 0.0; // AVX2 em relacao a versao escalar
+  double haversine = 0.0;  // Em relacao a ::haversine (pares a mais de 1 km)
+};
+
+/// Confere TrigPontos::haversineLote e haversineLoteEscalar contra
+/// ::haversine em pontos aleatorios, no mundo todo e em uma regiao pequena
+ErrosLote conferirHaversineLote(unsigned semente) {
+  // Numero de pontos impar, para que o lote com AVX2 tenha restos
+  const size_t n = 4001, num_alvos = 50;
+  mt19937 sorteio(semente);
+  ErrosLote E;
+  const double regioes[2][4] = {{-80.0, 80.0, -180.0, 180.0},
+                                {-6.0, -5.0, -36.0, -35.0}};
+  for (const double *R : regioes) {
+    uniform_real_distribution<double> lat(R[0], R[1]), lon(R[2], R[3]);
+    Arranjo<double> latitude, longitude;
+    for (size_t i = 0; i < n; ++i) {
+      latitude.push_back(lat(sorteio));
+      longitude.push_back(lon(sorteio));
+    }
+    TrigPontos T;
+    T.calcular(latitude, longitude);
+    vector<double> vetorizado(n), escalar(n);
+    for (Indice alvo = 0; alvo < num_alvos; ++alvo) {
+      T.haversineLote(alvo, n, vetorizado.data());
+      T.haversineLoteEscalar(alvo, n, escalar.data());
+      for (size_t k = 0; k < n; ++k) {
+        const double h = haversine(latitude[alvo], longitude[alvo],
+                                   latitude[k], longitude[k]);
+        if (h <= 1.0)
+          continue;
+        E.vetorizado =
+            max(E.vetorizado, fabs(vetorizado[k] - escalar[k]) / escalar[k]);
+        E.haversine = max({E.haversine, fabs(vetorizado[k] - h) / h,
+                           fabs(escalar[k] - h) / h});
+      }
+    }
+  }
+  return E;
+}
+
+/// Confere o lote paralelo chamado de dentro do laco de um pool externo
+/// com mais threads que o pool do lote: cada thread externa calcula o
+/// mesmo lote, que deve ter os resultados das consultas uma de cada vez.
+/// Retorna false se algum resultado diferir.
+bool conferirPoolAninhado(const Planejador &G,
+                          const vector<pair<IDPonto, IDPonto>> &consultas) {
+  const vector<pair<IDPonto, IDPonto>> lote(
+      consultas.begin(), consultas.begin() + min<size_t>(consultas.size(), 64));
+  vector<double> esperado(lote.size());
+  EspacoBusca E;
+  Caminho C;
+  int NA, NF;
+  for (size_t i = 0; i < lote.size(); ++i)
+    esperado[i] = G.calculaCaminho(lote[i].first, lote[i].second, C, NA, NF,
+                                   E);
+
+  PoolThreads externo(4), interno(1);
+  atomic<bool> iguais(true);
+  externo.paraCada(externo.size(), [&](size_t, unsigned) {
+    vector<ResultadoCaminho> R =
+        G.calculaCaminhos(lote, ModoBusca::UNIDIRECIONAL, interno);
+    for (size_t i = 0; i < lote.size(); ++i)
+      if (R[i].comprimento != esperado[i])
+        iguais = false;
+  });
+  return iguais;
+}
+
+/// Valor do percentil q (0 a 1) de valores jah ordenados
+double percentil(const vector<double> &ordenados, double q) {
+  size_t pos = size_t(ceil(q * double(ordenados.size())));
+  return ordenados[pos > 0 ? pos - 1 : 0];
+}
+
+} // namespace
+
+int main(int argc, char *argv[]) {
+  Opcoes O;
+  if (!lerOpcoes(argc, argv, O)) {
+    cerr << "Uso: " << argv[0]
+         << " [--pontos N] [--consultas N] [--semente N] [--modos LISTA]"
+            " [--marcos N] [--threads N] [--dir DIR] [--mapa P R]"
+            " [--embaralhar 0|1] [--reordenar 0|1]\n";
+    return 1;
+  }
+
+  // Mapa: gerado ou dado
+  vector<IDPonto> ids;
+  double t_gerar = 0.0;
+  size_t num_rotas = 0;
+  const bool gerado = O.arq_pontos.empty();
+  if (gerado) {
+    O.arq_pontos = O.dir + "/bench-pontos.txt";
+    O.arq_rotas = O.dir + "/bench-rotas.txt";
+    cerr << "Gerando mapa com " << O.num_pontos << " pontos...\n";
+    auto inicio = chrono::steady_clock::now();
+    num_rotas = gerarMapa(O, ids);
+    t_gerar = segundos(inicio);
+  } else {
+    lerIds(O.arq_pontos, ids);
+  }
+
+  Planejador G;
+  cerr << "Lendo mapa...\n";
+  auto inicio = chrono::steady_clock::now();
+  if (!G.ler(O.arq_pontos, O.arq_rotas) || ids.size() < 2) {
+    cerr << "Erro na leitura dos arquivos do mapa\n";
+    return 1;
+  }
+  const double t_ler = segundos(inicio);
+  const long rss_ler = picoRSS();
+
+  // Reordenacao do mapa (antes de gravar o binario, que fica na nova ordem)
+  double t_reordenar = 0.0;
+  if (O.reordenar) {
+    inicio = chrono::steady_clock::now();
+    G.reordenarMapa();
+    t_reordenar = segundos(inicio);
+  }
+
+  // Mapa binario
+  const string arq_bin = O.dir + "/bench-mapa.bin";
+  inicio = chrono::steady_clock::now();
+  G.salvarBinario(arq_bin);
+  const double t_salvar_bin = segundos(inicio);
+  inicio = chrono::steady_clock::now();
+  G.lerBinario(arq_bin);
+  const double t_ler_bin = segundos(inicio);
+  remove(arq_bin.c_str());
+
+  // Consultas aleatorias, as mesmas em todos os modos
+  mt19937 sorteio(O.semente + 1);
+  uniform_int_distribution<size_t> ponto(0, ids.size() - 1);
+  vector<pair<IDPonto, IDPonto>> consultas(O.num_consultas);
+  for (auto &C : consultas)
+    C = {ids[ponto(sorteio)], ids[ponto(sorteio)]};
+
+  cerr << "Conferindo a haversine em lote...\n";
+  const ErrosLote erros_lote = conferirHaversineLote(O.semente);
+  const bool lote_ok = erros_lote.vetorizado <= ERRO_LOTE_VETORIZADO &&
+                       erros_lote.haversine <= ERRO_LOTE_HAVERSINE;
+  cerr << "Conferindo o lote em pool aninhado...\n";
+  const bool aninhado_ok = conferirPoolAninhado(G, consultas);
+
+  cout.precision(6);
+  cout << "{\n"
+       << "  \"mapa\": {\"gerado\": " << (gerado ? "true" : "false")
+       << ", \"pontos\": " << ids.size()
+       << ", \"rotas\": " << (gerado ? to_string(num_rotas) : "null")
+       << ", \"semente\": " << O.semente
+       << ", \"embaralhado\": " << (O.embaralhar ? "true" : "false")
+       << ", \"reordenado\": " << (O.reordenar ? "true" : "false") << "},\n"
+       << "  \"gerar_s\": " << t_gerar << ",\n"
+       << "  \"ler_s\": " << t_ler << ",\n"
+       << "  \"reordenar_s\": " << t_reordenar << ",\n"
+       << "  \"salvar_binario_s\": " << t_salvar_bin << ",\n"
+       << "  \"ler_binario_s\": " << t_ler_bin << ",\n"
+       << "  \"rss_apos_ler_kb\": " << rss_ler << ",\n"
+       << "  \"haversine_lote\": {\"avx2\": "
+       << (TrigPontos::loteVetorizado() ? "true" : "false")
+       << ", \"erro_rel_avx2\": " << erros_lote.vetorizado
+       << ", \"erro_rel_haversine\": " << erros_lote.haversine << "},\n"
+       << "  \"pool_aninhado_ok\": " << (aninhado_ok ? "true" : "false")
+       << ",\n"
+       << "  \"modos\": [";
+
+  Caminho C;
+  CaminhoContiguo contiguo; // Modos que escolhem as politicas do A*
+  EspacoBusca espaco;
+  vector<double> latencias(consultas.size());
+  ContadorCache contador;
+  bool alocou = false;
+  for (size_t m = 0; m < O.modos.size(); ++m) {
+    const ModoBench &B = O.modos[m];
+    cerr << "Modo " << B.nome << "...\n";
+
+    // Preparo do modo
+    inicio = chrono::steady_clock::now();
+    if (B.marcos != (G.numMarcos() > 0))
+      G.calcularMarcos(B.marcos ? O.num_marcos : 0);
+    if (B.modo == ModoBusca::HIERARQUIA && !G.temHierarquia())
+      G.calcularHierarquia();
+    const double t_preparo = segundos(inicio);
+
+    // Consultas, uma de cada vez
+    double soma_NA = 0.0, soma_NF = 0.0;
+    size_t sem_caminho = 0;
+    auto inicio_consultas = chrono::steady_clock::now();
+    contador.iniciar();
+    for (size_t i = 0; i < consultas.size(); ++i) {
+      int NA, NF;
+      inicio = chrono::steady_clock::now();
+      const auto &Q = consultas[i];
+      double compr =
+          B.politicas ? G.calculaCaminho(Q.first, Q.second, contiguo, NA, NF,
+                                         espaco, B.heuristica, B.custo)
+                      : G.calculaCaminho(Q.first, Q.second, C, NA, NF, B.modo);
+      latencias[i] = 1000.0 * segundos(inicio);
+      soma_NA += NA;
+      soma_NF += NF;
+      if (compr < 0.0)
+        ++sem_caminho;
+    }
+    const long long falhas_cache = contador.parar();
+    const double t_consultas = segundos(inicio_consultas);
+    sort(latencias.begin(), latencias.end());
+    const double num = double(consultas.size());
+
+    cout << (m > 0 ? "," : "") << "\n    {\"modo\": \"" << B.nome << "\""
+         << ", \"preparo_s\": " << t_preparo
+         << ", \"consultas\": " << consultas.size()
+         << ", \"p50_ms\": " << percentil(latencias, 0.50)
+         << ", \"p95_ms\": " << percentil(latencias, 0.95)
+         << ", \"p99_ms\": " << percentil(latencias, 0.99)
+         << ", \"max_ms\": " << latencias.back()
+         << ", \"consultas_por_s\": " << num / t_consultas
+         << ", \"NA_medio\": " << soma_NA / num
+         << ", \"NF_medio\": " << soma_NF / num
+         << ", \"sem_caminho\": " << sem_caminho
+         << ", \"falhas_cache_por_consulta\": "
+         << (falhas_cache >= 0 ? to_string(double(falhas_cache) / num)
+                               : string("null"));
+
+    // Alocacoes em regime: a 1a passada dimensiona os buffers, e a 2a, com
+    // as mesmas consultas, nao deve alocar
+    {
+      EspacoBusca E;
+      CaminhoContiguo CC;
+      int NA, NF;
+      auto consultar = [&](const pair<IDPonto, IDPonto> &Q) {
+        if (B.politicas)
+          G.calculaCaminho(Q.first, Q.second, CC, NA, NF, E, B.heuristica,
+                           B.custo);
+        else
+          G.calculaCaminho(Q.first, Q.second, CC, NA, NF, E, B.modo);
+      };
+      for (const auto &Q : consultas)
+        consultar(Q);
+      const size_t antes = num_alocacoes;
+      for (const auto &Q : consultas)
+        consultar(Q);
+      const size_t alocacoes = num_alocacoes - antes;
+      if (alocacoes > 0)
+        alocou = true;
+      cout << ", \"alocacoes_por_consulta\": " << alocacoes / num;
+    }
+
+    // Vazao do lote paralelo (que nao escolhe as politicas do A*)
+    if (O.num_threads > 0 && !B.politicas) {
+      PoolThreads pool(O.num_threads);
+      inicio = chrono::steady_clock::now();
+      G.calculaCaminhos(consultas, B.modo, pool);
+      cout << ", \"threads\": " << O.num_threads
+           << ", \"lote_consultas_por_s\": " << num / segundos(inicio);
+    }
+    cout << "}";
+  }
+
+  cout << "\n  ],\n"
+       << "  \"pico_rss_kb\": " << picoRSS() << "\n"
+       << "}\n";
+
+  if (gerado) {
+    remove(O.arq_pontos.c_str());
+    remove(O.arq_rotas.c_str());
+  }
+  if (!lote_ok) {
+    cerr << "Erro: haversine em lote fora da tolerancia\n";
+    return 1;
+  }
+  if (!aninhado_ok) {
+    cerr << "Erro: lote em pool aninhado com resultados diferentes\n";
+    return 1;
+  }
+  if (alocou) {
+    cerr << "Erro: consultas em regime alocaram memoria\n";
+    return 1;
+  }
+  return 0;
+}
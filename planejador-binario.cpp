@@ -0,0 +1,538 @@
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+#include <fcntl.h>
+#include <iostream>
+#include <type_traits>
+#include <unistd.h>
+
+#include "planejador.h"
+
+using namespace std;
+
+/* *************************
+ * FORMATO BINARIO       *
+ ************************* */
+
+// O arquivo binario eh composto por:
+// - um cabecalho de 64 bytes (Cabecalho);
+// - a tabela de secoes (um DescritorSecao por secao);
+// - as secoes, cada uma com o conteudo de um Arranjo do Mapa, gravado
+//   exatamente como estah na memoria e iniciando em um deslocamento
+//   multiplo de 64 bytes, de modo que o arquivo mapeado na memoria pode ser
+//   usado diretamente pelos arranjos.
+// O checksum cobre todo o conteudo apos o cabecalho.
+// Secoes de tipo desconhecido sao ignoradas na leitura, e secoes opcionais
+// podem faltar: novos dados podem ser acrescentados sem mudar a versao.
+
+namespace {
+
+/// Identificacao do formato
+const char MAGICA[8] = {'P', 'L', 'A', 'N', 'E', 'J', 'A', 'D'};
+/// Versao do formato: a leitura recusa versoes diferentes
+const uint32_t VERSAO_BINARIO = 1;
+/// Marca da ordem dos bytes da maquina que gravou o arquivo
+const uint32_t ENDIANIDADE = 0x01020304;
+/// Alinhamento das secoes (em bytes)
+const uint64_t ALINHAMENTO = 64;
+
+/// Cabecalho do arquivo binario
+struct Cabecalho {
+  char magica[8];
+  uint32_t versao;
+  uint32_t endianidade;
+  uint64_t tamanho;  // Tamanho total do arquivo (em bytes)
+  uint64_t checksum; // Checksum do conteudo apos o cabecalho
+  uint32_t num_secoes;
+  uint32_t selecao_marcos; // SelecaoMarcos dos marcos gravados, mais 1
+                           // (0: desconhecida, em arquivos mais antigos)
+  uint32_t reservado[6];
+};
+static_assert(sizeof(Cabecalho) == 64, "Cabecalho deve ter 64 bytes");
+
+/// Descricao de uma secao do arquivo binario
+struct DescritorSecao {
+  uint32_t tipo;          // TipoSecao
+  uint32_t tam_elemento;  // sizeof de cada elemento
+  uint64_t deslocamento;  // Posicao do 1o elemento no arquivo
+  uint64_t num_elementos; // Numero de elementos
+  uint64_t reservado;
+};
+static_assert(sizeof(DescritorSecao) == 32, "DescritorSecao deve ter 32 bytes");
+
+/// Arredonda pos para o proximo multiplo de ALINHAMENTO
+uint64_t alinhar(uint64_t pos) {
+  return (pos + ALINHAMENTO - 1) / ALINHAMENTO * ALINHAMENTO;
+}
+
+/// Checksum de 64 bits, calculado com 4 acumuladores independentes sobre
+/// blocos de 32 bytes (como no xxHash64), para que a verificacao de um
+/// arquivo grande seja limitada pela leitura da memoria.
+class Checksum {
+private:
+  static const uint64_t P1 = 11400714785074694791ull;
+  static const uint64_t P2 = 14029467366897019727ull;
+  static const uint64_t P3 = 1609587929392839161ull;
+
+  uint64_t acc[4];
+  unsigned char pendente[32]; // Bytes que ainda nao completaram um bloco
+  size_t num_pendente;
+  uint64_t total;
+
+  static uint64_t rotl(uint64_t x, int r) { return (x << r) | (x >> (64 - r)); }
+
+  void bloco(const unsigned char *b) {
+    for (int k = 0; k < 4; ++k) {
+      uint64_t w;
+      memcpy(&w, b + 8 * k, 8);
+      acc[k] = rotl(acc[k] + w * P2, 31) * P1;
+    }
+  }
+
+public:
+  Checksum() : acc{P1 + P2, P2, 0, 0 - P1}, num_pendente(0), total(0) {}
+
+  /// Acrescenta n bytes ao conteudo
+  void atualizar(const void *dados, size_t n) {
+    const unsigned char *b = static_cast<const unsigned char *>(dados);
+    total += n;
+    if (num_pendente > 0) {
+      size_t k = min(n, 32 - num_pendente);
+      memcpy(pendente + num_pendente, b, k);
+      num_pendente += k;
+      b += k;
+      n -= k;
+      if (num_pendente < 32)
+        return;
+      bloco(pendente);
+      num_pendente = 0;
+    }
+    for (; n >= 32; b += 32, n -= 32)
+      bloco(b);
+    memcpy(pendente, b, n);
+    num_pendente = n;
+  }
+
+  /// Valor do checksum do conteudo acrescentado ateh agora
+  uint64_t valor() const {
+    uint64_t h = rotl(acc[0], 1) + rotl(acc[1], 7) + rotl(acc[2], 12) +
+                 rotl(acc[3], 18);
+    for (size_t i = 0; i < num_pendente; ++i)
+      h = rotl(h ^ (pendente[i] * P1), 11) * P2;
+    h ^= total;
+    h ^= h >> 33;
+    h *= P2;
+    h ^= h >> 29;
+    h *= P3;
+    h ^= h >> 32;
+    return h;
+  }
+};
+
+/// Tipos de secao do arquivo binario
+enum TipoSecao : uint32_t {
+  SEC_ID_PONTOS_FAIXAS = 1,
+  SEC_ID_PONTOS_CARACTERES = 2,
+  SEC_ID_PONTOS_SLOTS = 3,
+  SEC_NOME_PONTOS_FAIXAS = 4,
+  SEC_NOME_PONTOS_CARACTERES = 5,
+  SEC_LATITUDE = 6,
+  SEC_LONGITUDE = 7,
+  SEC_ID_ROTAS_FAIXAS = 8,
+  SEC_ID_ROTAS_CARACTERES = 9,
+  SEC_ID_ROTAS_SLOTS = 10,
+  SEC_NOME_ROTAS_FAIXAS = 11,
+  SEC_NOME_ROTAS_CARACTERES = 12,
+  SEC_EXTREMIDADES = 13,
+  SEC_COMPRIMENTO = 14,
+  SEC_ADJ_INICIO = 15,
+  SEC_ADJ_VIZINHO = 16,
+  SEC_ADJ_ROTA = 17,
+  SEC_ADJ_COMPRIMENTO = 18,
+  SEC_MARCOS = 19,
+  SEC_DIST_MARCOS = 20,
+  SEC_ADJ_FIM = 21,
+  SEC_TRIG_LON = 22,
+  SEC_TRIG_SEN_LAT = 23,
+  SEC_TRIG_COS_LAT = 24,
+  SEC_TRIG_X = 25,
+  SEC_TRIG_Y = 26,
+  SEC_ESPACIAL_PONTO = 27,
+  SEC_ESPACIAL_COORD = 28,
+  SEC_ESPACIAL_NOH = 29,
+  SEC_ESPACIAL_EXTRA = 30,
+  SEC_ESPACIAL_COORD_EXTRA = 31,
+  SEC_ESPACIAL_POSICAO = 32,
+  SEC_COMPONENTE = 33,
+  SEC_TAM_COMPONENTE = 34
+};
+
+/// Testa se uma secao pode faltar no arquivo (o arranjo fica vazio).
+/// Sao as secoes de dados opcionais, como os marcos da heuristica ALT, e as
+/// de dados derivados, que arquivos mais antigos nao tem (e que sao
+/// calculados na leitura).
+bool opcional(uint32_t tipo) {
+  return tipo == SEC_MARCOS || tipo == SEC_DIST_MARCOS ||
+         tipo == SEC_ADJ_FIM || tipo >= SEC_TRIG_LON;
+}
+
+/// Grava n bytes no arquivo, atualizando o checksum. Em caso de erro,
+/// throw 2
+void gravar(int fd, const void *dados, size_t n, Checksum &ck) {
+  // Secao vazia: os dados podem ser nulos
+  if (n == 0)
+    return;
+  ck.atualizar(dados, n);
+  const char *b = static_cast<const char *>(dados);
+  while (n > 0) {
+    ssize_t k = ::write(fd, b, n);
+    if (k < 0)
+      throw 2;
+    b += k;
+    n -= size_t(k);
+  }
+}
+
+/// Grava zeros ateh que a posicao pos do arquivo seja prox
+void completar(int fd, uint64_t &pos, uint64_t prox, Checksum &ck) {
+  static const char zeros[ALINHAMENTO] = {};
+  gravar(fd, zeros, size_t(prox - pos), ck);
+  pos = prox;
+}
+
+} // namespace
+
+/// Os arranjos do Mapa que sao gravados no arquivo binario, cada um
+/// associado ao seu tipo de secao
+struct SecoesMapa {
+  template <class MapaT, class Funcao>
+  static void visitar(MapaT &M, Funcao f) {
+    f(SEC_ID_PONTOS_FAIXAS, M.id_pontos.faixas);
+    f(SEC_ID_PONTOS_CARACTERES, M.id_pontos.caracteres);
+    f(SEC_ID_PONTOS_SLOTS, M.id_pontos.slots);
+    f(SEC_NOME_PONTOS_FAIXAS, M.nome_pontos.faixas);
+    f(SEC_NOME_PONTOS_CARACTERES, M.nome_pontos.caracteres);
+    f(SEC_LATITUDE, M.latitude);
+    f(SEC_LONGITUDE, M.longitude);
+    f(SEC_ID_ROTAS_FAIXAS, M.id_rotas.faixas);
+    f(SEC_ID_ROTAS_CARACTERES, M.id_rotas.caracteres);
+    f(SEC_ID_ROTAS_SLOTS, M.id_rotas.slots);
+    f(SEC_NOME_ROTAS_FAIXAS, M.nome_rotas.faixas);
+    f(SEC_NOME_ROTAS_CARACTERES, M.nome_rotas.caracteres);
+    f(SEC_EXTREMIDADES, M.extremidades);
+    f(SEC_COMPRIMENTO, M.comprimento);
+    f(SEC_ADJ_INICIO, M.adj.inicio);
+    f(SEC_ADJ_FIM, M.adj.fim);
+    f(SEC_ADJ_VIZINHO, M.adj.vizinho);
+    f(SEC_ADJ_ROTA, M.adj.rota);
+    f(SEC_ADJ_COMPRIMENTO, M.adj.comprimento);
+    f(SEC_MARCOS, M.marcos);
+    f(SEC_DIST_MARCOS, M.dist_marcos);
+    f(SEC_TRIG_LON, M.trig.lon);
+    f(SEC_TRIG_SEN_LAT, M.trig.sen_lat);
+    f(SEC_TRIG_COS_LAT, M.trig.cos_lat);
+    f(SEC_TRIG_X, M.trig.x);
+    f(SEC_TRIG_Y, M.trig.y);
+    f(SEC_ESPACIAL_PONTO, M.espacial.ponto);
+    f(SEC_ESPACIAL_COORD, M.espacial.coord);
+    f(SEC_ESPACIAL_NOH, M.espacial.noh);
+    f(SEC_ESPACIAL_EXTRA, M.espacial.extra);
+    f(SEC_ESPACIAL_COORD_EXTRA, M.espacial.coord_extra);
+    f(SEC_ESPACIAL_POSICAO, M.espacial.posicao);
+    f(SEC_COMPONENTE, M.componente);
+    f(SEC_TAM_COMPONENTE, M.tam_componente);
+  }
+
+  /// Completa as componentes conexas lidas do arquivo: o numero de rotulos
+  /// eh o de tamanhos. Retorna false se o arquivo, mais antigo, nao as tem.
+  /// Se os rotulos nao correspondem aos tamanhos, throw 7.
+  static bool restaurarComponentes(Mapa &M) {
+    const Indice n = M.numPontos();
+    if (M.componente.empty() && n > 0)
+      return false;
+    const size_t num = M.tam_componente.size();
+    if (M.componente.size() != n || num >= INDICE_INVALIDO)
+      throw 7;
+    vector<Indice> tam(num, 0);
+    for (Indice c : M.componente) {
+      if (c >= num)
+        throw 7;
+      ++tam[c];
+    }
+    if (!equal(tam.begin(), tam.end(), M.tam_componente.begin()))
+      throw 7;
+    M.num_componentes = Indice(num);
+    return true;
+  }
+
+  /// Completa o indice espacial lido do arquivo. Retorna false se o arquivo,
+  /// mais antigo, nao o tem (a arvore de um indice construido tem ao menos
+  /// um noh). Se o indice for incoerente, throw 7.
+  static bool restaurarEspacial(Mapa &M) {
+    if (M.espacial.noh.empty())
+      return false;
+    if (!M.espacial.restaurar(M.numPontos()))
+      throw 7;
+    return true;
+  }
+
+  /// Testa se os tamanhos das tabelas de um mapa lido sao coerentes entre
+  /// si. Em particular, as tabelas hash precisam ter posicoes livres, para
+  /// que as buscas terminem.
+  static bool coerente(const Mapa &M) {
+    size_t n = M.numPontos(), m = M.numRotas(), k = M.marcos.size();
+    // Coordenadas pre-processadas: todas ou nenhuma (arquivos mais antigos)
+    const TrigPontos &T = M.trig;
+    const size_t t = T.lon.empty() ? 0 : n;
+    if (T.lon.size() != t || T.sen_lat.size() != t || T.cos_lat.size() != t ||
+        T.x.size() != t || T.y.size() != t)
+      return false;
+    // Mapa vazio (a adjacencia nunca foi construida)
+    if (n == 0)
+      return m == 0 && M.adj.inicio.size() <= 1 && M.adj.fim.empty() &&
+             k == 0 && M.dist_marcos.empty();
+    for (Indice marco : M.marcos)
+      if (marco >= n)
+        return false;
+    auto hash_ok = [](const TabelaIds &T) {
+      size_t k = T.slots.size();
+      return (k == 0 && T.size() == 0) ||
+             (k > T.size() && (k & (k - 1)) == 0);
+    };
+    // Sem a secao SEC_ADJ_FIM (arquivos mais antigos), a adjacencia nao
+    // tem posicoes livres; com ela, pode ter (alteracoes incrementais)
+    const Adjacencia &A = M.adj;
+    size_t posicoes = A.vizinho.size();
+    bool adj_ok = A.inicio.size() == n + 1 && A.inicio[n] == posicoes &&
+                  A.rota.size() == posicoes &&
+                  A.comprimento.size() == posicoes &&
+                  (A.fim.empty() ? posicoes == 2 * m
+                                 : A.fim.size() == n && posicoes >= 2 * m);
+    return hash_ok(M.id_pontos) && hash_ok(M.id_rotas) &&
+           M.nome_pontos.size() == n && M.latitude.size() == n &&
+           M.longitude.size() == n && M.nome_rotas.size() == m &&
+           M.extremidades.size() == 2 * m && M.comprimento.size() == m &&
+           adj_ok && k <= n && M.dist_marcos.size() == n * k &&
+           indicesValidos(M);
+  }
+
+  /// Testa se os indices guardados nas tabelas de um mapa lido (com
+  /// tamanhos coerentes) estao nos seus intervalos: pontos e rotas
+  /// existentes e textos dentro dos seus blocos de caracteres. Sem isso, um
+  /// arquivo corrompido (ou lido sem verificar o checksum) levaria as
+  /// buscas a acessar posicoes fora das tabelas. Cada indice das tabelas
+  /// hash deve estar em exatamente uma posicao, e as demais livres: com
+  /// indices repetidos, poderiam faltar posicoes livres, e a busca de um
+  /// identificador inexistente nao terminaria.
+  static bool indicesValidos(const Mapa &M) {
+    const Indice n = M.numPontos(), m = M.numRotas();
+    auto textos_ok = [](const TabelaTextos &T) {
+      const uint64_t c = T.caracteres.size();
+      for (const TabelaTextos::Faixa &F : T.faixas)
+        if (uint64_t(F.inicio) + F.tamanho > c)
+          return false;
+      return true;
+    };
+    auto slots_ok = [](const TabelaIds &T) {
+      vector<bool> visto(T.size(), false);
+      size_t ocupados = 0;
+      for (Indice i : T.slots)
+        if (i != INDICE_INVALIDO) {
+          if (i >= T.size() || visto[i])
+            return false;
+          visto[i] = true;
+          ++ocupados;
+        }
+      return ocupados == T.size();
+    };
+    if (!textos_ok(M.id_pontos) || !textos_ok(M.nome_pontos) ||
+        !textos_ok(M.id_rotas) || !textos_ok(M.nome_rotas) ||
+        !slots_ok(M.id_pontos) || !slots_ok(M.id_rotas))
+      return false;
+    for (Indice p : M.extremidades)
+      if (p >= n)
+        return false;
+
+    // Arestas de cada ponto: [inicio[p], fim[p]) dentro dos vetores, com
+    // vizinhos e rotas existentes
+    const Adjacencia &A = M.adj;
+    const Indice posicoes = Indice(A.vizinho.size());
+    for (Indice p = 0; p < n; ++p) {
+      const Indice ini = A.inicio[p];
+      const Indice fim = A.fim.empty() ? A.inicio[p + 1] : A.fim[p];
+      if (ini > fim || fim > posicoes)
+        return false;
+      for (Indice e = ini; e < fim; ++e)
+        if (A.vizinho[e] >= n || A.rota[e] >= m)
+          return false;
+    }
+    return true;
+  }
+};
+
+/// Salva o mapa em um arquivo binario, que pode ser lido por lerBinario.
+/// Retorna true em caso de sucesso. Em caso de erro, o arquivo nao eh
+/// alterado e retorna false.
+bool Planejador::salvarBinario(const std::string &arq) const {
+  // O arquivo eh gravado com outro nome e soh substitui arq quando completo
+  string temp = arq + ".tmp";
+  int fd = -1;
+
+  try {
+    // Monta a tabela de secoes
+    vector<DescritorSecao> secoes;
+    vector<const void *> dados;
+    SecoesMapa::visitar(mapa, [&](uint32_t tipo, const auto &A) {
+      using T = typename decay_t<decltype(A)>::value_type;
+      static_assert(is_trivially_copyable<T>::value, "");
+      DescritorSecao D = {};
+      D.tipo = tipo;
+      D.tam_elemento = sizeof(T);
+      D.num_elementos = A.size();
+      secoes.push_back(D);
+      dados.push_back(A.data());
+    });
+    uint64_t pos = alinhar(sizeof(Cabecalho) +
+                           secoes.size() * sizeof(DescritorSecao));
+    for (DescritorSecao &D : secoes) {
+      D.deslocamento = pos;
+      pos = alinhar(pos + D.num_elementos * D.tam_elemento);
+    }
+
+    Cabecalho C = {};
+    memcpy(C.magica, MAGICA, sizeof(MAGICA));
+    C.versao = VERSAO_BINARIO;
+    C.endianidade = ENDIANIDADE;
+    C.tamanho = pos;
+    C.num_secoes = uint32_t(secoes.size());
+    C.selecao_marcos = uint32_t(mapa.selecao_marcos) + 1;
+
+    // Cria o arquivo
+    fd = ::open(temp.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    if (fd < 0)
+      throw 1;
+
+    // Grava o cabecalho (ainda sem o checksum), a tabela e as secoes
+    Checksum ck, ck_cabecalho;
+    gravar(fd, &C, sizeof(C), ck_cabecalho);
+    pos = sizeof(C);
+    gravar(fd, secoes.data(), secoes.size() * sizeof(DescritorSecao), ck);
+    pos += secoes.size() * sizeof(DescritorSecao);
+    for (size_t i = 0; i < secoes.size(); ++i) {
+      completar(fd, pos, secoes[i].deslocamento, ck);
+      size_t n = secoes[i].num_elementos * secoes[i].tam_elemento;
+      gravar(fd, dados[i], n, ck);
+      pos += n;
+    }
+    completar(fd, pos, alinhar(pos), ck);
+
+    // Grava o checksum no cabecalho
+    C.checksum = ck.valor();
+    if (pwrite(fd, &C, sizeof(C), 0) != ssize_t(sizeof(C)) || fsync(fd) != 0)
+      throw 2;
+    if (::close(fd) != 0) {
+      fd = -1;
+      throw 2;
+    }
+    fd = -1;
+
+    // Substitui o arquivo anterior
+    if (rename(temp.c_str(), arq.c_str()) != 0)
+      throw 3;
+  } catch (int i) {
+    if (fd >= 0)
+      ::close(fd);
+    unlink(temp.c_str());
+    cerr << "Erro " << i << " na gravacao do arquivo binario " << arq << endl;
+    return false;
+  }
+  return true;
+}
+
+/// Leh um mapa de um arquivo binario gerado por salvarBinario.
+/// O arquivo eh mapeado na memoria e suas tabelas sao usadas diretamente,
+/// sem conversao. Se verificar for true, confere o checksum do conteudo.
+/// Caso nao consiga ler o arquivo, deixa o mapa inalterado e retorna false.
+/// Retorna true em caso de leitura bem sucedida.
+bool Planejador::lerBinario(const std::string &arq, bool verificar) {
+  // Mapa temporario, que referencia o arquivo mapeado
+  Mapa M;
+  bool tem_espacial = false, tem_componentes = false;
+
+  try {
+    // Abre e mapeia o arquivo
+    auto A = make_shared<ArquivoMapeado>();
+    if (!A->abrir(arq, false))
+      throw 1;
+
+    // Leh o cabecalho
+    Cabecalho C;
+    if (A->size() < sizeof(C))
+      throw 2;
+    memcpy(&C, A->data(), sizeof(C));
+    if (memcmp(C.magica, MAGICA, sizeof(MAGICA)) != 0)
+      throw 2;
+    if (C.versao != VERSAO_BINARIO || C.endianidade != ENDIANIDADE)
+      throw 3;
+    if (C.tamanho != A->size() ||
+        sizeof(C) + uint64_t(C.num_secoes) * sizeof(DescritorSecao) >
+            A->size())
+      throw 4;
+
+    // Confere o checksum
+    if (verificar) {
+      Checksum ck;
+      ck.atualizar(A->data() + sizeof(C), A->size() - sizeof(C));
+      if (ck.valor() != C.checksum)
+        throw 5;
+    }
+
+    // Faz cada arranjo do mapa referenciar a sua secao no arquivo
+    const DescritorSecao *secoes =
+        reinterpret_cast<const DescritorSecao *>(A->data() + sizeof(C));
+    SecoesMapa::visitar(M, [&](uint32_t tipo, auto &arr) {
+      using T = typename decay_t<decltype(arr)>::value_type;
+      const DescritorSecao *D = secoes;
+      while (D != secoes + C.num_secoes && D->tipo != tipo)
+        ++D;
+      if (D == secoes + C.num_secoes && opcional(tipo))
+        return;
+      // Secao inteira dentro do arquivo (sem estouro nas contas)
+      if (D == secoes + C.num_secoes || D->tam_elemento != sizeof(T) ||
+          D->deslocamento % alignof(T) != 0 ||
+          D->deslocamento > A->size() ||
+          D->num_elementos > (A->size() - D->deslocamento) / sizeof(T))
+        throw 6;
+      arr.referenciar(reinterpret_cast<const T *>(A->data() + D->deslocamento),
+                      D->num_elementos);
+    });
+    if (!SecoesMapa::coerente(M))
+      throw 7;
+    // Marcos escolhidos com DISTANTES (o criterio default eh EVITAR)
+    if (C.selecao_marcos == uint32_t(SelecaoMarcos::DISTANTES) + 1)
+      M.selecao_marcos = SelecaoMarcos::DISTANTES;
+    tem_espacial = SecoesMapa::restaurarEspacial(M);
+    tem_componentes = SecoesMapa::restaurarComponentes(M);
+
+    M.arquivo = std::move(A);
+  } catch (int i) {
+    cerr << "Erro " << i << " na leitura do arquivo binario " << arq << endl;
+    return false;
+  }
+
+  // Soh chega aqui se nao entrou no catch, jah que ele termina com return.
+  // Nos arquivos sem o fim das arestas de cada ponto, ele eh o inicio das
+  // arestas do ponto seguinte. Nos arquivos sem as coordenadas usadas pela
+  // haversine, elas sao derivadas das latitudes e longitudes.
+  if (M.adj.fim.empty() && M.numPontos() > 0)
+    M.adj.fim.append(M.adj.inicio.data() + 1, M.numPontos());
+  if (M.trig.lon.empty())
+    M.trig.calcular(M.latitude, M.longitude);
+  if (!tem_espacial)
+    M.espacial.construir(M.trig);
+  if (!tem_componentes)
+    M.calcularComponentes(PoolThreads::global());
+  mapa = std::move(M);
+  cache.clear();
+  return true;
+}
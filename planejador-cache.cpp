@@ -0,0 +1,120 @@
+#include "planejador.h"
+
+using namespace std;
+
+/* *************************
+ * CLASSE CACHECAMINHOS  *
+ ************************* */
+
+namespace {
+/// Copia em R o caminho C percorrido no sentido contrario
+void inverter(const CaminhoIndices &C, CaminhoIndices &R) {
+  R.clear();
+  if (C.empty())
+    return;
+  R.push_back({INDICE_INVALIDO, C.back().ponto});
+  // A rota do trecho i liga os pontos dos trechos i-1 e i
+  for (size_t i = C.size() - 1; i > 0; --i)
+    R.push_back({C[i].rota, C[i - 1].ponto});
+}
+} // namespace
+
+/// Atribuicao: mesma capacidade, mas vazio
+CacheCaminhos &CacheCaminhos::operator=(const CacheCaminhos &C) {
+  if (this != &C) {
+    clear();
+    setCapacidade(C.capacidade);
+  }
+  return *this;
+}
+
+/// Altera a capacidade, descartando as entradas menos usadas que excederem
+void CacheCaminhos::setCapacidade(size_t cap) {
+  lock_guard<mutex> lk(m);
+  capacidade = cap;
+  while (lista.size() > cap) {
+    posicao.erase(lista.back().first);
+    lista.pop_back();
+  }
+}
+
+/// Procura o resultado da consulta de orig a dest
+bool CacheCaminhos::buscar(Indice orig, Indice dest, double &compr,
+                           CaminhoIndices &C, int &NA, int &NF) {
+  // A entrada eh compartilhada: o caminho eh copiado fora da secao critica
+  shared_ptr<const Entrada> E;
+  {
+    lock_guard<mutex> lk(m);
+    auto it = posicao.find(chave(orig, dest));
+    if (it != posicao.end()) {
+      // Passa a ser a entrada usada mais recentemente
+      lista.splice(lista.begin(), lista, it->second);
+      E = it->second->second;
+    }
+  }
+  if (!E) {
+    ++falhas;
+    return false;
+  }
+
+  ++acertos;
+  compr = E->comprimento;
+  NA = E->NA;
+  NF = E->NF;
+  if (E->origem == orig)
+    C = E->caminho;
+  else
+    inverter(E->caminho, C);
+  return true;
+}
+
+/// Armazena o resultado da consulta de orig a dest, descartando a entrada
+/// usada ha mais tempo se o cache estiver cheio
+void CacheCaminhos::incluir(Indice orig, Indice dest, double compr,
+                            const CaminhoIndices &C, int NA, int NF) {
+  if (!ativo())
+    return;
+  shared_ptr<const Entrada> E =
+      make_shared<Entrada>(Entrada{orig, compr, C, NA, NF});
+
+  lock_guard<mutex> lk(m);
+  const Chave k = chave(orig, dest);
+  auto it = posicao.find(k);
+  if (it != posicao.end()) {
+    // Outra thread calculou a mesma consulta
+    it->second->second = std::move(E);
+    lista.splice(lista.begin(), lista, it->second);
+    return;
+  }
+  if (capacidade == 0)
+    return;
+  lista.emplace_front(k, std::move(E));
+  posicao.emplace(k, lista.begin());
+  if (lista.size() > capacidade) {
+    posicao.erase(lista.back().first);
+    lista.pop_back();
+  }
+}
+
+/// Descarta todas as entradas
+void CacheCaminhos::clear() {
+  lock_guard<mutex> lk(m);
+  lista.clear();
+  posicao.clear();
+}
+
+/// Contadores do cache
+EstatisticasCache CacheCaminhos::estatisticas() const {
+  lock_guard<mutex> lk(m);
+  return {acertos.load(), falhas.load(), lista.size(), capacidade.load()};
+}
+
+/* *************************
+ * CLASSE PLANEJADOR     *
+ ************************* */
+
+/// Ativa (capacidade > 0) ou desativa (capacidade == 0) o cache dos
+/// resultados de calculaCaminho
+void Planejador::ativarCache(size_t capacidade) {
+  cache.setCapacidade(capacidade);
+}
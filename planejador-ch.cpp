@@ -0,0 +1,547 @@
+#include <algorithm>
+#include <cmath>
+#include <functional>
+#include <vector>
+
+#include "planejador.h"
+
+using namespace std;
+
+/* *************************
+ * CONTRACTION HIERARCHIES *
+ ************************* */
+
+// Preprocessamento (calcularHierarquia):
+// - a prioridade de um ponto eh a sua diferenca de arestas (numero de
+//   atalhos que a contracao criaria menos o numero de arestas removidas),
+//   mais o numero de vizinhos jah contraidos, que espalha as contracoes
+//   pelo mapa;
+// - a cada rodada, sao contraidos todos os pontos de prioridade menor que a
+//   de todos os seus vizinhos. Esses pontos nao sao vizinhos entre si, e os
+//   seus atalhos sao calculados em paralelo;
+// - um atalho u-w pelo ponto contraido v soh eh criado se uma busca local
+//   (testemunha) nao encontrar um caminho de u ateh w, sem passar por v,
+//   de comprimento menor ou igual. As buscas de uma rodada tambem nao
+//   passam pelos demais pontos da rodada, jah que todos eles sao removidos
+//   juntos.
+// Consulta (buscaHierarquia): Dijkstra bidirecional, em que as duas buscas
+// soh seguem arcos para pontos de nivel maior. O caminho encontrado eh
+// expandido, substituindo cada atalho pelos seus dois arcos filhos.
+
+namespace {
+
+/// Numero maximo de pontos fechados por uma busca de testemunha, na
+/// contracao e na estimativa da prioridade. Buscas interrompidas soh criam
+/// atalhos desnecessarios, nunca erros.
+const int MAX_FECHADOS_CONTRACAO = 500;
+const int MAX_FECHADOS_PRIORIDADE = 50;
+
+/// Aresta do grafo durante a contracao
+struct ArestaCH {
+  Indice viz;  // Ponto vizinho (ainda nao contraido)
+  double peso; // Comprimento
+  Indice arco; // Arco correspondente
+};
+
+/// Arco (rota original ou atalho) criado durante a contracao
+struct ArcoCH {
+  Indice baixo, alto; // Pontos (INDICE_INVALIDO ateh a contracao de um deles)
+  double peso;
+  Indice rota;                    // INDICE_INVALIDO se atalho
+  Indice filho_baixo, filho_alto; // Arcos do atalho
+};
+
+/// Atalho calculado pela contracao de um ponto
+struct Atalho {
+  Indice u, w;
+  double peso;
+  Indice arco_u, arco_w; // Arcos do ponto contraido ateh u e ateh w
+};
+
+using GrafoCH = vector<vector<ArestaCH>>;
+
+/// Busca local de testemunhas: Dijkstra a partir de um ponto, limitado em
+/// distancia e em numero de pontos fechados. Cada thread tem a sua.
+class Testemunha {
+private:
+  vector<double> dist;
+  vector<char> alvo; // Pontos cuja distancia interessa
+  vector<Indice> tocados;
+  vector<pair<double, Indice>> heap;
+
+public:
+  /// Distancias a partir de u no grafo G, sem passar pelo ponto excluido
+  /// nem por pontos com ignorar[x] != 0, ateh a distancia limite, ateh
+  /// fechar todos os alvos ou ateh fechar max_fechados pontos
+  void buscar(const GrafoCH &G, Indice u, Indice excluido,
+              const vector<char> &ignorar, double limite,
+              const ArestaCH *alvos, size_t num_alvos, int max_fechados) {
+    for (Indice x : tocados)
+      dist[x] = HUGE_VAL;
+    tocados.clear();
+    heap.clear();
+    if (dist.size() < G.size()) {
+      dist.resize(G.size(), HUGE_VAL);
+      alvo.resize(G.size(), 0);
+    }
+    size_t restantes = 0;
+    for (size_t j = 0; j < num_alvos; ++j)
+      if (!alvo[alvos[j].viz]) {
+        alvo[alvos[j].viz] = 1;
+        ++restantes;
+      }
+
+    auto maior = greater<pair<double, Indice>>();
+    dist[u] = 0.0;
+    tocados.push_back(u);
+    heap.push_back({0.0, u});
+    int fechados = 0;
+    while (!heap.empty() && fechados < max_fechados) {
+      pop_heap(heap.begin(), heap.end(), maior);
+      auto [d, x] = heap.back();
+      heap.pop_back();
+      if (d > dist[x])
+        continue; // Entrada obsoleta
+      if (d > limite)
+        break;
+      ++fechados;
+      if (alvo[x]) {
+        alvo[x] = 0;
+        if (--restantes == 0)
+          break;
+      }
+      for (const ArestaCH &A : G[x]) {
+        if (A.viz == excluido || ignorar[A.viz])
+          continue;
+        double nd = d + A.peso;
+        if (nd <= limite && nd < dist[A.viz]) {
+          if (dist[A.viz] == HUGE_VAL)
+            tocados.push_back(A.viz);
+          dist[A.viz] = nd;
+          heap.push_back({nd, A.viz});
+          push_heap(heap.begin(), heap.end(), maior);
+        }
+      }
+    }
+    for (size_t j = 0; j < num_alvos; ++j)
+      alvo[alvos[j].viz] = 0;
+  }
+
+  /// Distancia encontrada ateh x (HUGE_VAL se nao alcancado)
+  double distancia(Indice x) const {
+    return x < dist.size() ? dist[x] : HUGE_VAL;
+  }
+};
+
+/// Calcula os atalhos necessarios para contrair o ponto v
+void calcularAtalhos(const GrafoCH &G, Indice v, const vector<char> &ignorar,
+                     int max_fechados, Testemunha &T,
+                     vector<Atalho> &atalhos) {
+  atalhos.clear();
+  const vector<ArestaCH> &N = G[v];
+  for (size_t i = 0; i + 1 < N.size(); ++i) {
+    // Maior comprimento de um caminho u-v-w a verificar
+    double limite = 0.0;
+    for (size_t j = i + 1; j < N.size(); ++j)
+      limite = max(limite, N[i].peso + N[j].peso);
+    T.buscar(G, N[i].viz, v, ignorar, limite, &N[i + 1], N.size() - i - 1,
+             max_fechados);
+
+    for (size_t j = i + 1; j < N.size(); ++j) {
+      double peso = N[i].peso + N[j].peso;
+      if (T.distancia(N[j].viz) <= peso)
+        continue; // Existe testemunha
+      atalhos.push_back({N[i].viz, N[j].viz, peso, N[i].arco, N[j].arco});
+    }
+  }
+}
+
+/// Inclui no grafo a aresta u-w do arco a, se nao houver uma melhor
+void incluirAresta(GrafoCH &G, Indice u, Indice w, double peso, Indice a) {
+  for (ArestaCH &A : G[u])
+    if (A.viz == w) {
+      if (peso < A.peso) {
+        A.peso = peso;
+        A.arco = a;
+        for (ArestaCH &B : G[w])
+          if (B.viz == u) {
+            B.peso = peso;
+            B.arco = a;
+          }
+      }
+      return;
+    }
+  G[u].push_back({w, peso, a});
+  G[w].push_back({u, peso, a});
+}
+
+} // namespace
+
+/// Torna a hierarquia vazia
+void Hierarquia::clear() {
+  nivel.clear();
+  inicio.clear();
+  baixo.clear();
+  alto.clear();
+  peso.clear();
+  rota.clear();
+  filho_baixo.clear();
+  filho_alto.clear();
+}
+
+/// Prepara as Contraction Hierarchies do mapa
+void Planejador::calcularHierarquia(PoolThreads &pool) {
+  const Indice n = mapa.numPontos();
+  mapa.ch.clear();
+  if (n == 0)
+    return;
+
+  // Grafo inicial: uma aresta por par de pontos vizinhos (a rota mais
+  // curta, se houver mais de uma), sem lacos
+  GrafoCH G(n);
+  vector<ArcoCH> arcos;
+  for (Indice r = 0; r < mapa.numRotas(); ++r) {
+    Indice a = mapa.extremidades[2 * r], b = mapa.extremidades[2 * r + 1];
+    if (a == b)
+      continue;
+    Indice id = Indice(arcos.size());
+    arcos.push_back({INDICE_INVALIDO, INDICE_INVALIDO, mapa.comprimento[r], r,
+                     INDICE_INVALIDO, INDICE_INVALIDO});
+    incluirAresta(G, a, b, mapa.comprimento[r], id);
+  }
+
+  vector<Testemunha> testemunhas(pool.size());
+  vector<char> contraindo(n, 0);    // Pontos da rodada atual
+  vector<int> diferenca(n, 0);      // Diferenca de arestas
+  vector<char> desatualizada(n, 1); // A diferenca precisa ser recalculada
+  vector<int> contraidos_viz(n, 0); // Vizinhos jah contraidos
+
+  // Prioridade: diferenca de arestas + vizinhos contraidos. A diferenca
+  // de um ponto muda quando um vizinho eh contraido, mas soh eh recalculada
+  // quando o ponto eh candidato a contracao (atualizacao preguicosa).
+  auto precede = [&](Indice u, Indice v) {
+    int pu = diferenca[u] + contraidos_viz[u];
+    int pv = diferenca[v] + contraidos_viz[v];
+    return pu < pv || (pu == pv && u < v);
+  };
+  // Testa se o ponto v precede todos os seus vizinhos
+  auto minimo = [&](Indice v) {
+    for (const ArestaCH &A : G[v])
+      if (precede(A.viz, v))
+        return false;
+    return true;
+  };
+  // Recalcula a diferenca de arestas dos pontos, simulando a contracao
+  auto atualizar = [&](const vector<Indice> &pontos) {
+    pool.paraCada(pontos.size(), [&](size_t i, unsigned t) {
+      Indice v = pontos[i];
+      vector<Atalho> A;
+      calcularAtalhos(G, v, contraindo, MAX_FECHADOS_PRIORIDADE,
+                      testemunhas[t], A);
+      diferenca[v] = int(A.size()) - int(G[v].size());
+      desatualizada[v] = 0;
+    });
+  };
+
+  vector<Indice> restantes(n);
+  for (Indice v = 0; v < n; ++v)
+    restantes[v] = v;
+  atualizar(restantes);
+
+  Arranjo<Indice> nivel;
+  nivel.assign(n, INDICE_INVALIDO);
+  Indice *niv = nivel.mutavel();
+  Indice proximo_nivel = 0;
+
+  vector<Indice> candidatos, rodada;
+  vector<vector<Atalho>> atalhos;
+
+  while (!restantes.empty()) {
+    // Candidatos: pontos que precedem todos os vizinhos. Nao ha dois
+    // candidatos vizinhos.
+    candidatos.clear();
+    rodada.clear();
+    for (Indice v : restantes)
+      if (minimo(v)) {
+        if (desatualizada[v])
+          candidatos.push_back(v);
+        else
+          rodada.push_back(v);
+      }
+    // Os candidatos desatualizados soh entram na rodada se continuarem
+    // precedendo os vizinhos
+    atualizar(candidatos);
+    for (Indice v : candidatos)
+      if (minimo(v))
+        rodada.push_back(v);
+    if (rodada.empty())
+      continue;
+    for (Indice v : rodada)
+      contraindo[v] = 1;
+
+    // Atalhos de cada ponto da rodada, em paralelo
+    atalhos.resize(rodada.size());
+    pool.paraCada(rodada.size(), [&](size_t i, unsigned t) {
+      calcularAtalhos(G, rodada[i], contraindo, MAX_FECHADOS_CONTRACAO,
+                      testemunhas[t], atalhos[i]);
+    });
+
+    // Contrai os pontos, na ordem da rodada
+    for (size_t i = 0; i < rodada.size(); ++i) {
+      Indice v = rodada[i];
+      niv[v] = proximo_nivel++;
+
+      // As arestas restantes de v sobem para vizinhos de nivel maior
+      for (const ArestaCH &A : G[v]) {
+        arcos[A.arco].baixo = v;
+        arcos[A.arco].alto = A.viz;
+
+        vector<ArestaCH> &Gu = G[A.viz];
+        for (size_t k = 0; k < Gu.size(); ++k)
+          if (Gu[k].viz == v) {
+            Gu[k] = Gu.back();
+            Gu.pop_back();
+            break;
+          }
+        ++contraidos_viz[A.viz];
+        desatualizada[A.viz] = 1;
+      }
+      G[v].clear();
+      G[v].shrink_to_fit();
+
+      for (const Atalho &S : atalhos[i]) {
+        Indice id = Indice(arcos.size());
+        arcos.push_back({INDICE_INVALIDO, INDICE_INVALIDO, S.peso,
+                         INDICE_INVALIDO, S.arco_u, S.arco_w});
+        incluirAresta(G, S.u, S.w, S.peso, id);
+      }
+      contraindo[v] = 0;
+    }
+
+    // Remove os pontos contraidos
+    size_t k = 0;
+    for (Indice v : restantes)
+      if (niv[v] == INDICE_INVALIDO)
+        restantes[k++] = v;
+    restantes.resize(k);
+  }
+
+  // Arcos em formato CSR, agrupados pelo ponto de menor nivel. Arcos sem
+  // pontos sao arestas substituidas por atalhos melhores.
+  Hierarquia &H = mapa.ch;
+  Arranjo<Indice> inicio;
+  inicio.assign(size_t(n) + 1, 0);
+  Indice *ini = inicio.mutavel();
+  for (const ArcoCH &A : arcos)
+    if (A.baixo != INDICE_INVALIDO)
+      ++ini[A.baixo + 1];
+  for (Indice v = 0; v < n; ++v)
+    ini[v + 1] += ini[v];
+
+  const Indice m = ini[n];
+  vector<Indice> novo(arcos.size(), INDICE_INVALIDO);
+  {
+    vector<Indice> pos(ini, ini + n);
+    for (Indice a = 0; a < arcos.size(); ++a)
+      if (arcos[a].baixo != INDICE_INVALIDO)
+        novo[a] = pos[arcos[a].baixo]++;
+  }
+
+  H.baixo.resize(m);
+  H.alto.resize(m);
+  H.peso.resize(m);
+  H.rota.resize(m);
+  H.filho_baixo.resize(m);
+  H.filho_alto.resize(m);
+  Indice *baixo = H.baixo.mutavel(), *alto = H.alto.mutavel();
+  Indice *rota = H.rota.mutavel();
+  Indice *filho_baixo = H.filho_baixo.mutavel();
+  Indice *filho_alto = H.filho_alto.mutavel();
+  double *peso = H.peso.mutavel();
+  for (Indice a = 0; a < arcos.size(); ++a) {
+    const ArcoCH &A = arcos[a];
+    if (novo[a] == INDICE_INVALIDO)
+      continue;
+    Indice i = novo[a];
+    baixo[i] = A.baixo;
+    alto[i] = A.alto;
+    peso[i] = A.peso;
+    rota[i] = A.rota;
+    filho_baixo[i] = filho_alto[i] = INDICE_INVALIDO;
+    if (A.rota == INDICE_INVALIDO) {
+      // Os filhos partem do meio do atalho; o filho que chega a baixo eh
+      // filho_baixo
+      Indice f1 = A.filho_baixo, f2 = A.filho_alto;
+      if (arcos[f1].alto != A.baixo)
+        swap(f1, f2);
+      filho_baixo[i] = novo[f1];
+      filho_alto[i] = novo[f2];
+    }
+  }
+  H.inicio = std::move(inicio);
+  H.nivel = std::move(nivel);
+}
+
+/// Prepara os buffers para uma busca em um mapa com num_pontos pontos
+void EspacoBusca::DirecaoCH::preparar(Indice num_pontos) {
+  if (dist.size() != num_pontos) {
+    dist.assign(num_pontos, HUGE_VAL);
+    arco.resize(num_pontos);
+  } else {
+    for (Indice x : tocados)
+      dist[x] = HUGE_VAL;
+  }
+  tocados.clear();
+  heap.clear();
+  num_fechados = 0;
+}
+
+namespace {
+
+/// Acrescenta ao caminho C os trechos (rotas originais) do arco a,
+/// percorrido de baixo para alto (se subindo) ou de alto para baixo.
+/// pilha eh apenas um buffer reaproveitado entre as chamadas.
+void expandirArco(const Hierarquia &H, Indice a, bool subindo,
+                  CaminhoIndices &C, vector<pair<Indice, bool>> &pilha) {
+  pilha.assign(1, {a, subindo});
+  while (!pilha.empty()) {
+    auto [x, sobe] = pilha.back();
+    pilha.pop_back();
+    if (H.rota[x] != INDICE_INVALIDO) {
+      C.push_back({H.rota[x], sobe ? H.alto[x] : H.baixo[x]});
+      continue;
+    }
+    // Os filhos partem do meio, que tem nivel menor que baixo e alto.
+    // A pilha recebe primeiro o trecho que deve ser expandido por ultimo.
+    if (sobe) {
+      // baixo -> meio -> alto
+      pilha.push_back({H.filho_alto[x], true});
+      pilha.push_back({H.filho_baixo[x], false});
+    } else {
+      // alto -> meio -> baixo
+      pilha.push_back({H.filho_baixo[x], true});
+      pilha.push_back({H.filho_alto[x], false});
+    }
+  }
+}
+
+} // namespace
+
+/// Busca nas Contraction Hierarchies: Dijkstra bidirecional em que as duas
+/// buscas soh sobem de nivel, alternando entre elas. Cada busca para quando
+/// o menor valor no seu aberto nao for menor que mu, o melhor caminho
+/// encontrado ateh entao.
+template <class Politica>
+double Planejador::buscaHierarquia(Indice orig, Indice dest, EspacoBusca &E,
+                                   int &NA, int &NF, Politica &P) const {
+  const Hierarquia &H = mapa.ch;
+  EspacoBusca::DirecaoCH *D[2] = {&E.ch_ida, &E.ch_volta};
+  CaminhoIndices &C = E.caminho;
+  auto maior = greater<pair<double, Indice>>();
+
+  C.clear();
+  for (int lado = 0; lado < 2; ++lado) {
+    EspacoBusca::DirecaoCH &d = *D[lado];
+    Indice x = (lado == 0) ? orig : dest;
+    d.preparar(mapa.numPontos());
+    d.dist[x] = 0.0;
+    d.arco[x] = INDICE_INVALIDO;
+    d.tocados.push_back(x);
+    d.heap.push_back({0.0, x});
+  }
+  P.fimPreparo();
+  P.aberto(2);
+
+  double mu = HUGE_VAL;
+  Indice meio = INDICE_INVALIDO;
+  bool ativa[2] = {true, true};
+  for (int lado = 0; ativa[0] || ativa[1]; lado = 1 - lado) {
+    if (!ativa[lado])
+      continue;
+    EspacoBusca::DirecaoCH &d = *D[lado];
+    const EspacoBusca::DirecaoCH &outra = *D[1 - lado];
+
+    // Descarta entradas obsoletas
+    while (!d.heap.empty() &&
+           d.heap.front().first > d.dist[d.heap.front().second]) {
+      pop_heap(d.heap.begin(), d.heap.end(), maior);
+      d.heap.pop_back();
+    }
+    if (d.heap.empty() || d.heap.front().first >= mu) {
+      ativa[lado] = false;
+      continue;
+    }
+
+    pop_heap(d.heap.begin(), d.heap.end(), maior);
+    auto [dist_x, x] = d.heap.back();
+    d.heap.pop_back();
+    ++d.num_fechados;
+    P.expandiu();
+
+    if (outra.dist[x] != HUGE_VAL && dist_x + outra.dist[x] < mu) {
+      mu = dist_x + outra.dist[x];
+      meio = x;
+    }
+
+    // Stall-on-demand: se um vizinho de nivel maior jah alcancado oferece
+    // um caminho mais curto ateh x, a distancia de x nao eh a correta e a
+    // busca nao precisa continuar a partir dele
+    bool parado = false;
+    for (Indice a = H.inicio[x]; a < H.inicio[x + 1] && !parado; ++a)
+      parado = d.dist[H.alto[a]] + H.peso[a] < dist_x;
+    if (parado)
+      continue;
+
+    for (Indice a = H.inicio[x]; a < H.inicio[x + 1]; ++a) {
+      Indice y = H.alto[a];
+      double nd = dist_x + H.peso[a];
+      P.relaxou();
+      if (nd < d.dist[y]) {
+        // Com entradas obsoletas no heap, diminuir a chave eh incluir de novo
+        if (d.dist[y] == HUGE_VAL)
+          d.tocados.push_back(y);
+        else
+          P.diminuiu();
+        d.dist[y] = nd;
+        d.arco[y] = a;
+        d.heap.push_back({nd, y});
+        push_heap(d.heap.begin(), d.heap.end(), maior);
+        P.aberto(E.ch_ida.heap.size() + E.ch_volta.heap.size());
+      }
+    }
+  }
+
+  NA = int(E.ch_ida.heap.size() + E.ch_volta.heap.size());
+  NF = E.ch_ida.num_fechados + E.ch_volta.num_fechados;
+  P.fimBusca();
+
+  if (meio == INDICE_INVALIDO)
+    return -1.0;
+
+  // Arcos da origem ateh o meio, subindo...
+  vector<Indice> &arcos_ida = E.ch_ida.arcos;
+  vector<pair<Indice, bool>> &pilha = E.ch_ida.pilha;
+  arcos_ida.clear();
+  for (Indice x = meio; x != orig; x = H.baixo[E.ch_ida.arco[x]])
+    arcos_ida.push_back(E.ch_ida.arco[x]);
+  C.push_back({INDICE_INVALIDO, orig});
+  for (size_t i = arcos_ida.size(); i-- > 0;)
+    expandirArco(H, arcos_ida[i], true, C, pilha);
+  // ... e do meio ateh o destino, descendo
+  for (Indice x = meio; x != dest; x = H.baixo[E.ch_volta.arco[x]])
+    expandirArco(H, E.ch_volta.arco[x], false, C, pilha);
+
+  // Comprimento somado na ordem do caminho, como no A*
+  double compr = 0.0;
+  for (size_t i = 1; i < C.size(); ++i)
+    compr += mapa.comprimento[C[i].rota];
+  return compr;
+}
+
+// Instancias usadas por Planejador::calcular
+template double Planejador::buscaHierarquia(Indice, Indice, EspacoBusca &,
+                                            int &, int &,
+                                            SemEstatisticas &) const;
+template double Planejador::buscaHierarquia(Indice, Indice, EspacoBusca &,
+                                            int &, int &,
+                                            ComEstatisticas &) const;
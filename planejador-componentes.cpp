@@ -0,0 +1,205 @@
+#include <algorithm>
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include <vector>
+
+#include "planejador.h"
+
+using namespace std;
+
+/* *************************
+ * COMPONENTES CONEXAS   *
+ ************************* */
+
+// Quando a origem e o destino estao em componentes diferentes do mapa (ilhas,
+// redes regionais sem ligacao entre si), a busca soh descobre que nao existe
+// caminho depois de fechar todos os pontos alcancaveis a partir da origem: o
+// pior caso das consultas. Com a componente de cada ponto, essas consultas
+// sao respondidas sem busca.
+//
+// As componentes sao calculadas com union-find concorrente: as rotas sao
+// divididas entre as threads, que unem os conjuntos das suas extremidades
+// com compare-and-swap. Uma raiz sempre eh ligada a uma raiz de indice
+// menor, de modo que nao se formam ciclos e a raiz de cada conjunto eh o seu
+// ponto de menor indice, qualquer que seja a ordem das unioes.
+//
+// As alteracoes do mapa mantem os rotulos sem refazer o calculo: uma rota
+// incluida une duas componentes, renomeando a menor, e uma rota removida
+// pode separar uma componente, o que eh descoberto por duas buscas em
+// largura a partir das extremidades da rota. Os rotulos deixam de ser
+// densos: os das componentes desfeitas nao sao reaproveitados.
+
+namespace {
+
+/// Pontos ou rotas processados por iteracao do pool
+constexpr size_t BLOCO_COMPONENTES = 1 << 14;
+
+/// Raiz do conjunto do ponto x, encurtando o caminho pela metade (cada ponto
+/// visitado passa a apontar para o avo)
+Indice raiz(atomic<Indice> *pai, Indice x) {
+  Indice p = pai[x].load(memory_order_relaxed);
+  while (p != x) {
+    Indice avo = pai[p].load(memory_order_relaxed);
+    if (avo != p)
+      pai[x].compare_exchange_weak(p, avo, memory_order_relaxed);
+    x = avo;
+    p = pai[x].load(memory_order_relaxed);
+  }
+  return x;
+}
+
+/// Une os conjuntos dos pontos a e b
+void unir(atomic<Indice> *pai, Indice a, Indice b) {
+  for (;;) {
+    a = raiz(pai, a);
+    b = raiz(pai, b);
+    if (a == b)
+      return;
+    if (a > b)
+      swap(a, b);
+    // Liga a raiz b sob a, se b ainda for raiz
+    Indice esperado = b;
+    if (pai[b].compare_exchange_strong(esperado, a, memory_order_relaxed))
+      return;
+  }
+}
+
+/// Numero de blocos de BLOCO_COMPONENTES elementos em n elementos
+size_t numBlocos(size_t n) {
+  return (n + BLOCO_COMPONENTES - 1) / BLOCO_COMPONENTES;
+}
+
+/// Area de trabalho das buscas que mantem as componentes, reaproveitada
+/// entre as alteracoes (uma por thread)
+struct BuscaComponentes {
+  vector<Indice> fila[2]; // Pontos alcancados por cada busca, em ordem
+  vector<uint32_t> marca; // Busca e rodada que alcancou cada ponto
+  uint32_t rodada = 0;    // Marcas da rodada atual: rodada-1 e rodada
+};
+
+BuscaComponentes &buscaComponentes() {
+  thread_local BuscaComponentes B;
+  return B;
+}
+
+} // namespace
+
+/// Calcula a componente conexa de cada ponto, em paralelo no pool
+void Mapa::calcularComponentes(PoolThreads &pool) {
+  const Indice n = numPontos(), m = numRotas();
+  unique_ptr<atomic<Indice>[]> pai(new atomic<Indice>[n]);
+
+  pool.paraCada(numBlocos(n), [&](size_t k, unsigned) {
+    const size_t fim = min<size_t>(n, (k + 1) * BLOCO_COMPONENTES);
+    for (size_t i = k * BLOCO_COMPONENTES; i < fim; ++i)
+      pai[i].store(Indice(i), memory_order_relaxed);
+  });
+  pool.paraCada(numBlocos(m), [&](size_t k, unsigned) {
+    const size_t fim = min<size_t>(m, (k + 1) * BLOCO_COMPONENTES);
+    for (size_t r = k * BLOCO_COMPONENTES; r < fim; ++r)
+      unir(pai.get(), extremidades[2 * r], extremidades[2 * r + 1]);
+  });
+  componente.resize(n);
+  Indice *c = componente.mutavel();
+  pool.paraCada(numBlocos(n), [&](size_t k, unsigned) {
+    const size_t fim = min<size_t>(n, (k + 1) * BLOCO_COMPONENTES);
+    for (size_t i = k * BLOCO_COMPONENTES; i < fim; ++i)
+      c[i] = raiz(pai.get(), Indice(i));
+  });
+
+  // Rotulos densos, na ordem das raizes: a raiz eh o menor ponto da
+  // componente, e jah recebeu o seu rotulo quando os demais sao visitados
+  num_componentes = 0;
+  for (Indice i = 0; i < n; ++i)
+    c[i] = (c[i] == i) ? num_componentes++ : c[c[i]];
+  tam_componente.assign(num_componentes, 0);
+  Indice *tam = tam_componente.mutavel();
+  for (Indice i = 0; i < n; ++i)
+    ++tam[c[i]];
+}
+
+/// Une as componentes dos pontos a e b, ligados por uma rota incluida.
+/// Os pontos da componente menor passam a ter o rotulo da maior, e o
+/// rotulo da menor deixa de ser usado: O(tamanho da menor).
+void Mapa::unirComponentes(Indice a, Indice b) {
+  Indice ca = componente[a], cb = componente[b];
+  if (ca == cb)
+    return;
+  Indice *tam = tam_componente.mutavel();
+  if (tam[ca] < tam[cb]) {
+    swap(a, b);
+    swap(ca, cb);
+  }
+  // Percorre a componente de b pelas rotas, sem atravessar a rota nova:
+  // os pontos de a jah tem um rotulo diferente de cb
+  Indice *c = componente.mutavel();
+  vector<Indice> &pilha = buscaComponentes().fila[0];
+  pilha.assign(1, b);
+  c[b] = ca;
+  while (!pilha.empty()) {
+    const Indice p = pilha.back();
+    pilha.pop_back();
+    for (Indice e = adj.inicio[p]; e < adj.fim[p]; ++e) {
+      const Indice viz = adj.vizinho[e];
+      if (c[viz] == cb) {
+        c[viz] = ca;
+        pilha.push_back(viz);
+      }
+    }
+  }
+  tam[ca] += tam[cb];
+  tam[cb] = 0;
+}
+
+/// Separa as componentes dos pontos a e b, cuja rota foi removida, se nao
+/// houver mais caminho entre eles. As buscas em largura a partir de a e de
+/// b avancam alternadamente, um ponto por vez: se uma delas se esgota, os
+/// pontos que ela alcancou formam uma nova componente; se se encontram, a
+/// componente continua inteira. O custo eh proporcional ao tamanho da
+/// parte separada, ou a regiao percorrida ateh o encontro.
+void Mapa::separarComponentes(Indice a, Indice b) {
+  if (a == b)
+    return;
+  BuscaComponentes &B = buscaComponentes();
+  if (B.marca.size() < numPontos())
+    B.marca.resize(numPontos(), 0);
+  if (B.rodada > UINT32_MAX - 2) {
+    fill(B.marca.begin(), B.marca.end(), 0);
+    B.rodada = 0;
+  }
+  B.rodada += 2;
+  const uint32_t marca[2] = {B.rodada - 1, B.rodada};
+  const Indice origem[2] = {a, b};
+  size_t prox[2] = {0, 0};
+  for (int k = 0; k < 2; ++k) {
+    B.fila[k].assign(1, origem[k]);
+    B.marca[origem[k]] = marca[k];
+  }
+
+  for (;;)
+    for (int k = 0; k < 2; ++k) {
+      vector<Indice> &fila = B.fila[k];
+      if (prox[k] == fila.size()) {
+        // A busca k se esgotou sem encontrar a outra: nova componente
+        const Indice antiga = componente[origem[k]];
+        const Indice nova = num_componentes++;
+        Indice *c = componente.mutavel();
+        for (Indice p : fila)
+          c[p] = nova;
+        tam_componente.mutavel()[antiga] -= Indice(fila.size());
+        tam_componente.push_back(Indice(fila.size()));
+        return;
+      }
+      const Indice p = fila[prox[k]++];
+      for (Indice e = adj.inicio[p]; e < adj.fim[p]; ++e) {
+        const Indice viz = adj.vizinho[e];
+        if (B.marca[viz] == marca[k])
+          continue;
+        if (B.marca[viz] == marca[1 - k])
+          return; // As buscas se encontraram
+        B.marca[viz] = marca[k];
+        fila.push_back(viz);
+      }
+    }
+}
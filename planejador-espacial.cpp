@@ -0,0 +1,398 @@
+#include <algorithm>
+#include <cmath>
+
+#include "planejador.h"
+
+using namespace std;
+
+/* *************************
+ * CLASSE INDICEESPACIAL *
+ ************************* */
+
+// As buscas comparam os quadrados das cordas entre os pontos na esfera de
+// raio 1, sem raizes nem funcoes trigonometricas. Soh as distancias dos
+// pontos encontrados sao convertidas para km: theta = 2 asin(c/2).
+
+namespace {
+
+/// Testa se a coordenada (em graus) eh valida (falso tambem se NaN)
+bool coordenadaValida(double latitude, double longitude) {
+  return fabs(latitude) <= 90.0 && fabs(longitude) <= 180.0;
+}
+
+/// Coordenadas cartesianas na esfera de raio 1, calculadas como em
+/// TrigPontos::definir
+void cartesianas(double latitude, double longitude, double q[3]) {
+  const double lat = radianos(latitude);
+  const double lon = radianos(longitude);
+  q[0] = cos(lat) * cos(lon);
+  q[1] = cos(lat) * sin(lon);
+  q[2] = sin(lat);
+}
+
+/// Distancia pela superficie (em km) correspondente ao quadrado da corda c2
+double distanciaCorda2(double c2) {
+  return 2.0 * RAIO_TERRA * asin(min(1.0, 0.5 * sqrt(c2)));
+}
+
+/// Quadrado da corda entre q e o ponto de coordenadas c
+inline double corda2(const double q[3], const double *c) {
+  const double dx = c[0] - q[0], dy = c[1] - q[1], dz = c[2] - q[2];
+  return dx * dx + dy * dy + dz * dz;
+}
+
+/// Um ponto durante a construcao do indice
+struct ItemIndice {
+  double c[3];
+  Indice pt;
+};
+
+} // namespace
+
+/// Constroi o indice dos pontos de T
+void IndiceEspacial::construir(const TrigPontos &T) {
+  const size_t n = T.x.size();
+  nivel_folhas = nivelFolhas(n);
+  ponto.resize(n);
+  noh.assign(size_t(1) << nivel_folhas, Noh{0.0, 0, 0});
+  Noh *nohs = noh.mutavel();
+
+  vector<ItemIndice> itens(n);
+  for (size_t i = 0; i < n; ++i)
+    itens[i] = {{T.x[i], T.y[i], T.sen_lat[i]}, Indice(i)};
+
+  // Cada noh interno divide o seu intervalo ao meio; os nohs de cada nivel
+  // sao processados da esquerda para a direita
+  for (unsigned nivel = 0; nivel < nivel_folhas; ++nivel) {
+    const size_t primeiro = size_t(1) << nivel;
+    for (size_t j = 0; j < primeiro; ++j) {
+      auto ini = itens.begin() + inicio(j, nivel);
+      auto fim = itens.begin() + inicio(j + 1, nivel);
+      auto meio = itens.begin() + inicio(2 * j + 1, nivel + 1);
+
+      // Eixo de maior extensao do intervalo
+      double menor[3] = {HUGE_VAL, HUGE_VAL, HUGE_VAL};
+      double maior[3] = {-HUGE_VAL, -HUGE_VAL, -HUGE_VAL};
+      for (auto it = ini; it != fim; ++it)
+        for (int a = 0; a < 3; ++a) {
+          menor[a] = min(menor[a], it->c[a]);
+          maior[a] = max(maior[a], it->c[a]);
+        }
+      uint8_t a = 0;
+      for (uint8_t b = 1; b < 3; ++b)
+        if (maior[b] - menor[b] > maior[a] - menor[a])
+          a = b;
+
+      // Os pontos antes do meio nao passam do plano, e os seguintes nao
+      // ficam antes dele
+      nth_element(ini, meio, fim, [a](const ItemIndice &p,
+                                      const ItemIndice &q) {
+        return p.c[a] < q.c[a];
+      });
+      nohs[primeiro + j] = {meio->c[a], a, 0};
+    }
+  }
+
+  coord.resize(3 * n);
+  posicao.resize(n);
+  Indice *pt = ponto.mutavel(), *pos = posicao.mutavel();
+  double *c = coord.mutavel();
+  for (size_t i = 0; i < n; ++i) {
+    copy_n(itens[i].c, 3, c + 3 * i);
+    pt[i] = itens[i].pt;
+    pos[itens[i].pt] = Indice(i);
+  }
+  extra.clear();
+  coord_extra.clear();
+  removidos = 0;
+}
+
+/// Inclui o ponto de indice igual ao numero de pontos indexados, fora da
+/// arvore
+void IndiceEspacial::incluir(const TrigPontos &T) {
+  const Indice pt = Indice(posicao.size());
+  posicao.push_back(Indice(ponto.size() + extra.size()));
+  extra.push_back(pt);
+  const double c[3] = {T.x[pt], T.y[pt], T.sen_lat[pt]};
+  coord_extra.append(c, 3);
+}
+
+/// Remove o ponto p. O ultimo ponto passa a ter o indice p.
+void IndiceEspacial::remover(Indice p) {
+  const Indice ultimo = Indice(posicao.size() - 1);
+  // Nas folhas, o ponto eh soh marcado; fora da arvore, o ultimo de extra
+  // ocupa o seu lugar
+  Indice *posicoes = posicao.mutavel();
+  const size_t pos = posicoes[p];
+  if (pos < ponto.size()) {
+    ponto.mutavel()[pos] = INDICE_INVALIDO;
+    ++removidos;
+  } else {
+    const size_t k = pos - ponto.size(), ultimo_extra = extra.size() - 1;
+    Indice *e = extra.mutavel();
+    double *c = coord_extra.mutavel();
+    e[k] = e[ultimo_extra];
+    copy_n(c + 3 * ultimo_extra, 3, c + 3 * k);
+    posicoes[e[k]] = Indice(pos);
+    extra.resize(ultimo_extra);
+    coord_extra.resize(3 * ultimo_extra);
+  }
+  // O ultimo ponto passa a ser p
+  if (p != ultimo) {
+    const size_t pos_ultimo = posicoes[ultimo];
+    if (pos_ultimo < ponto.size())
+      ponto.mutavel()[pos_ultimo] = p;
+    else
+      extra.mutavel()[pos_ultimo - ponto.size()] = p;
+    posicoes[p] = Indice(pos_ultimo);
+  }
+  posicao.resize(ultimo);
+}
+
+/// Completa o indice lido de um arquivo binario e testa se ele eh coerente
+/// com n pontos
+bool IndiceEspacial::restaurar(size_t n) {
+  const size_t folhas = ponto.size(), num_extra = extra.size();
+  nivel_folhas = nivelFolhas(folhas);
+  if (noh.size() != size_t(1) << nivel_folhas ||
+      coord.size() != 3 * folhas || coord_extra.size() != 3 * num_extra ||
+      posicao.size() != n || folhas + num_extra < n)
+    return false;
+  // Os eixos indexam as coordenadas
+  for (const Noh &N : noh)
+    if (N.eixo > 2)
+      return false;
+  // Cada ponto estah na sua posicao, e cada posicao ocupada (nas folhas ou
+  // fora da arvore) eh a do seu ponto
+  for (size_t p = 0; p < n; ++p) {
+    const size_t pos = posicao[p];
+    if (pos >= folhas + num_extra ||
+        (pos < folhas ? ponto[pos] : extra[pos - folhas]) != p)
+      return false;
+  }
+  for (size_t i = 0; i < folhas; ++i)
+    if (ponto[i] != INDICE_INVALIDO &&
+        (ponto[i] >= n || posicao[ponto[i]] != i))
+      return false;
+  for (size_t k = 0; k < num_extra; ++k)
+    if (extra[k] >= n || posicao[extra[k]] != folhas + k)
+      return false;
+  removidos = folhas + num_extra - n;
+  return true;
+}
+
+/// Busca a partir do noh no (de nivel nivel): visita os pontos das folhas
+/// (exceto os removidos) que podem ter pontos a uma corda (ao quadrado)
+/// menor ou igual a V.limite() de q. dist2 eh o quadrado da distancia de q
+/// ateh a regiao do noh, somando a distancia ateh cada plano jah
+/// atravessado (dif[a] no eixo a). O lado de cada plano mais proximo de q
+/// eh visitado primeiro, para que o limite diminua o quanto antes (nas
+/// buscas de proximos).
+template <class Visitante>
+void IndiceEspacial::percorrer(size_t no, unsigned nivel, const double q[3],
+                               double dist2, double dif[3],
+                               Visitante &V) const {
+  while (nivel < nivel_folhas) {
+    const uint32_t a = noh[no].eixo;
+    const double d = q[a] - noh[no].corte;
+    const size_t perto = 2 * no + (d >= 0.0);
+    percorrer(perto, nivel + 1, q, dist2, dif, V);
+    // O outro lado soh eh visitado se a sua regiao estiver dentro do limite
+    const double anterior = dif[a];
+    const double dist2_longe = dist2 - anterior * anterior + d * d;
+    if (dist2_longe > V.limite())
+      return;
+    dif[a] = d;
+    percorrer(perto ^ 1, nivel + 1, q, dist2_longe, dif, V);
+    dif[a] = anterior;
+    return;
+  }
+  const size_t j = no - (size_t(1) << nivel_folhas);
+  const size_t fim = inicio(j + 1, nivel_folhas);
+  for (size_t i = inicio(j, nivel_folhas); i < fim; ++i)
+    if (ponto[i] != INDICE_INVALIDO)
+      V.considerar(ponto[i], corda2(q, &coord[3 * i]));
+}
+
+/// Busca os pontos aceitos pelo visitante V: primeiro os de fora da arvore,
+/// que sao poucos e podem diminuir o limite, e depois os das folhas
+template <class Visitante>
+void IndiceEspacial::buscar(const double q[3], Visitante &V) const {
+  for (size_t k = 0; k < extra.size(); ++k)
+    V.considerar(extra[k], corda2(q, &coord_extra[3 * k]));
+  if (ponto.empty())
+    return;
+  double dif[3] = {0.0, 0.0, 0.0};
+  percorrer(1, 0, q, 0.0, dif, V);
+}
+
+namespace {
+
+/// Visitante da busca do ponto mais proximo
+struct MaisProximo {
+  double melhor = HUGE_VAL;
+  Indice pt = INDICE_INVALIDO;
+  double limite() const { return melhor; }
+  void considerar(Indice i, double d2) {
+    if (d2 < melhor) {
+      melhor = d2;
+      pt = i;
+    }
+  }
+};
+
+/// Visitante da busca dos k pontos mais proximos. R eh um heap de maximo
+/// com os melhores encontrados: (quadrado da corda, indice do ponto).
+struct KProximos {
+  size_t k;
+  vector<pair<double, Indice>> &R;
+  double limite() const { return R.size() < k ? HUGE_VAL : R.front().first; }
+  void considerar(Indice i, double d2) {
+    pair<double, Indice> x(d2, i);
+    if (R.size() < k) {
+      R.push_back(x);
+      push_heap(R.begin(), R.end());
+    } else if (x < R.front()) {
+      pop_heap(R.begin(), R.end());
+      R.back() = x;
+      push_heap(R.begin(), R.end());
+    }
+  }
+};
+
+/// Visitante da busca dos pontos a uma corda (ao quadrado) de ateh c2
+struct NoRaio {
+  double c2;
+  vector<pair<double, Indice>> &R;
+  double limite() const { return c2; }
+  void considerar(Indice i, double d2) {
+    if (d2 <= c2)
+      R.push_back({d2, i});
+  }
+};
+
+} // namespace
+
+/// Os k pontos mais proximos da coordenada (em graus), em ordem crescente
+/// de distancia
+void IndiceEspacial::proximos(double latitude, double longitude, size_t k,
+                              vector<Resultado> &R) const {
+  R.clear();
+  if (k == 0 || posicao.empty() || !coordenadaValida(latitude, longitude))
+    return;
+  double q[3];
+  cartesianas(latitude, longitude, q);
+  KProximos V{k, R};
+  buscar(q, V);
+  sort_heap(R.begin(), R.end());
+  for (Resultado &x : R)
+    x.first = distanciaCorda2(x.first);
+}
+
+/// Os pontos a uma distancia em linha reta de ateh raio km da coordenada
+/// (em graus), em ordem crescente de distancia
+void IndiceEspacial::noRaio(double latitude, double longitude, double raio,
+                            vector<Resultado> &R) const {
+  R.clear();
+  if (!(raio >= 0.0) || posicao.empty() ||
+      !coordenadaValida(latitude, longitude))
+    return;
+  double q[3];
+  cartesianas(latitude, longitude, q);
+  // Corda correspondente ao raio (o maior angulo possivel eh pi). A margem
+  // cobre o arredondamento do seno; os pontos alem do raio que ela inclui
+  // sao descartados depois, em km.
+  const double c = 2.0 * sin(0.5 * min(raio / RAIO_TERRA, radianos(180.0)));
+  NoRaio V{c * c * (1.0 + 1e-12), R};
+  buscar(q, V);
+  sort(R.begin(), R.end());
+  for (Resultado &x : R)
+    x.first = distanciaCorda2(x.first);
+  while (!R.empty() && R.back().first > raio)
+    R.pop_back();
+}
+
+/// Ponto mais proximo da coordenada (em graus)
+Indice IndiceEspacial::maisProximo(double latitude, double longitude) const {
+  if (posicao.empty() || !coordenadaValida(latitude, longitude))
+    return INDICE_INVALIDO;
+  double q[3];
+  cartesianas(latitude, longitude, q);
+  MaisProximo V;
+  buscar(q, V);
+  return V.pt;
+}
+
+/// Torna o indice vazio
+void IndiceEspacial::clear() {
+  ponto.clear();
+  coord.clear();
+  noh.clear();
+  nivel_folhas = 0;
+  extra.clear();
+  coord_extra.clear();
+  posicao.clear();
+  removidos = 0;
+}
+
+/* *************************
+ * CLASSE PLANEJADOR     *
+ ************************* */
+
+namespace {
+
+/// Converte os resultados do indice espacial em PontoProximo
+vector<PontoProximo> converterProximos(
+    const Mapa &M, const vector<IndiceEspacial::Resultado> &R) {
+  vector<PontoProximo> P(R.size());
+  for (size_t i = 0; i < R.size(); ++i) {
+    P[i].id.set(string(M.id_pontos[R[i].second]));
+    P[i].distancia = R[i].first;
+  }
+  return P;
+}
+
+} // namespace
+
+/// Retorna os k pontos do mapa mais proximos da coordenada
+vector<PontoProximo> Planejador::pontosProximos(double latitude,
+                                                double longitude,
+                                                size_t k) const {
+  vector<IndiceEspacial::Resultado> R;
+  mapa.espacial.proximos(latitude, longitude, k, R);
+  return converterProximos(mapa, R);
+}
+
+/// Retorna os pontos do mapa a ateh raio km da coordenada
+vector<PontoProximo> Planejador::pontosNoRaio(double latitude,
+                                              double longitude,
+                                              double raio) const {
+  vector<IndiceEspacial::Resultado> R;
+  mapa.espacial.noRaio(latitude, longitude, raio, R);
+  return converterProximos(mapa, R);
+}
+
+/// Calcula o caminho entre os pontos mais proximos das coordenadas
+double Planejador::calculaCaminho(double lat_origem, double lon_origem,
+                                  double lat_destino, double lon_destino,
+                                  Caminho &C, int &NA, int &NF,
+                                  ModoBusca modo) {
+  return calculaCaminho(lat_origem, lon_origem, lat_destino, lon_destino, C,
+                        NA, NF, espaco, modo);
+}
+
+/// Versao reentrante de calculaCaminho entre coordenadas
+double Planejador::calculaCaminho(double lat_origem, double lon_origem,
+                                  double lat_destino, double lon_destino,
+                                  Caminho &C, int &NA, int &NF,
+                                  EspacoBusca &E, ModoBusca modo) const {
+  // Ids vazias (inexistentes) se a coordenada for invalida
+  IDPonto id_origem, id_destino;
+  Indice orig = mapa.espacial.maisProximo(lat_origem, lon_origem);
+  Indice dest = mapa.espacial.maisProximo(lat_destino, lon_destino);
+  if (orig != INDICE_INVALIDO)
+    id_origem.set(string(mapa.id_pontos[orig]));
+  if (dest != INDICE_INVALIDO)
+    id_destino.set(string(mapa.id_pontos[dest]));
+  return calculaCaminho(id_origem, id_destino, C, NA, NF, E, modo);
+}
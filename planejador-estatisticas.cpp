@@ -0,0 +1,105 @@
+#include <algorithm>
+#include <iostream>
+
+#include "planejador.h"
+
+using namespace std;
+
+/* *************************
+ * CLASSE TOTAISBUSCA    *
+ ************************* */
+
+namespace {
+/// Segundos em nanossegundos inteiros
+uint64_t nanossegundos(double s) { return uint64_t(s * 1e9 + 0.5); }
+} // namespace
+
+/// Soma as estatisticas de uma consulta aos totais
+void TotaisBusca::acumular(const EstatisticasBusca &E) {
+  // Os totais sao independentes entre si: basta a ordem relaxada
+  const auto rel = memory_order_relaxed;
+  consultas.fetch_add(1, rel);
+  if (E.erro != 0)
+    erros[min(E.erro, NUM_ERROS - 1)].fetch_add(1, rel);
+  expandidos.fetch_add(E.expandidos, rel);
+  relaxados.fetch_add(E.relaxados, rel);
+  diminuicoes.fetch_add(E.diminuicoes, rel);
+  reabertos.fetch_add(E.reabertos, rel);
+  heuristicas.fetch_add(E.heuristicas, rel);
+  ns_preparo.fetch_add(nanossegundos(E.t_preparo), rel);
+  ns_busca.fetch_add(nanossegundos(E.t_busca), rel);
+  ns_reconstrucao.fetch_add(nanossegundos(E.t_reconstrucao), rel);
+
+  uint64_t pico = pico_aberto.load(rel);
+  while (E.pico_aberto > pico &&
+         !pico_aberto.compare_exchange_weak(pico, E.pico_aberto, rel))
+    ;
+}
+
+/// Zera os totais
+void TotaisBusca::clear() {
+  consultas = 0;
+  for (auto &e : erros)
+    e = 0;
+  expandidos = relaxados = diminuicoes = reabertos = heuristicas = 0;
+  pico_aberto = 0;
+  ns_preparo = ns_busca = ns_reconstrucao = 0;
+}
+
+/// Escreve os totais no formato de texto do Prometheus: para cada metrica,
+/// linhas de ajuda e de tipo seguidas das amostras
+void TotaisBusca::exportarPrometheus(ostream &X) const {
+  auto metrica = [&X](const char *nome, const char *tipo, const char *ajuda) {
+    X << "# HELP " << nome << ' ' << ajuda << '\n'
+      << "# TYPE " << nome << ' ' << tipo << '\n';
+  };
+
+  metrica("planejador_consultas_total", "counter",
+          "Consultas de caminho com estatisticas");
+  X << "planejador_consultas_total " << consultas.load() << '\n';
+
+  metrica("planejador_erros_total", "counter",
+          "Consultas terminadas em erro, por codigo");
+  for (int i = 1; i < NUM_ERROS; ++i)
+    X << "planejador_erros_total{codigo=\"" << i << "\"} " << erros[i].load()
+      << '\n';
+
+  metrica("planejador_pontos_expandidos_total", "counter",
+          "Pontos fechados pelas buscas");
+  X << "planejador_pontos_expandidos_total " << expandidos.load() << '\n';
+
+  metrica("planejador_arestas_relaxadas_total", "counter",
+          "Arestas examinadas a partir dos pontos fechados");
+  X << "planejador_arestas_relaxadas_total " << relaxados.load() << '\n';
+
+  metrica("planejador_diminuicoes_chave_total", "counter",
+          "Chaves diminuidas no conjunto aberto");
+  X << "planejador_diminuicoes_chave_total " << diminuicoes.load() << '\n';
+
+  metrica("planejador_reabertos_total", "counter",
+          "Pontos fechados alcancados depois por caminho mais curto");
+  X << "planejador_reabertos_total " << reabertos.load() << '\n';
+
+  metrica("planejador_heuristicas_total", "counter",
+          "Avaliacoes da heuristica");
+  X << "planejador_heuristicas_total " << heuristicas.load() << '\n';
+
+  metrica("planejador_pico_aberto", "gauge",
+          "Maior conjunto aberto de uma consulta");
+  X << "planejador_pico_aberto " << pico_aberto.load() << '\n';
+
+  metrica("planejador_tempo_segundos_total", "counter",
+          "Tempo das consultas, por fase");
+  X << "planejador_tempo_segundos_total{fase=\"preparo\"} "
+    << ns_preparo.load() * 1e-9 << '\n'
+    << "planejador_tempo_segundos_total{fase=\"busca\"} "
+    << ns_busca.load() * 1e-9 << '\n'
+    << "planejador_tempo_segundos_total{fase=\"reconstrucao\"} "
+    << ns_reconstrucao.load() * 1e-9 << '\n';
+}
+
+/// Totais do processo, acumulados por Planejador::calculaCaminho
+TotaisBusca &TotaisBusca::global() {
+  static TotaisBusca totais;
+  return totais;
+}
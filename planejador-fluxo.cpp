@@ -0,0 +1,501 @@
+#include <charconv>
+#include <cmath>
+#include <condition_variable>
+#include <deque>
+#include <istream>
+#include <ostream>
+#include <system_error>
+#include <thread>
+
+#include "planejador.h"
+
+using namespace std;
+
+/* *************************
+ * FLUXO DE CONSULTAS    *
+ ************************* */
+
+// O fluxo eh processado em blocos de consultas por um pipeline de 3 etapas,
+// que trabalham ao mesmo tempo em blocos diferentes:
+// - uma thread leh as linhas da entrada e as converte em consultas;
+// - a thread que chamou processarFluxo calcula os caminhos de cada bloco em
+//   paralelo, com as threads do pool, e formata os resultados;
+// - uma thread escreve os resultados na saida, bloco a bloco, na ordem.
+// Os blocos circulam entre as etapas e voltam vazios para a leitura: como
+// ha max_blocos blocos no total, a leitura espera quando todos estao em
+// uso, e a memoria nao depende do tamanho da entrada.
+
+namespace {
+
+/// Uma consulta lida da entrada
+struct Consulta {
+  size_t linha;    // Numero da linha na entrada (a partir de 1)
+  bool valida;     // Se a linha foi entendida
+  string id;       // Valor do campo "id", em JSON (ver LeitorJSON::valor)
+  IDPonto origem;
+  IDPonto destino;
+  bool com_orcamento;      // Se tem o campo "prazo_ms" ou "max_expansoes"
+  OpcoesAnytime orcamento; // Valores desses campos (JSON)
+};
+
+/// Um bloco de consultas e os seus resultados, jah formatados
+struct BlocoConsultas {
+  vector<Consulta> consultas;
+  size_t num; // Consultas do bloco (consultas pode ter mais elementos)
+  vector<string> saida; // Linha de resultado de cada consulta
+};
+
+/// Fila de blocos entre duas etapas do pipeline. Depois de fechada, pop
+/// retorna false quando a fila estiver vazia.
+class FilaBlocos {
+private:
+  mutex m;
+  condition_variable cv;
+  deque<BlocoConsultas *> blocos;
+  bool fechada;
+
+public:
+  FilaBlocos() : m(), cv(), blocos(), fechada(false) {}
+  void push(BlocoConsultas *B) {
+    {
+      lock_guard<mutex> lk(m);
+      blocos.push_back(B);
+    }
+    cv.notify_one();
+  }
+  bool pop(BlocoConsultas *&B) {
+    unique_lock<mutex> lk(m);
+    cv.wait(lk, [this] { return !blocos.empty() || fechada; });
+    if (blocos.empty())
+      return false;
+    B = blocos.front();
+    blocos.pop_front();
+    return true;
+  }
+  void fechar() {
+    {
+      lock_guard<mutex> lk(m);
+      fechada = true;
+    }
+    cv.notify_all();
+  }
+};
+
+/// Remove os espacos do inicio e do fim de S
+string_view aparar(string_view S) {
+  while (!S.empty() && (S.front() == ' ' || S.front() == '\t'))
+    S.remove_prefix(1);
+  while (!S.empty() &&
+         (S.back() == ' ' || S.back() == '\t' || S.back() == '\r'))
+    S.remove_suffix(1);
+  return S;
+}
+
+/// Acrescenta a T o texto S entre aspas, com os escapes do JSON
+void escreverTexto(string &T, string_view S) {
+  static const char HEXA[] = "0123456789abcdef";
+  T += '"';
+  for (char c : S) {
+    if (c == '"' || c == '\\') {
+      T += '\\';
+      T += c;
+    } else if (static_cast<unsigned char>(c) < 0x20) {
+      T += "\\u00";
+      T += HEXA[(c >> 4) & 0xF];
+      T += HEXA[c & 0xF];
+    } else {
+      T += c;
+    }
+  }
+  T += '"';
+}
+
+/// Testa se L eh um numero com a sintaxe do JSON:
+/// -?(0|[1-9][0-9]*)(.[0-9]+)?([eE][+-]?[0-9]+)?
+bool numeroJSON(string_view L) {
+  size_t p = 0;
+  auto digitos = [&]() {
+    const size_t ini = p;
+    while (p < L.size() && L[p] >= '0' && L[p] <= '9')
+      ++p;
+    return p > ini;
+  };
+  if (p < L.size() && L[p] == '-')
+    ++p;
+  if (p < L.size() && L[p] == '0')
+    ++p;
+  else if (!digitos())
+    return false;
+  if (p < L.size() && L[p] == '.') {
+    ++p;
+    if (!digitos())
+      return false;
+  }
+  if (p < L.size() && (L[p] == 'e' || L[p] == 'E')) {
+    ++p;
+    if (p < L.size() && (L[p] == '+' || L[p] == '-'))
+      ++p;
+    if (!digitos())
+      return false;
+  }
+  return p == L.size();
+}
+
+/// Leitura de uma linha JSON com um objeto de campos simples
+class LeitorJSON {
+private:
+  string_view S;
+  size_t p;
+
+  void espacos() {
+    while (p < S.size() && (S[p] == ' ' || S[p] == '\t' || S[p] == '\r'))
+      ++p;
+  }
+  bool consumir(char c) {
+    espacos();
+    if (p >= S.size() || S[p] != c)
+      return false;
+    ++p;
+    return true;
+  }
+  /// Acrescenta a T o caractere de codigo c, em UTF-8
+  static void utf8(uint32_t c, string &T) {
+    if (c < 0x80) {
+      T += char(c);
+    } else if (c < 0x800) {
+      T += char(0xC0 | (c >> 6));
+      T += char(0x80 | (c & 0x3F));
+    } else if (c < 0x10000) {
+      T += char(0xE0 | (c >> 12));
+      T += char(0x80 | ((c >> 6) & 0x3F));
+      T += char(0x80 | (c & 0x3F));
+    } else {
+      T += char(0xF0 | (c >> 18));
+      T += char(0x80 | ((c >> 12) & 0x3F));
+      T += char(0x80 | ((c >> 6) & 0x3F));
+      T += char(0x80 | (c & 0x3F));
+    }
+  }
+  /// Leh os 4 digitos hexadecimais de um \u
+  bool hexa(uint32_t &c) {
+    if (p + 4 > S.size())
+      return false;
+    auto r = from_chars(S.data() + p, S.data() + p + 4, c, 16);
+    if (r.ptr != S.data() + p + 4)
+      return false;
+    p += 4;
+    return true;
+  }
+
+public:
+  explicit LeitorJSON(string_view linha) : S(linha), p(0) {}
+
+  /// Leh um texto entre aspas, convertendo as sequencias de escape
+  bool texto(string &T) {
+    T.clear();
+    if (!consumir('"'))
+      return false;
+    while (p < S.size() && S[p] != '"') {
+      char c = S[p++];
+      if (c != '\\') {
+        T += c;
+        continue;
+      }
+      if (p >= S.size())
+        return false;
+      switch (char e = S[p++]) {
+      case 'b': T += '\b'; break;
+      case 'f': T += '\f'; break;
+      case 'n': T += '\n'; break;
+      case 'r': T += '\r'; break;
+      case 't': T += '\t'; break;
+      case 'u': {
+        uint32_t c1 = 0, c2 = 0;
+        if (!hexa(c1))
+          return false;
+        // Par de substitutos (UTF-16) de um caractere acima de 0xFFFF
+        if (c1 >= 0xD800 && c1 < 0xDC00) {
+          if (p + 2 > S.size() || S[p] != '\\' || S[p + 1] != 'u')
+            return false;
+          p += 2;
+          if (!hexa(c2) || c2 < 0xDC00 || c2 >= 0xE000)
+            return false;
+          c1 = 0x10000 + ((c1 - 0xD800) << 10) + (c2 - 0xDC00);
+        }
+        utf8(c1, T);
+        break;
+      }
+      default:
+        if (e != '"' && e != '\\' && e != '/')
+          return false;
+        T += e;
+      }
+    }
+    return consumir('"');
+  }
+
+  /// Leh um valor simples (texto, numero, true, false ou null), guardando
+  /// em V o seu texto em JSON valido: os numeros e as palavras como estao
+  /// na linha, e os textos reescritos por escreverTexto. Qualquer outro
+  /// valor eh recusado, e V nao eh alterado.
+  bool valor(string &V) {
+    espacos();
+    if (p < S.size() && S[p] == '"') {
+      string T;
+      if (!texto(T))
+        return false;
+      V.clear();
+      escreverTexto(V, T);
+      return true;
+    }
+    const size_t ini = p;
+    while (p < S.size() && S[p] != ',' && S[p] != '}' && S[p] != ' ' &&
+           S[p] != '\t' && S[p] != '\r')
+      ++p;
+    const string_view L = S.substr(ini, p - ini);
+    if (L != "true" && L != "false" && L != "null" && !numeroJSON(L))
+      return false;
+    V.assign(L);
+    return true;
+  }
+
+  /// Leh um numero nao negativo
+  template <class Numero> bool numero(Numero &x) {
+    string V;
+    if (!valor(V))
+      return false;
+    auto r = from_chars(V.data(), V.data() + V.size(), x);
+    return r.ec == errc() && r.ptr == V.data() + V.size() && !(x < 0);
+  }
+
+  /// Leh a consulta do objeto {"origem": ..., "destino": ..., "id": ...},
+  /// com o orcamento opcional ("prazo_ms": ..., "max_expansoes": ...).
+  /// Outros campos (de valor simples) sao ignorados.
+  bool consulta(Consulta &Q) {
+    string chave, v;
+    bool tem_origem = false, tem_destino = false;
+    Q.id.clear();
+    Q.com_orcamento = false;
+    Q.orcamento = OpcoesAnytime();
+    if (!consumir('{'))
+      return false;
+    if (!consumir('}')) {
+      do {
+        if (!texto(chave) || !consumir(':'))
+          return false;
+        if (chave == "origem" || chave == "destino") {
+          if (!texto(v))
+            return false;
+          (chave == "origem" ? tem_origem : tem_destino) = true;
+          (chave == "origem" ? Q.origem : Q.destino).set(std::move(v));
+        } else if (chave == "prazo_ms") {
+          if (!numero(Q.orcamento.prazo_ms))
+            return false;
+          Q.com_orcamento = true;
+        } else if (chave == "max_expansoes") {
+          if (!numero(Q.orcamento.max_expansoes))
+            return false;
+          Q.com_orcamento = true;
+        } else if (!valor(chave == "id" ? Q.id : v)) {
+          return false;
+        }
+      } while (consumir(','));
+      if (!consumir('}'))
+        return false;
+    }
+    espacos();
+    return p == S.size() && tem_origem && tem_destino;
+  }
+};
+
+/// Leh a consulta de uma linha CSV: origem e destino separados por ';' (ou
+/// por ',', se a linha nao tiver ';')
+bool lerCSV(string_view L, Consulta &Q) {
+  char sep = L.find(';') != string_view::npos ? ';' : ',';
+  size_t k = L.find(sep);
+  if (k == string_view::npos || L.find(sep, k + 1) != string_view::npos)
+    return false;
+  Q.id.clear();
+  Q.com_orcamento = false;
+  Q.origem.set(string(aparar(L.substr(0, k))));
+  Q.destino.set(string(aparar(L.substr(k + 1))));
+  return true;
+}
+
+/// Acrescenta a T um numero, com o menor numero de digitos que o representa
+template <class Numero> void escreverNumero(string &T, Numero x) {
+  char buf[32];
+  auto r = to_chars(buf, buf + sizeof(buf), x);
+  T.append(buf, r.ptr);
+}
+
+/// Formata em T o resultado de uma consulta, como um objeto JSON em uma
+/// linha. R eh a qualidade do caminho das consultas com orcamento.
+void formatar(const Consulta &Q, double compr, const CaminhoContiguo &C,
+              const EstatisticasBusca &est, const ResultadoAnytime &R,
+              string &T) {
+  T = "{\"linha\":";
+  escreverNumero(T, Q.linha);
+  if (!Q.id.empty()) {
+    T += ",\"id\":";
+    T += Q.id;
+  }
+  if (!Q.valida) {
+    // Linha que nao eh uma consulta
+    T += ",\"erro\":-1}\n";
+    return;
+  }
+  T += ",\"origem\":";
+  escreverTexto(T, Q.origem.str());
+  T += ",\"destino\":";
+  escreverTexto(T, Q.destino.str());
+  T += ",\"comprimento\":";
+  escreverNumero(T, compr);
+  T += ",\"pontos\":[";
+  bool primeiro = true;
+  for (const auto &trecho : C) {
+    if (!primeiro)
+      T += ',';
+    escreverTexto(T, trecho.ponto);
+    primeiro = false;
+  }
+  T += "],\"rotas\":[";
+  primeiro = true;
+  for (const auto &trecho : C) {
+    if (trecho.rota.empty())
+      continue;
+    if (!primeiro)
+      T += ',';
+    escreverTexto(T, trecho.rota);
+    primeiro = false;
+  }
+  T += "],\"NA\":";
+  escreverNumero(T, est.aberto_final);
+  T += ",\"NF\":";
+  escreverNumero(T, est.fechado_final);
+  T += ",\"relaxados\":";
+  escreverNumero(T, est.relaxados);
+  T += ",\"tempo_ms\":";
+  escreverNumero(T, 1e3 * (est.t_preparo + est.t_busca + est.t_reconstrucao));
+  if (Q.com_orcamento && est.erro == 0) {
+    T += ",\"subotimalidade\":";
+    if (std::isfinite(R.subotimalidade))
+      escreverNumero(T, R.subotimalidade);
+    else
+      T += "null";
+    T += R.completa ? ",\"completa\":true" : ",\"completa\":false";
+  }
+  if (est.erro != 0) {
+    T += ",\"erro\":";
+    escreverNumero(T, est.erro);
+  }
+  T += "}\n";
+}
+
+} // namespace
+
+/// Processa um fluxo de consultas, uma por linha de entrada, escrevendo em
+/// saida um resultado JSON por linha, na ordem das consultas
+size_t Planejador::processarFluxo(istream &entrada, ostream &saida,
+                                  const OpcoesFluxo &O,
+                                  PoolThreads &pool) const {
+  const size_t tam_bloco = max<size_t>(1, O.tam_bloco);
+  vector<BlocoConsultas> blocos(max<size_t>(2, O.max_blocos));
+  FilaBlocos livres, lidos, calculados;
+  for (BlocoConsultas &B : blocos) {
+    B.consultas.resize(tam_bloco);
+    B.saida.resize(tam_bloco);
+    livres.push(&B);
+  }
+
+  // Leitura: preenche os blocos livres. Um bloco incompleto segue adiante
+  // quando a proxima linha ainda nao estah disponivel (entrada interativa
+  // ou pipe), para nao atrasar as respostas.
+  thread leitura([&] {
+    string linha;
+    size_t num_linha = 0;
+    BlocoConsultas *B;
+    bool fim = false;
+    while (!fim && livres.pop(B)) {
+      B->num = 0;
+      while (B->num < tam_bloco) {
+        if (B->num > 0 && entrada.rdbuf()->in_avail() <= 0)
+          break;
+        if (!getline(entrada, linha)) {
+          fim = true;
+          break;
+        }
+        ++num_linha;
+        string_view L = aparar(linha);
+        if (L.empty())
+          continue;
+        Consulta &Q = B->consultas[B->num];
+        Q.linha = num_linha;
+        if (L.front() == '{') {
+          Q.valida = LeitorJSON(L).consulta(Q);
+        } else {
+          Q.valida = lerCSV(L, Q);
+          // Cabecalho do CSV
+          if (num_linha == 1 && !(Q.valida && Q.origem.valid()))
+            continue;
+        }
+        ++B->num;
+      }
+      if (B->num > 0)
+        lidos.push(B);
+      else
+        livres.push(B);
+    }
+    lidos.fechar();
+  });
+
+  // Escrita: os blocos chegam na ordem em que foram lidos
+  thread escrita([&] {
+    BlocoConsultas *B;
+    while (calculados.pop(B)) {
+      for (size_t i = 0; i < B->num; ++i)
+        saida.write(B->saida[i].data(), B->saida[i].size());
+      saida.flush();
+      livres.push(B);
+    }
+  });
+
+  // Calculo: uma area de trabalho (emprestada da reserva) e um caminho por
+  // thread do pool
+  ReservaEspacos::Emprestimo espacos(reserva, pool.size());
+  vector<CaminhoContiguo> caminhos(pool.size());
+  size_t total = 0;
+  BlocoConsultas *B;
+  try {
+    while (lidos.pop(B)) {
+      pool.paraCada(B->num, [&](size_t i, unsigned t) {
+        const Consulta &Q = B->consultas[i];
+        CaminhoContiguo &C = caminhos[t];
+        EstatisticasBusca est;
+        ResultadoAnytime R;
+        double compr = -1.0;
+        if (Q.valida && Q.com_orcamento)
+          compr = calculaCaminhoAnytime(Q.origem, Q.destino, C, est,
+                                        espacos[t], Q.orcamento, R);
+        else if (Q.valida)
+          compr = calculaCaminho(Q.origem, Q.destino, C, est, espacos[t],
+                                 O.modo);
+        formatar(Q, compr, C, est, R, B->saida[i]);
+      });
+      total += B->num;
+      calculados.push(B);
+    }
+  } catch (...) {
+    // Encerra as outras etapas antes de repassar o erro
+    livres.fechar();
+    calculados.fechar();
+    escrita.join();
+    leitura.join();
+    throw;
+  }
+  calculados.fechar();
+  escrita.join();
+  livres.fechar();
+  leitura.join();
+  return total;
+}
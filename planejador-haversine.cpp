@@ -0,0 +1,187 @@
+#include <algorithm>
+#include <array>
+#include <cmath>
+
+#include "planejador.h"
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#include <immintrin.h>
+#define HAVERSINE_AVX2 1
+#endif
+
+using namespace std;
+
+/* *************************
+ * CLASSE TRIGPONTOS     *
+ ************************* */
+
+/// Calcula as tabelas a partir das latitudes e longitudes (em graus)
+void TrigPontos::calcular(const Arranjo<double> &latitude,
+                          const Arranjo<double> &longitude) {
+  const size_t n = latitude.size();
+  for (Arranjo<double> *v : {&lon, &sen_lat, &cos_lat, &x, &y})
+    v->assign(n, 0.0);
+  for (size_t i = 0; i < n; ++i)
+    definir(Indice(i), latitude[i], longitude[i]);
+}
+
+/// Calcula as tabelas do ponto i (i <= numero de pontos: i igual ao numero
+/// de pontos inclui um ponto)
+void TrigPontos::definir(Indice i, double latitude, double longitude) {
+  if (i == lon.size())
+    for (Arranjo<double> *v : {&lon, &sen_lat, &cos_lat, &x, &y})
+      v->push_back(0.0);
+  // A mesma conversao de ::haversine, para obter os mesmos valores
+  const double lat = radianos(latitude), lo = radianos(longitude);
+  const double s = sin(lat), c = cos(lat);
+  lon.mutavel()[i] = lo;
+  sen_lat.mutavel()[i] = s;
+  cos_lat.mutavel()[i] = c;
+  x.mutavel()[i] = c * cos(lo);
+  y.mutavel()[i] = c * sin(lo);
+}
+
+/// Remove o ponto i, que passa a ser o ultimo ponto
+void TrigPontos::remover(Indice i) {
+  for (Arranjo<double> *v : {&lon, &sen_lat, &cos_lat, &x, &y}) {
+    const size_t ultimo = v->size() - 1;
+    v->mutavel()[i] = (*v)[ultimo];
+    v->resize(ultimo);
+  }
+}
+
+/// Torna as tabelas vazias
+void TrigPontos::clear() {
+  lon.clear();
+  sen_lat.clear();
+  cos_lat.clear();
+  x.clear();
+  y.clear();
+}
+
+// Calculo em lote: o angulo entre dois pontos eh obtido da corda c entre
+// eles na esfera de raio 1, theta = 2 asin(c/2), em vez do arco cosseno do
+// produto escalar usado por ::haversine. A corda soh usa somas e produtos,
+// que o AVX2 calcula em 4 pontos de cada vez, e o arco seno eh um polinomio
+// (a biblioteca padrao nao tem funcoes trigonometricas vetorizadas).
+// Para pontos proximos, a corda eh mais precisa que o arco cosseno.
+
+namespace {
+
+/// Distancia do ponto alvo ateh o ponto pt pela corda, versao escalar
+inline double distanciaCorda(const TrigPontos &T, Indice alvo, Indice pt) {
+  const double dx = T.x[pt] - T.x[alvo];
+  const double dy = T.y[pt] - T.y[alvo];
+  const double dz = T.sen_lat[pt] - T.sen_lat[alvo];
+  const double meia_corda = min(1.0, 0.5 * sqrt(dx * dx + dy * dy + dz * dz));
+  return 2.0 * RAIO_TERRA * asin(meia_corda);
+}
+
+#ifdef HAVERSINE_AVX2
+
+/// Numero de termos da serie de Taylor do arco seno usados no AVX2
+constexpr size_t TERMOS_ASIN = 24;
+
+/// Coeficientes da serie asin(a) = a * soma(COEF_ASIN[k] * a^(2k)), em que
+/// COEF_ASIN[k] = (2k)! / (4^k (k!)^2 (2k+1)). Com a <= 1/2, o termo
+/// desprezado eh menor que 1e-17.
+constexpr array<double, TERMOS_ASIN> COEF_ASIN = [] {
+  array<double, TERMOS_ASIN> c{};
+  double binomial = 1.0; // (2k)! / (4^k (k!)^2)
+  for (size_t k = 0; k < TERMOS_ASIN; ++k) {
+    if (k > 0)
+      binomial *= double(2 * k - 1) / double(2 * k);
+    c[k] = binomial / double(2 * k + 1);
+  }
+  return c;
+}();
+
+/// Arco seno de 4 valores em [0, 1]. Acima de 1/2, usa a identidade
+/// asin(s) = pi/2 - 2 asin(sqrt((1-s)/2)), cujo argumento eh <= 1/2.
+__attribute__((target("avx2,fma"))) inline __m256d asinAVX2(__m256d s) {
+  const __m256d meio = _mm256_set1_pd(0.5);
+  const __m256d grande = _mm256_cmp_pd(s, meio, _CMP_GT_OQ);
+  const __m256d um_menos_s = _mm256_sub_pd(_mm256_set1_pd(1.0), s);
+  const __m256d t = _mm256_sqrt_pd(_mm256_mul_pd(um_menos_s, meio));
+  const __m256d a = _mm256_blendv_pd(s, t, grande);
+
+  const __m256d a2 = _mm256_mul_pd(a, a);
+  __m256d p = _mm256_set1_pd(COEF_ASIN[TERMOS_ASIN - 1]);
+  for (size_t k = TERMOS_ASIN - 1; k-- > 0;)
+    p = _mm256_fmadd_pd(p, a2, _mm256_set1_pd(COEF_ASIN[k]));
+  const __m256d r = _mm256_mul_pd(a, p);
+
+  const __m256d complemento = _mm256_fnmadd_pd(
+      _mm256_set1_pd(2.0), r, _mm256_set1_pd(1.57079632679489661923));
+  return _mm256_blendv_pd(r, complemento, grande);
+}
+
+/// Calculo em lote com AVX2, 4 pontos de cada vez
+__attribute__((target("avx2,fma"))) void
+loteAVX2(const TrigPontos &T, Indice alvo, size_t n, double *saida) {
+  const __m256d xa = _mm256_set1_pd(T.x[alvo]);
+  const __m256d ya = _mm256_set1_pd(T.y[alvo]);
+  const __m256d za = _mm256_set1_pd(T.sen_lat[alvo]);
+  const __m256d meio = _mm256_set1_pd(0.5);
+  const __m256d um = _mm256_set1_pd(1.0);
+  const __m256d diametro = _mm256_set1_pd(2.0 * RAIO_TERRA);
+
+  size_t k = 0;
+  for (; k + 4 <= n; k += 4) {
+    const __m256d px = _mm256_loadu_pd(T.x.data() + k);
+    const __m256d py = _mm256_loadu_pd(T.y.data() + k);
+    const __m256d pz = _mm256_loadu_pd(T.sen_lat.data() + k);
+    const __m256d dx = _mm256_sub_pd(px, xa);
+    const __m256d dy = _mm256_sub_pd(py, ya);
+    const __m256d dz = _mm256_sub_pd(pz, za);
+    __m256d c2 = _mm256_mul_pd(dx, dx);
+    c2 = _mm256_fmadd_pd(dy, dy, c2);
+    c2 = _mm256_fmadd_pd(dz, dz, c2);
+    const __m256d meia_corda =
+        _mm256_min_pd(um, _mm256_mul_pd(meio, _mm256_sqrt_pd(c2)));
+    _mm256_storeu_pd(saida + k, _mm256_mul_pd(diametro, asinAVX2(meia_corda)));
+  }
+
+  // Pontos restantes (menos de 4)
+  for (; k < n; ++k)
+    saida[k] = distanciaCorda(T, alvo, Indice(k));
+}
+
+/// Testa se o processador executa instrucoes AVX2 e FMA
+bool temAVX2() {
+  static const bool tem =
+      __builtin_cpu_supports("avx2") && __builtin_cpu_supports("fma");
+  return tem;
+}
+
+#endif // HAVERSINE_AVX2
+
+} // namespace
+
+/// Distancias em linha reta do ponto alvo ateh os pontos 0..n-1, usando
+/// AVX2 se o processador permitir
+void TrigPontos::haversineLote(Indice alvo, size_t n, double *saida) const {
+#ifdef HAVERSINE_AVX2
+  if (temAVX2()) {
+    loteAVX2(*this, alvo, n, saida);
+    return;
+  }
+#endif
+  haversineLoteEscalar(alvo, n, saida);
+}
+
+/// Versao de haversineLote sem AVX2
+void TrigPontos::haversineLoteEscalar(Indice alvo, size_t n,
+                                      double *saida) const {
+  for (size_t k = 0; k < n; ++k)
+    saida[k] = distanciaCorda(*this, alvo, Indice(k));
+}
+
+/// Testa se haversineLote usa AVX2 neste processador
+bool TrigPontos::loteVetorizado() {
+#ifdef HAVERSINE_AVX2
+  return temAVX2();
+#else
+  return false;
+#endif
+}
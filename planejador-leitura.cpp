@@ -0,0 +1,445 @@
+#include <algorithm>
+#include <charconv>
+#include <cmath>
+#include <cstdlib>
+#include <cstring>
+#include <fcntl.h>
+#include <iostream>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <thread>
+#include <unistd.h>
+
+#include "planejador.h"
+
+using namespace std;
+
+/* *************************
+ * CLASSE ARQUIVOMAPEADO *
+ ************************* */
+
+/// Abre e mapeia o arquivo. Retorna false se nao conseguir abrir.
+/// O parametro sequencial indica se o conteudo serah lido do inicio ao fim
+/// (como um arquivo texto) ou consultado em ordem qualquer.
+bool ArquivoMapeado::abrir(const string &nome, bool sequencial) {
+  fechar();
+
+  int fd = ::open(nome.c_str(), O_RDONLY);
+  if (fd < 0)
+    return false;
+
+  // Arquivos regulares sao mapeados diretamente na memoria
+  struct stat info;
+  if (fstat(fd, &info) == 0 && S_ISREG(info.st_mode) && info.st_size > 0) {
+    void *p = mmap(nullptr, size_t(info.st_size), PROT_READ, MAP_PRIVATE, fd,
+                   0);
+    if (p != MAP_FAILED) {
+      madvise(p, size_t(info.st_size),
+              sequencial ? MADV_SEQUENTIAL : MADV_WILLNEED);
+      mapeamento = p;
+      dados = static_cast<const char *>(p);
+      tamanho = size_t(info.st_size);
+      ::close(fd);
+      return true;
+    }
+  }
+
+  // Arquivos que nao podem ser mapeados (vazios, pipes...) sao copiados.
+  // Um erro de leitura equivale ao fim do arquivo, como em um ifstream.
+  char buf[1 << 16];
+  ssize_t n;
+  while ((n = ::read(fd, buf, sizeof(buf))) > 0)
+    copia.append(buf, size_t(n));
+  ::close(fd);
+  dados = copia.data();
+  tamanho = copia.size();
+  return true;
+}
+
+/// Desfaz o mapeamento
+void ArquivoMapeado::fechar() {
+  if (mapeamento != nullptr)
+    munmap(mapeamento, tamanho);
+  mapeamento = nullptr;
+  copia.clear();
+  dados = nullptr;
+  tamanho = 0;
+}
+
+/* *************************
+ * LEITURA DOS ARQUIVOS  *
+ ************************* */
+
+namespace {
+
+/// Cursor sobre o conteudo de um arquivo de texto, que reproduz a leitura
+/// formatada de um istream (getline, operator>>, ignore e ws) sem copiar
+/// os dados. Os campos lidos apontam para o proprio conteudo do arquivo.
+class Cursor {
+public:
+  const char *p;   // Proximo caractere a ser lido
+  const char *fim; // Fim do conteudo
+
+  Cursor(const char *inicio, const char *final) : p(inicio), fim(final) {}
+
+  /// Testa se chegou ao fim do conteudo
+  bool eof() const { return p == fim; }
+
+  /// Como getline(arq, S, delim): falha se jah estiver no fim do conteudo
+  bool campo(string_view &S, char delim) {
+    if (p == fim)
+      return false;
+    const char *d = static_cast<const char *>(memchr(p, delim, fim - p));
+    if (d == nullptr)
+      d = fim;
+    S = string_view(p, d - p);
+    p = (d == fim) ? fim : d + 1;
+    return true;
+  }
+
+  /// Como arq >> ws
+  void espacos() {
+    while (p != fim && (*p == ' ' || (*p >= '\t' && *p <= '\r')))
+      ++p;
+  }
+
+  /// Como arq.ignore(1)
+  void ignorar() {
+    if (p != fim)
+      ++p;
+  }
+
+  /// Como arq >> x: pula os espacos, consome o maior prefixo com a forma de
+  /// um numero real e o converte. Falha se o prefixo nao for um numero
+  /// completo ou se o valor estourar a faixa de double.
+  bool numero(double &x) {
+    espacos();
+    const char *inicio = p;
+    bool mantissa = false, ponto = false, expoente = false;
+    if (p != fim && (*p == '+' || *p == '-'))
+      ++p;
+    while (p != fim) {
+      char c = *p;
+      if (c >= '0' && c <= '9') {
+        mantissa = true;
+      } else if (c == '.' && !ponto && !expoente) {
+        ponto = true;
+      } else if ((c == 'e' || c == 'E') && mantissa && !expoente) {
+        expoente = true;
+        if (p + 1 != fim && (p[1] == '+' || p[1] == '-'))
+          ++p;
+      } else {
+        break;
+      }
+      ++p;
+    }
+
+    // from_chars nao aceita o sinal '+'
+    const char *a = (inicio != p && *inicio == '+') ? inicio + 1 : inicio;
+    from_chars_result r = from_chars(a, p, x);
+    if (r.ec == errc::result_out_of_range && r.ptr == p) {
+      // Estouro (falha) ou valor muito proximo de zero (aceito)
+      x = strtod(string(inicio, p).c_str(), nullptr);
+      return std::abs(x) != HUGE_VAL;
+    }
+    return r.ec == errc() && r.ptr == p;
+  }
+};
+
+/// Um ponto lido, com os textos apontando para o conteudo do arquivo
+struct PontoLido {
+  string_view id;
+  string_view nome;
+  double latitude;
+  double longitude;
+};
+
+/// Uma rota lida, com os textos apontando para o conteudo do arquivo
+struct RotaLida {
+  string_view id;
+  string_view nome;
+  Indice ext[2];
+  double comprimento;
+};
+
+/// Leh um ponto. Retorna 0 ou o codigo de erro da leitura.
+int lerPonto(Cursor &C, const TabelaIds &, PontoLido &P) {
+  // Leh a ID
+  if (!C.campo(P.id, ';'))
+    return 3;
+  if (!IDPonto::valid(P.id))
+    return 4;
+  // Leh o nome
+  if (!C.campo(P.nome, ';') || P.nome.size() < 2)
+    return 5;
+  // Leh a latitude
+  if (!C.numero(P.latitude))
+    return 6;
+  C.ignorar();
+  // Leh a longitude
+  if (!C.numero(P.longitude))
+    return 7;
+  C.espacos();
+  return 0;
+}
+
+/// Leh uma rota, verificando se as extremidades sao pontos em id_pontos.
+/// Retorna 0 ou o codigo de erro da leitura.
+int lerRota(Cursor &C, const TabelaIds &id_pontos, RotaLida &R) {
+  string_view S;
+  // Leh a ID
+  if (!C.campo(R.id, ';'))
+    return 3;
+  if (!IDRota::valid(R.id))
+    return 4;
+  // Leh o nome
+  if (!C.campo(R.nome, ';') || R.nome.size() < 2)
+    return 4;
+  // Leh a id da extremidade[0] e verifica se corresponde a um ponto lido
+  if (!C.campo(S, ';'))
+    return 6;
+  if (!IDPonto::valid(S))
+    return 7;
+  R.ext[0] = id_pontos.find(S);
+  if (R.ext[0] == INDICE_INVALIDO)
+    return 8;
+  // Leh a id da extremidade[1] e verifica se corresponde a um ponto lido
+  if (!C.campo(S, ';'))
+    return 9;
+  if (!IDPonto::valid(S))
+    return 10;
+  R.ext[1] = id_pontos.find(S);
+  if (R.ext[1] == INDICE_INVALIDO)
+    return 8;
+  // Leh o comprimento
+  if (!C.numero(R.comprimento))
+    return 12;
+  C.espacos();
+  return 0;
+}
+
+/// Trecho do conteudo de um arquivo lido por uma thread
+template <class Registro> struct Bloco {
+  const char *inicio;     // Inicio do 1o registro do bloco
+  const char *limite;     // Registros que comecam a partir daqui sao do
+                          // proximo bloco
+  const char *fim_lido;   // Onde a leitura do bloco terminou
+  vector<Registro> regs;  // Registros lidos
+  int erro;               // Codigo do erro que interrompeu a leitura (ou 0)
+};
+
+/// Leh os registros de um bloco. O 1o bloco do arquivo sempre tem ao menos
+/// um registro, como no laco do-while da leitura com istream.
+template <class Registro, class LerUm>
+void lerBloco(Bloco<Registro> &B, const char *fim, bool primeiro,
+              const TabelaIds &id_pontos, LerUm lerUm) {
+  Cursor C(B.inicio, fim);
+  Registro R;
+  B.erro = 0;
+  while (primeiro || (!C.eof() && C.p < B.limite)) {
+    primeiro = false;
+    B.erro = lerUm(C, id_pontos, R);
+    if (B.erro != 0)
+      break;
+    B.regs.push_back(R);
+  }
+  B.fim_lido = C.p;
+}
+
+/// Leh os registros do conteudo [inicio, fim), que comeca logo apos o
+/// cabecalho, dividindo-o em ateh num_threads blocos lidos em paralelo.
+/// Retorna em regs os registros lidos antes do 1o erro, na ordem do arquivo,
+/// e o codigo desse erro (0 se nao houve erro).
+///
+/// Os blocos sao divididos em quebras de linha. Como um registro mal formado
+/// pode ocupar varias linhas, cada bloco soh eh aceito se a leitura do bloco
+/// anterior terminou exatamente no seu inicio; caso contrario, o restante do
+/// arquivo eh relido sequencialmente a partir de onde a leitura parou.
+template <class Registro, class LerUm>
+int lerRegistros(const char *inicio, const char *fim, unsigned num_threads,
+                 const TabelaIds &id_pontos, LerUm lerUm,
+                 vector<Registro> &regs) {
+  // Blocos de pelo menos 1 MiB, para compensar o custo das threads
+  static const size_t MIN_BLOCO = size_t(1) << 20;
+  size_t tamanho = size_t(fim - inicio);
+  size_t num_blocos = max<size_t>(
+      1, min<size_t>(num_threads, tamanho / MIN_BLOCO));
+
+  vector<Bloco<Registro>> blocos(num_blocos);
+  blocos[0].inicio = inicio;
+  for (size_t k = 1; k < num_blocos; ++k) {
+    // Cada bloco comeca no inicio de uma linha, apos os espacos
+    Cursor C(inicio + k * (tamanho / num_blocos), fim);
+    string_view S;
+    C.campo(S, '\n');
+    C.espacos();
+    blocos[k].inicio = max(C.p, blocos[k - 1].inicio);
+  }
+  for (size_t k = 0; k < num_blocos; ++k)
+    blocos[k].limite = (k + 1 < num_blocos) ? blocos[k + 1].inicio : fim;
+
+  // Leh os blocos, o 1o na propria thread
+  vector<thread> threads;
+  for (size_t k = 1; k < num_blocos; ++k) {
+    threads.emplace_back(lerBloco<Registro, LerUm>, ref(blocos[k]), fim,
+                         false, cref(id_pontos), lerUm);
+  }
+  lerBloco(blocos[0], fim, true, id_pontos, lerUm);
+  for (thread &t : threads)
+    t.join();
+
+  // Junta os blocos, na ordem do arquivo
+  size_t total = 0;
+  for (const auto &B : blocos)
+    total += B.regs.size();
+  regs.clear();
+  regs.reserve(total);
+  for (size_t k = 0; k < num_blocos; ++k) {
+    Bloco<Registro> &B = blocos[k];
+    regs.insert(regs.end(), B.regs.begin(), B.regs.end());
+    if (B.erro != 0)
+      return B.erro;
+    if (k + 1 < num_blocos && B.fim_lido != blocos[k + 1].inicio) {
+      // O proximo bloco nao comeca em um registro: rele o restante
+      Bloco<Registro> resto;
+      resto.inicio = B.fim_lido;
+      resto.limite = fim;
+      lerBloco(resto, fim, false, id_pontos, lerUm);
+      regs.insert(regs.end(), resto.regs.begin(), resto.regs.end());
+      return resto.erro;
+    }
+  }
+  return 0;
+}
+
+/// Leh a 1a linha do arquivo e verifica se eh o cabecalho esperado.
+/// Retorna o inicio do conteudo apos o cabecalho ou nullptr.
+const char *lerCabecalho(const ArquivoMapeado &arq, string_view esperado) {
+  Cursor C(arq.data(), arq.data() + arq.size());
+  string_view S;
+  if (!C.campo(S, '\n') || S != esperado)
+    return nullptr;
+  return C.p;
+}
+
+} // namespace
+
+/// Leh um mapa dos arquivos arq_pontos e arq_rotas.
+/// Caso nao consiga ler dos arquivos, deixa o mapa inalterado e retorna false.
+/// Retorna true em caso de leitura bem sucedida
+bool Planejador::ler(const std::string &arq_pontos,
+                     const std::string &arq_rotas, unsigned num_threads) {
+  // Mapa temporario para armazenamento dos dados lidos
+  Mapa M;
+  // Os arquivos sao mapeados na memoria e os campos lidos apontam para eles
+  ArquivoMapeado arq;
+  const char *inicio;
+
+  if (num_threads == 0)
+    num_threads = max(1u, thread::hardware_concurrency());
+
+  // Leh os pontos do arquivo
+  try {
+    // Abre o arquivo de pontos
+    if (!arq.abrir(arq_pontos))
+      throw 1;
+
+    // Leh o cabecalho
+    inicio = lerCabecalho(arq, "ID;Nome;Latitude;Longitude");
+    if (inicio == nullptr)
+      throw 2;
+
+    // Leh os pontos
+    vector<PontoLido> lidos;
+    int erro = lerRegistros(inicio, arq.data() + arq.size(), num_threads,
+                            M.id_pontos, lerPonto, lidos);
+
+    // Inclui os pontos lidos no mapa, antes de acusar um eventual erro de
+    // leitura, pois uma ID repetida em um ponto anterior tem precedencia
+    size_t tam_ids = 0, tam_nomes = 0;
+    for (const PontoLido &P : lidos) {
+      tam_ids += P.id.size();
+      tam_nomes += P.nome.size();
+    }
+    M.id_pontos.reserve(lidos.size(), tam_ids);
+    M.nome_pontos.reserve(lidos.size(), tam_nomes);
+    M.latitude.reserve(lidos.size());
+    M.longitude.reserve(lidos.size());
+    for (const PontoLido &P : lidos) {
+      // Verifica se jah existe ponto com a mesma ID nos pontos lidos.
+      // Caso nao exista, a ID eh incluida; caso exista, throw 8
+      if (!M.id_pontos.insert(P.id).second)
+        throw 8;
+      M.nome_pontos.push_back(P.nome);
+      M.latitude.push_back(P.latitude);
+      M.longitude.push_back(P.longitude);
+    }
+    if (erro != 0)
+      throw erro;
+  } catch (int i) {
+    cerr << "Erro " << i << " na leitura do arquivo de pontos " << arq_pontos
+         << endl;
+    return false;
+  }
+
+  // Leh as rotas do arquivo
+  try {
+    // Abre o arquivo de rotas
+    if (!arq.abrir(arq_rotas))
+      throw 1;
+
+    // Leh o cabecalho
+    inicio = lerCabecalho(arq, "ID;Nome;Extremidade 1;Extremidade 2;"
+                               "Comprimento");
+    if (inicio == nullptr)
+      throw 2;
+
+    // Leh as rotas (a busca das extremidades em M.id_pontos eh somente
+    // leitura e pode ser feita em paralelo)
+    vector<RotaLida> lidas;
+    int erro = lerRegistros(inicio, arq.data() + arq.size(), num_threads,
+                            M.id_pontos, lerRota, lidas);
+
+    // Inclui as rotas lidas no mapa
+    size_t tam_ids = 0, tam_nomes = 0;
+    for (const RotaLida &R : lidas) {
+      tam_ids += R.id.size();
+      tam_nomes += R.nome.size();
+    }
+    M.id_rotas.reserve(lidas.size(), tam_ids);
+    M.nome_rotas.reserve(lidas.size(), tam_nomes);
+    M.extremidades.reserve(2 * lidas.size());
+    M.comprimento.reserve(lidas.size());
+    for (const RotaLida &R : lidas) {
+      // Verifica se jah existe rota com a mesma ID nas rotas lidas.
+      // Caso nao exista, a ID eh incluida; caso exista, throw 13
+      if (!M.id_rotas.insert(R.id).second)
+        throw 13;
+      M.nome_rotas.push_back(R.nome);
+      M.extremidades.push_back(R.ext[0]);
+      M.extremidades.push_back(R.ext[1]);
+      M.comprimento.push_back(R.comprimento);
+    }
+    if (erro != 0)
+      throw erro;
+  } catch (int i) {
+    cerr << "Erro " << i << " na leitura do arquivo de rotas " << arq_rotas
+         << endl;
+    return false;
+  }
+
+  // Soh chega aqui se nao entrou no catch, jah que ele termina com return.
+  // Compila as rotas incidentes a cada ponto e as coordenadas usadas pela
+  // haversine e move o mapa lido para o planejador.
+  M.adj.construir(M.numPontos(), M.extremidades, M.comprimento);
+  M.trig.calcular(M.latitude, M.longitude);
+  M.espacial.construir(M.trig);
+  {
+    PoolThreads pool(num_threads);
+    M.calcularComponentes(pool);
+  }
+  mapa = std::move(M);
+  cache.clear();
+
+  return true;
+}
@@ -1,10 +1,99 @@
 #include "planejador.h"
 #include <chrono>
+#include <cstdlib>
+#include <fstream>
 #include <iostream>
+#include <memory>
 
 using namespace std;
 
-int main() {
+/// Modo nao interativo: calcula os caminhos das consultas de um arquivo (ou
+/// da entrada padrao) e escreve um resultado JSON por linha na saida padrao.
+/// Opcoes: --batch ARQ ('-' para a entrada padrao), --mapa P R,
+/// --binario B, --modo uni|bi|ch, --threads N, --bloco N,
+/// --reordenar 0|1 (ver Planejador::reordenarMapa)
+int processarLote(int argc, char *argv[]) {
+  ios::sync_with_stdio(false);
+  string arq_consultas, arq_pontos = "pontos.txt", arq_rotas = "rotas.txt";
+  string arq_binario, modo = "uni";
+  unsigned num_threads = 0;
+  bool reordenar = false;
+  OpcoesFluxo O;
+  bool ok = true;
+  for (int a = 1; a < argc && ok; ++a) {
+    string opcao = argv[a];
+    // Todas as opcoes tem ao menos um valor
+    if (a + 1 >= argc)
+      ok = false;
+    else if (opcao == "--batch")
+      arq_consultas = argv[++a];
+    else if (opcao == "--mapa" && a + 2 < argc) {
+      arq_pontos = argv[++a];
+      arq_rotas = argv[++a];
+    } else if (opcao == "--binario")
+      arq_binario = argv[++a];
+    else if (opcao == "--modo")
+      modo = argv[++a];
+    else if (opcao == "--threads")
+      num_threads = unsigned(strtoul(argv[++a], nullptr, 10));
+    else if (opcao == "--bloco")
+      O.tam_bloco = strtoul(argv[++a], nullptr, 10);
+    else if (opcao == "--reordenar")
+      reordenar = strtoul(argv[++a], nullptr, 10) != 0;
+    else
+      ok = false;
+  }
+  if (modo == "uni")
+    O.modo = ModoBusca::UNIDIRECIONAL;
+  else if (modo == "bi")
+    O.modo = ModoBusca::BIDIRECIONAL;
+  else if (modo == "ch")
+    O.modo = ModoBusca::HIERARQUIA;
+  else
+    ok = false;
+  if (!ok || arq_consultas.empty() || O.tam_bloco == 0) {
+    cerr << "Uso: " << argv[0]
+         << " --batch ARQ|- [--mapa P R | --binario B] [--modo uni|bi|ch]"
+            " [--threads N] [--bloco N] [--reordenar 0|1]\n";
+    return 1;
+  }
+
+  Planejador G;
+  if (!(arq_binario.empty() ? G.ler(arq_pontos, arq_rotas)
+                            : G.lerBinario(arq_binario))) {
+    cerr << "Erro na leitura dos arquivos do mapa\n";
+    return -1;
+  }
+  if (reordenar)
+    G.reordenarMapa();
+
+  ifstream arq;
+  if (arq_consultas != "-") {
+    arq.open(arq_consultas);
+    if (!arq.is_open()) {
+      cerr << "Erro na abertura do arquivo de consultas " << arq_consultas
+           << endl;
+      return -1;
+    }
+  }
+  istream &entrada = arq_consultas == "-" ? cin : arq;
+
+  // Pool proprio, se o numero de threads foi dado
+  unique_ptr<PoolThreads> pool;
+  if (num_threads > 0)
+    pool = make_unique<PoolThreads>(num_threads);
+  PoolThreads &P = pool ? *pool : PoolThreads::global();
+
+  if (O.modo == ModoBusca::HIERARQUIA && !G.temHierarquia())
+    G.calcularHierarquia(P);
+  G.processarFluxo(entrada, cout, O, P);
+  return 0;
+}
+
+int main(int argc, char *argv[]) {
+  if (argc > 1)
+    return processarLote(argc, argv);
+
   // O planejador de caminhos
   Planejador G;
   // O caminho a ser calculado:
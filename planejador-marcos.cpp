@@ -0,0 +1,201 @@
+#include <algorithm>
+#include <cmath>
+#include <random>
+#include <vector>
+
+#include "planejador.h"
+
+using namespace std;
+
+/* *************************
+ * HEURISTICA ALT        *
+ ************************* */
+
+// ALT = A*, Landmarks (marcos) e desigualdade Triangular.
+// Para um marco k e pontos v e t quaisquer, d(k,t) <= d(k,v) + d(v,t) e
+// d(k,v) <= d(k,t) + d(t,v); logo d(v,t) >= |d(k,t) - d(k,v)|.
+// Com as distancias de todos os pontos ateh alguns marcos bem escolhidos,
+// esse limite inferior eh muito mais proximo da distancia real do que a
+// distancia em linha reta, e a busca expande muito menos pontos.
+// Como as rotas sao de mao dupla, a distancia "ateh" o marco eh igual a
+// distancia "a partir" do marco, e uma tabela por marco eh suficiente.
+
+namespace {
+
+/// Algoritmo de Dijkstra a partir do ponto orig: calcula a distancia pelas
+/// rotas de orig ateh todos os pontos (HUGE_VAL se inalcancavel).
+/// Se ordem nao for nullptr, preenche ordem com os pontos alcancados, na
+/// ordem em que foram fechados, e pai com o ponto anterior a cada um deles
+/// no caminho a partir de orig (arvore de caminhos mais curtos).
+void dijkstra(const Mapa &M, Indice orig, vector<double> &dist,
+              HeapIndexado &aberto, vector<Indice> *ordem,
+              vector<Indice> *pai) {
+  const Adjacencia &adj = M.adj;
+  const Indice n = M.numPontos();
+
+  dist.assign(n, HUGE_VAL);
+  aberto.reset(n);
+  if (ordem != nullptr) {
+    ordem->clear();
+    pai->assign(n, INDICE_INVALIDO);
+  }
+
+  dist[orig] = 0.0;
+  aberto.push(orig, 0.0);
+  while (!aberto.empty()) {
+    Indice atual = aberto.pop();
+    if (ordem != nullptr)
+      ordem->push_back(atual);
+
+    for (Indice e = adj.inicio[atual]; e < adj.fim[atual]; ++e) {
+      Indice suc = adj.vizinho[e];
+      double d = dist[atual] + adj.comprimento[e];
+      // Pontos jah fechados nunca melhoram (comprimentos nao negativos)
+      if (!(d < dist[suc]))
+        continue;
+      if (aberto.contem(suc))
+        aberto.diminuir(suc, d);
+      else
+        aberto.push(suc, d);
+      dist[suc] = d;
+      if (pai != nullptr)
+        (*pai)[suc] = atual;
+    }
+  }
+}
+
+/// Ponto ainda nao escolhido como marco de maior valor em v
+Indice maiorValor(const vector<double> &v, const vector<bool> &eh_marco) {
+  Indice melhor = INDICE_INVALIDO;
+  for (Indice i = 0; i < v.size(); ++i)
+    if (!eh_marco[i] && (melhor == INDICE_INVALIDO || v[i] > v[melhor]))
+      melhor = i;
+  return melhor;
+}
+
+} // namespace
+
+/// Escolhe os marcos e calcula as suas tabelas de distancias.
+///
+/// DISTANTES: o 1o marco eh o ponto mais distante do ponto 0, e cada marco
+/// seguinte eh o ponto mais distante (pelas rotas) dos marcos jah
+/// escolhidos. Pontos que nao alcancam nenhum marco contam como infinitamente
+/// distantes, de modo que cada componente do mapa acaba recebendo marcos.
+///
+/// EVITAR (Goldberg e Harrelson, "avoid"): a partir de um ponto raiz
+/// sorteado, calcula a arvore de caminhos mais curtos e o erro da
+/// heuristica atual em cada ponto, d(raiz,v) - h(raiz,v). O tamanho de um
+/// ponto eh a soma dos erros da sua subarvore (0 se ela contem um marco).
+/// O novo marco eh uma folha alcancada descendo, a partir do ponto de maior
+/// tamanho, sempre para o filho de maior tamanho: fica na regiao em que a
+/// heuristica mais erra. Se todos os tamanhos forem 0, usa DISTANTES.
+void Planejador::calcularMarcos(unsigned num_marcos, SelecaoMarcos selecao) {
+  const Indice n = mapa.numPontos();
+  const size_t K = min<size_t>(num_marcos, n);
+
+  // Os marcos antigos nao participam da escolha dos novos. Os NA e NF
+  // guardados no cache foram obtidos com a heuristica antiga.
+  mapa.marcos.clear();
+  mapa.dist_marcos.clear();
+  cache.clear();
+  if (K == 0)
+    return;
+
+  Arranjo<Indice> marcos;
+  Arranjo<float> dist_marcos;
+  marcos.reserve(K);
+  dist_marcos.resize(size_t(n) * K);
+  float *D = dist_marcos.mutavel();
+
+  vector<double> dist;                  // Resultado de cada Dijkstra
+  vector<double> dist_min(n, HUGE_VAL); // Distancia ao marco mais proximo
+  vector<bool> eh_marco(n, false);
+  HeapIndexado aberto;
+
+  // Inclui o ponto m como marco: calcula a sua tabela de distancias
+  auto incluir = [&](Indice m) {
+    const size_t k = marcos.size();
+    dijkstra(mapa, m, dist, aberto, nullptr, nullptr);
+    for (Indice v = 0; v < n; ++v) {
+      D[size_t(v) * K + k] = float(dist[v]);
+      dist_min[v] = min(dist_min[v], dist[v]);
+    }
+    marcos.push_back(m);
+    eh_marco[m] = true;
+  };
+
+  // Dados da escolha EVITAR
+  mt19937 sorteio(1);
+  vector<Indice> ordem, pai, melhor_filho;
+  vector<double> tam, hav;
+  vector<bool> tem_marco;
+
+  // Escolhe um marco pelo criterio EVITAR (INDICE_INVALIDO se nao houver)
+  auto evitar = [&]() -> Indice {
+    const Indice raiz = Indice(sorteio() % n);
+    dijkstra(mapa, raiz, dist, aberto, &ordem, &pai);
+
+    // Erro da heuristica formada pelos marcos jah escolhidos
+    const size_t k_atual = marcos.size();
+    tam.resize(n);
+    melhor_filho.resize(n);
+    tem_marco.resize(n);
+    const float *d_raiz = D + size_t(raiz) * K;
+    hav.resize(n);
+    mapa.trig.haversineLote(raiz, n, hav.data());
+    for (Indice v : ordem) {
+      const float *d_v = D + size_t(v) * K;
+      double h = hav[v];
+      for (size_t k = 0; k < k_atual; ++k)
+        h = max<double>(h, fabs(d_raiz[k] - d_v[k]));
+      tam[v] = max(0.0, dist[v] - h);
+      melhor_filho[v] = INDICE_INVALIDO;
+      tem_marco[v] = eh_marco[v];
+    }
+
+    // Tamanhos das subarvores: os filhos sao fechados depois dos pais
+    for (size_t i = ordem.size(); i-- > 0;) {
+      Indice v = ordem[i], p = pai[v];
+      if (tem_marco[v])
+        tam[v] = 0.0;
+      if (p == INDICE_INVALIDO)
+        continue;
+      if (tem_marco[v]) {
+        tem_marco[p] = true;
+      } else {
+        tam[p] += tam[v];
+        Indice &f = melhor_filho[p];
+        if (f == INDICE_INVALIDO || tam[v] > tam[f])
+          f = v;
+      }
+    }
+
+    // Desce do ponto de maior tamanho ateh uma folha
+    Indice u = INDICE_INVALIDO;
+    for (Indice v : ordem)
+      if (u == INDICE_INVALIDO || tam[v] > tam[u])
+        u = v;
+    if (u == INDICE_INVALIDO || !(tam[u] > 0.0))
+      return INDICE_INVALIDO;
+    while (melhor_filho[u] != INDICE_INVALIDO)
+      u = melhor_filho[u];
+    return u;
+  };
+
+  // 1o marco: o ponto mais distante do ponto 0
+  dijkstra(mapa, 0, dist, aberto, nullptr, nullptr);
+  incluir(maiorValor(dist, eh_marco));
+
+  while (marcos.size() < K) {
+    Indice m = INDICE_INVALIDO;
+    if (selecao == SelecaoMarcos::EVITAR)
+      m = evitar();
+    if (m == INDICE_INVALIDO || eh_marco[m])
+      m = maiorValor(dist_min, eh_marco);
+    incluir(m);
+  }
+
+  mapa.marcos = std::move(marcos);
+  mapa.dist_marcos = std::move(dist_marcos);
+  mapa.selecao_marcos = selecao;
+}
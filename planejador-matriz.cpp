@@ -0,0 +1,126 @@
+#include <iostream>
+#include <vector>
+
+#include "planejador.h"
+
+using namespace std;
+
+/* *************************
+ * MATRIZ DE DISTANCIAS  *
+ ************************* */
+
+// Uma busca de Dijkstra (sem heuristica) a partir de uma origem se expande
+// em circulos e, ao fechar um ponto, jah conhece o seu caminho mais curto a
+// partir da origem. Uma unica busca por origem, que continua ateh fechar
+// todos os destinos, fornece uma linha inteira da matriz, sem repetir a
+// preparacao e a expansao das mesmas regioes do mapa a cada par.
+
+/// Algoritmo de Dijkstra a partir do ponto de indice orig, usando a area de
+/// trabalho E, que termina quando os num_alvos pontos com alvo[pt] == true
+/// estiverem fechados (ou quando nao houver mais pontos alcancaveis).
+void Planejador::buscaMultipla(Indice orig, const vector<bool> &alvo,
+                               Indice num_alvos, EspacoBusca &E) const {
+  const Adjacencia &adj = mapa.adj;
+  EspacoBusca::Direcao &D = E.ida;
+  D.preparar(mapa.numPontos());
+
+  D.g[orig] = 0.0;
+  D.aberto.push(orig, 0.0);
+
+  Indice restantes = num_alvos;
+  while (restantes > 0 && !D.aberto.empty()) {
+    Indice atual = D.aberto.pop();
+    D.fechar(atual);
+    if (alvo[atual] && --restantes == 0)
+      break;
+
+    for (Indice e = adj.inicio[atual]; e < adj.fim[atual]; ++e) {
+      Indice suc = adj.vizinho[e];
+      if (D.fechado(suc))
+        continue;
+
+      double g_suc = D.g[atual] + adj.comprimento[e];
+      if (D.aberto.contem(suc)) {
+        // Soh substitui o noh em aberto se o novo for melhor
+        if (!(g_suc < D.g[suc]))
+          continue;
+        D.aberto.diminuir(suc, g_suc);
+      } else {
+        D.aberto.push(suc, g_suc);
+      }
+      D.g[suc] = g_suc;
+      D.pai[suc] = adj.rota[e];
+    }
+  }
+}
+
+/// Calcula a matriz de distancias entre todas as origens e todos os
+/// destinos, com uma busca por origem. Cada thread do pool usa a sua
+/// propria area de trabalho e preenche as linhas das origens que processa.
+/// Ids inexistentes geram uma mensagem de erro (4 nas origens, 5 nos
+/// destinos) e deixam a linha ou coluna correspondente com -1.
+MatrizDistancias Planejador::calculaMatriz(const vector<IDPonto> &origens,
+                                           const vector<IDPonto> &destinos,
+                                           bool com_caminhos,
+                                           PoolThreads &pool) const {
+  MatrizDistancias M;
+  M.num_origens = origens.size();
+  M.num_destinos = destinos.size();
+  M.comprimento.assign(M.num_origens * M.num_destinos, -1.0);
+  if (com_caminhos)
+    M.caminho.resize(M.num_origens * M.num_destinos);
+
+  // Mapa vazio
+  if (empty()) {
+    cerr << "Erro 1 no calculo da matriz\n";
+    return M;
+  }
+
+  // Indice do ponto de cada id (INDICE_INVALIDO se nao existe)
+  auto indices = [this](const vector<IDPonto> &ids, int erro) {
+    vector<Indice> I(ids.size());
+    for (size_t k = 0; k < ids.size(); ++k) {
+      I[k] = mapa.id_pontos.find(ids[k].str());
+      if (I[k] == INDICE_INVALIDO)
+        cerr << "Erro " << erro << " no calculo da matriz\n";
+    }
+    return I;
+  };
+  const vector<Indice> orig = indices(origens, 4);
+  const vector<Indice> dest = indices(destinos, 5);
+
+  // Destinos distintos, contados por componente: a busca de uma origem
+  // termina quando fecha todos os da sua componente (os demais nao sao
+  // alcancaveis)
+  vector<bool> alvo(mapa.numPontos(), false);
+  vector<Indice> alvos_componente(mapa.num_componentes, 0);
+  for (Indice d : dest)
+    if (d != INDICE_INVALIDO && !alvo[d]) {
+      alvo[d] = true;
+      ++alvos_componente[mapa.componente[d]];
+    }
+
+  ReservaEspacos::Emprestimo espacos(reserva, pool.size());
+  pool.paraCada(orig.size(), [&](size_t i, unsigned t) {
+    if (orig[i] == INDICE_INVALIDO)
+      return;
+    const Indice num_alvos = alvos_componente[mapa.componente[orig[i]]];
+    if (num_alvos == 0)
+      return;
+    EspacoBusca &E = espacos[t];
+    buscaMultipla(orig[i], alvo, num_alvos, E);
+
+    const size_t linha = i * M.num_destinos;
+    for (size_t j = 0; j < dest.size(); ++j) {
+      // Destinos nao fechados nao sao alcancaveis a partir da origem
+      if (dest[j] == INDICE_INVALIDO || !E.ida.fechado(dest[j]))
+        continue;
+      M.comprimento[linha + j] = E.ida.g[dest[j]];
+      if (com_caminhos) {
+        refazerCaminho(E.ida.pai, orig[i], dest[j], E.caminho);
+        converterCaminho(E.caminho, M.caminho[linha + j]);
+      }
+    }
+  });
+  return M;
+}
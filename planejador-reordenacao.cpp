@@ -0,0 +1,157 @@
+#include <algorithm>
+#include <numeric>
+#include <utility>
+#include <vector>
+
+#include "planejador.h"
+
+using namespace std;
+
+/* *************************
+ * REORDENACAO DO MAPA   *
+ ************************* */
+
+// Os indices dos pontos seguem a ordem do arquivo, que em geral nao tem
+// relacao com a posicao dos pontos: os vizinhos de um ponto ficam espalhados
+// pelos vetores do mapa e da area de trabalho, e cada aresta relaxada pela
+// busca acessa linhas de cache diferentes. Numerados ao longo de uma curva
+// de Hilbert, pontos proximos no mapa tem indices proximos, e a regiao
+// explorada por uma busca ocupa poucos trechos contiguos da memoria.
+
+namespace {
+
+/// Bits de cada coordenada na curva de Hilbert (grade de 2^16 x 2^16)
+constexpr unsigned ORDEM_HILBERT = 16;
+
+/// Posicao da celula (x, y) ao longo da curva de Hilbert
+uint64_t posicaoHilbert(uint32_t x, uint32_t y) {
+  uint64_t d = 0;
+  for (uint32_t s = 1u << (ORDEM_HILBERT - 1); s > 0; s >>= 1) {
+    const uint32_t rx = (x & s) != 0, ry = (y & s) != 0;
+    d += uint64_t(s) * s * ((3 * rx) ^ ry);
+    // Gira o quadrante, para que a curva dentro dele tenha a orientacao
+    // padrao
+    if (ry == 0) {
+      if (rx == 1) {
+        x = s - 1 - (x & (s - 1));
+        y = s - 1 - (y & (s - 1));
+      }
+      swap(x, y);
+    }
+  }
+  return d;
+}
+
+} // namespace
+
+/// Renumera os pontos ao longo de uma curva de Hilbert e as rotas pela
+/// ordem dos seus pontos
+void Mapa::reordenar() {
+  const Indice n = numPontos(), m = numRotas();
+
+  // Celula de cada ponto em uma grade sobre o retangulo que contem o mapa
+  // (com a mesma escala nos dois eixos)
+  double lat_min = HUGE_VAL, lat_max = -HUGE_VAL;
+  double lon_min = HUGE_VAL, lon_max = -HUGE_VAL;
+  for (Indice i = 0; i < n; ++i) {
+    lat_min = min(lat_min, latitude[i]);
+    lat_max = max(lat_max, latitude[i]);
+    lon_min = min(lon_min, longitude[i]);
+    lon_max = max(lon_max, longitude[i]);
+  }
+  const double extensao = max(lat_max - lat_min, lon_max - lon_min);
+  const double escala =
+      extensao > 0.0 ? ((1u << ORDEM_HILBERT) - 1) / extensao : 0.0;
+  vector<uint64_t> chave(n);
+  for (Indice i = 0; i < n; ++i)
+    chave[i] = posicaoHilbert(uint32_t((longitude[i] - lon_min) * escala),
+                              uint32_t((latitude[i] - lat_min) * escala));
+
+  // Nova ordem dos pontos (em caso de empate, a original) e novo indice de
+  // cada ponto
+  vector<Indice> ordem(n), novo(n);
+  iota(ordem.begin(), ordem.end(), Indice(0));
+  stable_sort(ordem.begin(), ordem.end(),
+              [&chave](Indice a, Indice b) { return chave[a] < chave[b]; });
+  for (Indice k = 0; k < n; ++k)
+    novo[ordem[k]] = k;
+
+  // Nova ordem das rotas: pelo novo indice da extremidade de menor indice
+  vector<Indice> ordem_rotas(m);
+  iota(ordem_rotas.begin(), ordem_rotas.end(), Indice(0));
+  auto origem = [&](Indice r) {
+    return min(novo[extremidades[2 * r]], novo[extremidades[2 * r + 1]]);
+  };
+  stable_sort(ordem_rotas.begin(), ordem_rotas.end(),
+              [&origem](Indice a, Indice b) { return origem(a) < origem(b); });
+
+  // Monta o mapa renumerado; os identificadores nao mudam
+  Mapa M;
+  size_t tam_ids = 0, tam_nomes = 0;
+  for (Indice i = 0; i < n; ++i) {
+    tam_ids += id_pontos[i].size();
+    tam_nomes += nome_pontos[i].size();
+  }
+  M.id_pontos.reserve(n, tam_ids);
+  M.nome_pontos.reserve(n, tam_nomes);
+  M.latitude.reserve(n);
+  M.longitude.reserve(n);
+  for (Indice i : ordem) {
+    M.id_pontos.insert(id_pontos[i]);
+    M.nome_pontos.push_back(nome_pontos[i]);
+    M.latitude.push_back(latitude[i]);
+    M.longitude.push_back(longitude[i]);
+  }
+
+  tam_ids = tam_nomes = 0;
+  for (Indice r = 0; r < m; ++r) {
+    tam_ids += id_rotas[r].size();
+    tam_nomes += nome_rotas[r].size();
+  }
+  M.id_rotas.reserve(m, tam_ids);
+  M.nome_rotas.reserve(m, tam_nomes);
+  M.extremidades.reserve(2 * size_t(m));
+  M.comprimento.reserve(m);
+  for (Indice r : ordem_rotas) {
+    M.id_rotas.insert(id_rotas[r]);
+    M.nome_rotas.push_back(nome_rotas[r]);
+    M.extremidades.push_back(novo[extremidades[2 * r]]);
+    M.extremidades.push_back(novo[extremidades[2 * r + 1]]);
+    M.comprimento.push_back(comprimento[r]);
+  }
+
+  // Os marcos continuam os mesmos pontos, com as distancias reordenadas
+  const size_t K = marcos.size();
+  M.marcos.reserve(K);
+  M.selecao_marcos = selecao_marcos;
+  for (Indice k : marcos)
+    M.marcos.push_back(novo[k]);
+  M.dist_marcos.reserve(size_t(n) * K);
+  for (Indice i : ordem)
+    M.dist_marcos.append(dist_marcos.data() + size_t(i) * K, K);
+
+  // As componentes tambem: os rotulos nao dependem dos indices
+  M.componente.reserve(componente.size());
+  for (Indice i = 0; i < componente.size(); ++i)
+    M.componente.push_back(componente[ordem[i]]);
+  M.tam_componente = tam_componente;
+  M.num_componentes = num_componentes;
+
+  // Tabelas derivadas, refeitas na nova ordem (as Contraction Hierarchies
+  // sao descartadas)
+  M.adj.construir(n, M.extremidades, M.comprimento);
+  M.trig.calcular(M.latitude, M.longitude);
+  M.espacial.construir(M.trig);
+  *this = std::move(M);
+}
+
+/* *************************
+ * CLASSE PLANEJADOR     *
+ ************************* */
+
+/// Renumera os pontos e as rotas do mapa, para a localidade da memoria
+void Planejador::reordenarMapa() {
+  mapa.reordenar();
+  // O cache guarda caminhos em indices
+  cache.clear();
+}
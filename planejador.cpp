@@ -1,8 +1,7 @@
 #include <algorithm>
 #include <cmath>
-#include <fstream>
 #include <iostream>
-#include <list>
+#include <type_traits>
 #include <utility>
 
 #include "planejador.h"
@@ -41,13 +40,16 @@ double haversine(const Ponto &P1, const Ponto &P2) {
   if (P1.id == P2.id)
     return 0.0;
 
-  static const double MY_PI = 3.14159265358979323846;
-  static const double R_EARTH = 6371.0;
+  return haversine(P1.latitude, P1.longitude, P2.latitude, P2.longitude);
+}
+
+/// Distancia entre 2 coordenadas em graus (formula de haversine)
+double haversine(double lat1, double lon1, double lat2, double lon2) {
   // Conversao para radianos
-  double lat1 = MY_PI * P1.latitude / 180.0;
-  double lat2 = MY_PI * P2.latitude / 180.0;
-  double lon1 = MY_PI * P1.longitude / 180.0;
-  double lon2 = MY_PI * P2.longitude / 180.0;
+  lat1 = radianos(lat1);
+  lat2 = radianos(lat2);
+  lon1 = radianos(lon1);
+  lon2 = radianos(lon2);
 
   double cosseno =
       sin(lat1) * sin(lat2) + cos(lat1) * cos(lat2) * cos(lon1 - lon2);
@@ -58,7 +60,317 @@ double haversine(const Ponto &P1, const Ponto &P2) {
   if (cosseno < -1.0)
     cosseno = -1.0;
   // Distancia entre os pontos
-  return R_EARTH * acos(cosseno);
+  return RAIO_TERRA * acos(cosseno);
+}
+
+/* *************************
+ * CLASSE TABELATEXTOS   *
+ ************************* */
+
+/// Acrescenta um texto ao final, retornando seu indice
+Indice TabelaTextos::push_back(string_view S) {
+  faixas.push_back({uint32_t(caracteres.size()), uint32_t(S.size())});
+  caracteres.append(S.data(), S.size());
+  return size() - 1;
+}
+
+/// Reserva espaco para n textos com um total de c caracteres
+void TabelaTextos::reserve(size_t n, size_t c) {
+  faixas.reserve(n);
+  caracteres.reserve(c);
+}
+
+/// Torna a tabela vazia
+void TabelaTextos::clear() {
+  faixas.clear();
+  caracteres.clear();
+  descartados = 0;
+}
+
+/* *************************
+ * CLASSE TABELAIDS      *
+ ************************* */
+
+/// Funcao hash (FNV-1a) dos identificadores
+uint64_t TabelaIds::hash(string_view S) {
+  uint64_t h = 14695981039346656037ull;
+  for (unsigned char c : S) {
+    h ^= c;
+    h *= 1099511628211ull;
+  }
+  return h;
+}
+
+/// Reconstroi a tabela hash com o numero de posicoes dado (potencia de 2)
+void TabelaIds::rehash(size_t num_slots) {
+  slots.assign(num_slots, INDICE_INVALIDO);
+  Indice *s = slots.mutavel();
+  size_t mascara = num_slots - 1;
+  for (Indice i = 0; i < size(); ++i) {
+    size_t k = hash((*this)[i]) & mascara;
+    while (s[k] != INDICE_INVALIDO)
+      k = (k + 1) & mascara;
+    s[k] = i;
+  }
+}
+
+/// Indice do identificador S (INDICE_INVALIDO se inexistente)
+Indice TabelaIds::find(string_view S) const {
+  if (slots.empty())
+    return INDICE_INVALIDO;
+  size_t mascara = slots.size() - 1;
+  for (size_t k = hash(S) & mascara;; k = (k + 1) & mascara) {
+    Indice i = slots[k];
+    if (i == INDICE_INVALIDO || (*this)[i] == S)
+      return i;
+  }
+}
+
+/// Inclui o identificador S, caso ainda nao exista.
+/// Retorna o indice de S e se ele foi incluido (true) ou jah existia (false)
+pair<Indice, bool> TabelaIds::insert(string_view S) {
+  // Mantem a ocupacao da tabela hash em no maximo 50%
+  if (2 * (faixas.size() + 1) > slots.size())
+    rehash(max<size_t>(16, 2 * slots.size()));
+
+  size_t mascara = slots.size() - 1;
+  size_t k = hash(S) & mascara;
+  for (; slots[k] != INDICE_INVALIDO; k = (k + 1) & mascara) {
+    if ((*this)[slots[k]] == S)
+      return make_pair(slots[k], false);
+  }
+  Indice i = push_back(S);
+  slots.mutavel()[k] = i;
+  return make_pair(i, true);
+}
+
+/// Reserva espaco para n identificadores com um total de c caracteres
+void TabelaIds::reserve(size_t n, size_t c) {
+  TabelaTextos::reserve(n, c);
+  size_t num_slots = 16;
+  while (num_slots < 2 * n)
+    num_slots *= 2;
+  if (num_slots > slots.size())
+    rehash(num_slots);
+}
+
+/// Torna a tabela vazia
+void TabelaIds::clear() {
+  TabelaTextos::clear();
+  slots.clear();
+}
+
+/* *************************
+ * CLASSE ADJACENCIA     *
+ ************************* */
+
+/// Constroi a adjacencia de um mapa com num_pontos pontos, a partir das
+/// extremidades (2 indices de ponto por rota) e comprimentos das rotas.
+void Adjacencia::construir(Indice num_pontos,
+                           const Arranjo<Indice> &extremidades,
+                           const Arranjo<double> &comprimentos) {
+  clear();
+
+  // Conta o grau de cada ponto e calcula os deslocamentos
+  inicio.assign(size_t(num_pontos) + 1, 0);
+  Indice *ini = inicio.mutavel();
+  for (Indice p : extremidades)
+    ++ini[p + 1];
+  for (size_t i = 1; i < inicio.size(); ++i)
+    ini[i] += ini[i - 1];
+
+  // Preenche as arestas, uma a partir de cada extremidade da rota
+  vizinho.resize(extremidades.size());
+  rota.resize(extremidades.size());
+  comprimento.resize(extremidades.size());
+  Indice *viz = vizinho.mutavel();
+  Indice *rt = rota.mutavel();
+  double *compr = comprimento.mutavel();
+  fim.assign(num_pontos, 0);
+  Indice *f = fim.mutavel();
+  for (Indice i = 0; i < num_pontos; ++i)
+    f[i] = ini[i + 1];
+  vector<Indice> prox(inicio.begin(), inicio.end() - 1);
+  for (Indice r = 0; r < comprimentos.size(); ++r) {
+    for (int k = 0; k < 2; ++k) {
+      Indice e = prox[extremidades[2 * r + k]]++;
+      viz[e] = extremidades[2 * r + 1 - k];
+      rt[e] = r;
+      compr[e] = comprimentos[r];
+    }
+  }
+}
+
+/// Torna a adjacencia vazia
+void Adjacencia::clear() {
+  inicio.clear();
+  fim.clear();
+  vizinho.clear();
+  rota.clear();
+  comprimento.clear();
+}
+
+/* *************************
+ * CLASSE MAPA           *
+ ************************* */
+
+/// Ponto de indice i
+Ponto Mapa::ponto(Indice i) const {
+  Ponto P;
+  P.id.set(string(id_pontos[i]));
+  P.nome = nome_pontos[i];
+  P.latitude = latitude[i];
+  P.longitude = longitude[i];
+  return P;
+}
+
+/// Rota de indice i
+Rota Mapa::rota(Indice i) const {
+  Rota R;
+  R.id.set(string(id_rotas[i]));
+  R.nome = nome_rotas[i];
+  R.extremidade[0].set(string(id_pontos[extremidades[2 * i]]));
+  R.extremidade[1].set(string(id_pontos[extremidades[2 * i + 1]]));
+  R.comprimento = comprimento[i];
+  return R;
+}
+
+/// Torna o mapa vazio
+void Mapa::clear() {
+  id_pontos.clear();
+  nome_pontos.clear();
+  latitude.clear();
+  longitude.clear();
+  trig.clear();
+  espacial.clear();
+  id_rotas.clear();
+  nome_rotas.clear();
+  extremidades.clear();
+  comprimento.clear();
+  adj.clear();
+  marcos.clear();
+  dist_marcos.clear();
+  selecao_marcos = SelecaoMarcos::EVITAR;
+  componente.clear();
+  tam_componente.clear();
+  num_componentes = 0;
+  ch.clear();
+  arquivo.reset();
+}
+
+/* *************************
+ * CLASSE HEAPINDEXADO   *
+ ************************* */
+
+/// Esvazia o heap e o prepara para pontos de indices 0 a num_pontos-1.
+/// Os pontos que saem do heap jah tem a posicao invalidada: se o numero de
+/// pontos nao mudou, basta invalidar a dos pontos que ainda estao no heap.
+template <class Chave> void HeapIndexadoT<Chave>::reset(Indice num_pontos) {
+  if (posicao.size() != num_pontos) {
+    posicao.assign(num_pontos, INDICE_INVALIDO);
+  } else {
+    for (const Item &x : itens)
+      posicao[x.pt] = INDICE_INVALIDO;
+  }
+  itens.clear();
+  contador = 0;
+}
+
+/// Sobe o item da posicao i ateh restabelecer a ordem do heap
+template <class Chave> void HeapIndexadoT<Chave>::subir(size_t i) {
+  Item x = itens[i];
+  while (i > 0) {
+    size_t pai = (i - 1) / 2;
+    if (!menor(x, itens[pai]))
+      break;
+    itens[i] = itens[pai];
+    posicao[itens[i].pt] = Indice(i);
+    i = pai;
+  }
+  itens[i] = x;
+  posicao[x.pt] = Indice(i);
+}
+
+/// Desce o item da posicao i ateh restabelecer a ordem do heap
+template <class Chave> void HeapIndexadoT<Chave>::descer(size_t i) {
+  Item x = itens[i];
+  size_t n = itens.size();
+  while (2 * i + 1 < n) {
+    size_t filho = 2 * i + 1;
+    if (filho + 1 < n && menor(itens[filho + 1], itens[filho]))
+      ++filho;
+    if (!menor(itens[filho], x))
+      break;
+    itens[i] = itens[filho];
+    posicao[itens[i].pt] = Indice(i);
+    i = filho;
+  }
+  itens[i] = x;
+  posicao[x.pt] = Indice(i);
+}
+
+/// Inclui o ponto pt, que nao pode estar no heap
+template <class Chave>
+void HeapIndexadoT<Chave>::push(Indice pt, Chave chave) {
+  itens.push_back({chave, contador++, pt});
+  subir(itens.size() - 1);
+}
+
+/// Diminui a chave do ponto pt, que deve estar no heap
+template <class Chave>
+void HeapIndexadoT<Chave>::diminuir(Indice pt, Chave chave) {
+  Item &x = itens[posicao[pt]];
+  x.chave = chave;
+  x.ordem = contador++;
+  subir(posicao[pt]);
+}
+
+/// Remove e retorna o ponto de menor chave
+template <class Chave> Indice HeapIndexadoT<Chave>::pop() {
+  Indice pt = itens.front().pt;
+  posicao[pt] = INDICE_INVALIDO;
+  itens.front() = itens.back();
+  itens.pop_back();
+  if (!itens.empty())
+    descer(0);
+  return pt;
+}
+
+// Tipos de chave usados pelas buscas (ver as politicas de custo do A*)
+template class HeapIndexadoT<double>;
+template class HeapIndexadoT<float>;
+template class HeapIndexadoT<uint32_t>;
+
+/* *************************
+ * CLASSE RESERVAESPACOS *
+ ************************* */
+
+/// Empresta n areas de R (as que faltarem sao criadas)
+ReservaEspacos::Emprestimo::Emprestimo(ReservaEspacos &R, size_t n)
+    : reserva(R), espacos() {
+  espacos.reserve(n);
+  {
+    lock_guard<mutex> trava(reserva.m);
+    while (espacos.size() < n && !reserva.livres.empty()) {
+      espacos.push_back(std::move(reserva.livres.back()));
+      reserva.livres.pop_back();
+    }
+  }
+  while (espacos.size() < n)
+    espacos.push_back(make_unique<EspacoBusca>());
+}
+
+/// Devolve as areas a reserva
+ReservaEspacos::Emprestimo::~Emprestimo() {
+  lock_guard<mutex> trava(reserva.m);
+  for (unique_ptr<EspacoBusca> &E : espacos)
+    reserva.livres.push_back(std::move(E));
+}
+
+/// Descarta as areas guardadas
+void ReservaEspacos::clear() {
+  lock_guard<mutex> trava(m);
+  livres.clear();
 }
 
 /* *************************
@@ -67,231 +379,295 @@ double haversine(const Ponto &P1, const Ponto &P2) {
 
 /// Torna o mapa vazio
 void Planejador::clear() {
-  pontos.clear();
-  rotas.clear();
+  mapa.clear();
+  cache.clear();
+  reserva.clear();
 }
 
 /// Retorna um Ponto do mapa, passando a id como parametro.
 /// Se a id for inexistente, retorna um Ponto vazio.
 Ponto Planejador::getPonto(const IDPonto &Id) const {
-  auto it = find(pontos.begin(), pontos.end(), Id);
-  return (it != pontos.end()) ? *it : Ponto();
+  Indice i = mapa.id_pontos.find(Id.str());
+  return (i != INDICE_INVALIDO) ? mapa.ponto(i) : Ponto();
 }
 
 /// Retorna um Rota do mapa, passando a id como parametro.
 /// Se a id for inexistente, retorna um Rota vazio.
 Rota Planejador::getRota(const IDRota &Id) const {
-  auto it = find(rotas.begin(), rotas.end(), Id);
-  return (it != rotas.end()) ? *it : Rota();
+  Indice i = mapa.id_rotas.find(Id.str());
+  return (i != INDICE_INVALIDO) ? mapa.rota(i) : Rota();
 }
 
 /// Imprime os pontos do mapa no console
 void Planejador::imprimirPontos() const {
-  for (const auto &P : pontos) {
-    cout << P.id << '\t' << P.nome << " (" << P.latitude << ',' << P.longitude
-         << ")\n";
+  for (Indice i = 0; i < mapa.numPontos(); ++i) {
+    cout << mapa.id_pontos[i] << '\t' << mapa.nome_pontos[i] << " ("
+         << mapa.latitude[i] << ',' << mapa.longitude[i] << ")\n";
   }
 }
 
 /// Imprime as rotas do mapa no console
 void Planejador::imprimirRotas() const {
-  for (const auto &R : rotas) {
-    cout << R.id << '\t' << R.nome << '\t' << R.comprimento << "km"
-         << " [" << R.extremidade[0] << ',' << R.extremidade[1] << "]\n";
+  for (Indice i = 0; i < mapa.numRotas(); ++i) {
+    cout << mapa.id_rotas[i] << '\t' << mapa.nome_rotas[i] << '\t'
+         << mapa.comprimento[i] << "km"
+         << " [" << mapa.id_pontos[mapa.extremidades[2 * i]] << ','
+         << mapa.id_pontos[mapa.extremidades[2 * i + 1]] << "]\n";
   }
 }
 
-/// Leh um mapa dos arquivos arq_pontos e arq_rotas.
-/// Caso nao consiga ler dos arquivos, deixa o mapa inalterado e retorna false.
-/// Retorna true em caso de leitura bem sucedida
-bool Planejador::ler(const std::string &arq_pontos,
-                     const std::string &arq_rotas) {
-  // Listas temporarias para armazenamento dos dados lidos
-  list<Ponto> listP;
-  list<Rota> listR;
-  // Variaveis auxiliares para buscas nas listas
-  list<Ponto>::iterator itr_ponto;
-  list<Rota>::iterator itr_rota;
-  // Variaveis auxiliares para leitura de dados
-  Ponto P;
-  Rota R;
-  string prov;
-
-  // Leh os pontos do arquivo
-  try {
-    // Abre o arquivo de pontos
-    ifstream arq(arq_pontos);
-    if (!arq.is_open())
-      throw 1;
+/// *******************************************************************************
+/// Calcula o caminho entre a origem e o destino do planejador usando o
+/// algoritmo A*
+/// *******************************************************************************
 
-    // Leh o cabecalho
-    getline(arq, prov);
-    if (arq.fail() || prov != "ID;Nome;Latitude;Longitude")
-      throw 2;
-
-    // Leh os pontos
-    do {
-      // Leh a ID
-      getline(arq, prov, ';');
-      if (arq.fail())
-        throw 3;
-      P.id.set(std::move(prov));
-      if (!P.valid())
-        throw 4;
-
-      // Leh o nome
-      getline(arq, prov, ';');
-      if (arq.fail() || prov.size() < 2)
-        throw 5;
-      P.nome = std::move(prov);
-
-      // Leh a latitude
-      arq >> P.latitude;
-      if (arq.fail())
-        throw 6;
-      arq.ignore(1, ';');
-
-      // Leh a longitude
-      arq >> P.longitude;
-      if (arq.fail())
-        throw 7;
-      arq >> ws;
-
-      itr_ponto = find(listP.begin(), listP.end(), P);
-
-      if (itr_ponto != listP.end())
-        throw 8;
-
-      // Verifica se jah existe ponto com a mesma ID no conteiner de pontos
-      // lidos (listP) Caso exista, throw 8
-      /* ***********  /
-      /  FALTA FAZER  /
-      /  *********** */
-
-      // Inclui o ponto na lista de pontos
-      listP.push_back(std::move(P));
-    } while (!arq.eof());
-
-    // Fecha o arquivo de pontos
-    arq.close();
-  } catch (int i) {
-    cerr << "Erro " << i << " na leitura do arquivo de pontos " << arq_pontos
-         << endl;
-    return false;
+/// Prepara os buffers para uma busca em um mapa com num_pontos pontos.
+/// g e pai nao precisam ser zerados: soh sao lidos em pontos jah alcancados.
+/// O fechado soh eh zerado quando o numero de pontos muda ou quando a
+/// geracao chegaria ao maior valor possivel; nos outros casos, a nova
+/// geracao o esvazia.
+template <class Custo>
+void EspacoBusca::DirecaoT<Custo>::preparar(Indice num_pontos) {
+  if (marca.size() != num_pontos || geracao == UINT32_MAX) {
+    g.resize(num_pontos);
+    pai.resize(num_pontos, INDICE_INVALIDO);
+    marca.assign(num_pontos, 0);
+    geracao = 0;
   }
+  ++geracao;
+  aberto.reset(num_pontos);
+  num_fechados = 0;
+}
 
-  // Leh as rotas do arquivo
-  try {
-    // Abre o arquivo de rotas
-    ifstream arq(arq_rotas);
-    if (!arq.is_open())
-      throw 1;
+template struct EspacoBusca::DirecaoT<double>;
+template struct EspacoBusca::DirecaoT<float>;
+template struct EspacoBusca::DirecaoT<uint32_t>;
+
+/// Algoritmo A* entre os pontos de indices orig e dest, usando a area de
+/// trabalho E. Retorna o comprimento do caminho (<0 se nao existe caminho)
+/// e preenche o caminho em indices E.caminho e os tamanhos NA e NF dos
+/// conjuntos de busca.
+/// A busca acumula os custos no tipo Custo::Tipo, com a heuristica
+/// Heuristica; o comprimento retornado eh sempre em km, em double.
+template <class Heuristica, class Custo, class Politica>
+double Planejador::aEstrela(Indice orig, Indice dest, EspacoBusca &E,
+                            int &NA, int &NF, Politica &P) const {
+  using Tipo = typename Custo::Tipo;
+  const Adjacencia &adj = mapa.adj;
+  const Heuristica h(mapa);
+
+  EspacoBusca::DirecaoT<Tipo> &D = E.idaCusto(Tipo());
+  D.preparar(mapa.numPontos());
+  vector<Tipo> &g = D.g;
+  vector<Indice> &pai = D.pai;
+  HeapIndexadoT<Tipo> &aberto = D.aberto;
+  CaminhoIndices &C = E.caminho;
+  C.clear();
+  P.fimPreparo();
+
+  g[orig] = 0;
+  aberto.push(orig, Custo::limite(h(orig, dest)));
+  P.avaliouHeuristica();
+  P.aberto(aberto.size());
+
+  Indice atual;
+  do {
+    atual = aberto.pop();
+
+    D.fechar(atual);
+    P.expandiu();
+
+    if (atual != dest) {
+      // Percorre apenas as rotas incidentes ao ponto atual
+      for (Indice e = adj.inicio[atual]; e < adj.fim[atual]; ++e) {
+        Indice suc = adj.vizinho[e];
+        P.relaxou();
+        Tipo g_suc = g[atual] + Custo::aresta(adj.comprimento[e]);
+        if (D.fechado(suc)) {
+          P.alcancouFechado(g_suc, g[suc]);
+          continue;
+        }
 
-    // Leh o cabecalho
-    getline(arq, prov);
-    if (arq.fail() ||
-        prov != "ID;Nome;Extremidade 1;Extremidade 2;Comprimento") {
-      throw 2;
+        Tipo f_suc = g_suc + Custo::limite(h(suc, dest));
+        P.avaliouHeuristica();
+
+        if (aberto.contem(suc)) {
+          // Soh substitui o noh em aberto se o novo for melhor
+          if (!(f_suc < aberto.chave(suc)))
+            continue;
+          aberto.diminuir(suc, f_suc);
+          P.diminuiu();
+        } else {
+          aberto.push(suc, f_suc);
+          P.aberto(aberto.size());
+        }
+        g[suc] = g_suc;
+        pai[suc] = adj.rota[e];
+      }
     }
+  } while (!aberto.empty() && atual != dest);
+
+  NA = aberto.size();
+  NF = D.num_fechados;
+  P.fimBusca();
+
+  if (atual != dest)
+    return -1.0;
+
+  refazerCaminho(pai, orig, dest, C);
+  if constexpr (is_same<Tipo, double>::value)
+    return double(g[dest]);
+  // Com outros tipos, o comprimento eh somado em double ao longo do
+  // caminho, na mesma ordem da busca
+  double compr = 0.0;
+  for (size_t i = 1; i < C.size(); ++i)
+    compr += mapa.comprimento[C[i].rota];
+  return compr;
+}
 
-    // Leh as rotas
-    do {
-      // Leh a ID
-      getline(arq, prov, ';');
-      if (arq.fail())
-        throw 3;
-      R.id.set(std::move(prov));
-      if (!R.valid())
-        throw 4;
-
-      // Leh o nome
-      getline(arq, prov, ';');
-      if (arq.fail() || prov.size() < 2)
-        throw 4;
-      R.nome = std::move(prov);
-
-      // Leh a id da extremidade[0]
-      getline(arq, prov, ';');
-      if (arq.fail())
-        throw 6;
-      R.extremidade[0].set(std::move(prov));
-      if (!R.extremidade[0].valid())
-        throw 7;
-
-      itr_ponto = find(listP.begin(), listP.end(), R.extremidade[0]);
-
-      if (itr_ponto == listP.end())
-        throw 8;
-      // Verifica se a Id corresponde a um ponto no conteiner de pontos lidos
-      // (listP) Caso ponto nao exista, throw 8
-      /* ***********  /
-      /  FALTA FAZER  /
-      /  *********** */
-
-      // Leh a id da extremidade[1]
-      getline(arq, prov, ';');
-      if (arq.fail())
-        throw 9;
-      R.extremidade[1].set(std::move(prov));
-      if (!R.extremidade[1].valid())
-        throw 10;
-
-      itr_ponto = find(listP.begin(), listP.end(), R.extremidade[1]);
-
-      if (itr_ponto == listP.end())
-        throw 8;
-
-      // Verifica se a Id corresponde a um ponto no conteiner de pontos
-      // lidos (listP) Caso ponto nao exista, throw 11
-      /* ***********  /
-      /  FALTA FAZER  /
-      /  *********** */
-
-      // Leh o comprimento
-      arq >> R.comprimento;
-      if (arq.fail())
-        throw 12;
-      arq >> ws;
-
-      itr_rota = find(listR.begin(), listR.end(), R);
-
-      if (itr_rota != listR.end())
-        throw 13;
-      // Verifica se jah existe rota com a mesma ID no conteiner de rotas lidas
-      // (listR) Caso exista, throw 13
-      /* ***********  /
-      /  FALTA FAZER  /
-      /  *********** */
-
-      // Inclui a rota na lista de rotas
-      listR.push_back(std::move(R));
-    } while (!arq.eof());
-
-    // Fecha o arquivo de rotas
-    arq.close();
-  } catch (int i) {
-    cerr << "Erro " << i << " na leitura do arquivo de rotas " << arq_rotas
-         << endl;
-    return false;
+/// Algoritmo A* bidirecional: uma busca parte da origem e outra do destino,
+/// expandindo alternadamente a que tiver o menor f no topo do aberto.
+/// As duas usam o potencial medio p(v) = (h(v,dest) - h(v,orig))/2 (na ida)
+/// e -p(v) (na volta), com h = Mapa::heuristica. Ao contrario de usar
+/// h(v,dest) na ida e h(v,orig) na volta, esse potencial eh consistente nas
+/// duas direcoes ao mesmo tempo, de modo que cada busca pode fechar pontos em
+/// definitivo, como no A* comum.
+/// Sempre que uma busca alcanca um ponto jah alcancado pela outra, o caminho
+/// pelo ponto eh candidato a melhor (comprimento mu). A busca termina quando
+/// f_min(ida) + f_min(volta) >= mu: nenhum caminho ainda nao examinado pode
+/// ser mais curto que mu.
+template <class Politica>
+double Planejador::aEstrelaBidirecional(Indice orig, Indice dest,
+                                        EspacoBusca &E, int &NA, int &NF,
+                                        Politica &P) const {
+  const Adjacencia &adj = mapa.adj;
+  CaminhoIndices &C = E.caminho;
+
+  E.ida.preparar(mapa.numPontos());
+  E.volta.preparar(mapa.numPontos());
+  C.clear();
+  P.fimPreparo();
+
+  E.ida.g[orig] = 0.0;
+  E.ida.aberto.push(orig, potencial(orig, orig, dest));
+  E.volta.g[dest] = 0.0;
+  E.volta.aberto.push(dest, -potencial(dest, orig, dest));
+  P.avaliouHeuristica(4); // Cada potencial usa duas heuristicas
+  P.aberto(2);
+
+  // Melhor caminho encontrado ateh agora e o ponto onde as buscas se
+  // encontram nele
+  double mu = (orig == dest) ? 0.0 : HUGE_VAL;
+  Indice meio = (orig == dest) ? orig : INDICE_INVALIDO;
+
+  while (!E.ida.aberto.empty() && !E.volta.aberto.empty()) {
+    double topo_ida = E.ida.aberto.chave(E.ida.aberto.topo());
+    double topo_volta = E.volta.aberto.chave(E.volta.aberto.topo());
+    if (topo_ida + topo_volta >= mu)
+      break;
+
+    // Expande a direcao com o menor f no topo
+    bool eh_ida = (topo_ida <= topo_volta);
+    EspacoBusca::Direcao &D = eh_ida ? E.ida : E.volta;
+    const EspacoBusca::Direcao &outra = eh_ida ? E.volta : E.ida;
+    const double sinal = eh_ida ? 1.0 : -1.0;
+
+    Indice atual = D.aberto.pop();
+    D.fechar(atual);
+    P.expandiu();
+
+    for (Indice e = adj.inicio[atual]; e < adj.fim[atual]; ++e) {
+      Indice suc = adj.vizinho[e];
+      P.relaxou();
+      if (D.fechado(suc)) {
+        P.alcancouFechado(D.g[atual] + adj.comprimento[e], D.g[suc]);
+        continue;
+      }
+
+      double g_suc = D.g[atual] + adj.comprimento[e];
+      if (D.aberto.contem(suc)) {
+        // Soh substitui o noh em aberto se o novo for melhor
+        if (!(g_suc < D.g[suc]))
+          continue;
+        D.aberto.diminuir(suc, g_suc + sinal * potencial(suc, orig, dest));
+        P.diminuiu();
+      } else {
+        D.aberto.push(suc, g_suc + sinal * potencial(suc, orig, dest));
+        P.aberto(E.ida.aberto.size() + E.volta.aberto.size());
+      }
+      P.avaliouHeuristica(2);
+      D.g[suc] = g_suc;
+      D.pai[suc] = adj.rota[e];
+
+      // Caminho que passa por suc, se a outra busca jah chegou nele
+      if (outra.alcancado(suc) && g_suc + outra.g[suc] < mu) {
+        mu = g_suc + outra.g[suc];
+        meio = suc;
+      }
+    }
   }
 
-  // Soh chega aqui se nao entrou no catch, jah que ele termina com return.
-  // Move as listas de pontos e rotas para o planejador.
-  pontos = std::move(listP);
-  rotas = std::move(listR);
+  NA = E.ida.aberto.size() + E.volta.aberto.size();
+  NF = E.ida.num_fechados + E.volta.num_fechados;
+  P.fimBusca();
+
+  if (meio == INDICE_INVALIDO)
+    return -1.0;
+
+  // Refaz o caminho da origem ateh o ponto de encontro, pela busca de ida...
+  refazerCaminho(E.ida.pai, orig, meio, C);
+
+  // ... e do ponto de encontro ateh o destino, pela busca de volta
+  for (Indice pt = meio; pt != dest;) {
+    Indice r = E.volta.pai[pt];
+
+    const Indice *ext = &mapa.extremidades[2 * r];
+    pt = (ext[0] != pt) ? ext[0] : ext[1];
+    C.push_back({r, pt});
+  }
 
-  return true;
+  return mu;
 }
 
-/// *******************************************************************************
-/// Calcula o caminho entre a origem e o destino do planejador usando o
-/// algoritmo A*
-/// *******************************************************************************
+/// Refaz em C o caminho de orig ateh dest: volta do destino ateh a origem,
+/// pelas rotas que trouxeram ateh cada ponto, e inverte o resultado
+void Planejador::refazerCaminho(const vector<Indice> &pai, Indice orig,
+                                Indice dest, CaminhoIndices &C) const {
+  C.clear();
+  for (Indice pt = dest; pt != orig;) {
+    C.push_back({pai[pt], pt});
 
-/// Noh: os elementos dos conjuntos de busca do algoritmo A*
-/* ***********  /
-/  FALTA FAZER  /
-/  *********** */
+    const Indice *ext = &mapa.extremidades[2 * pai[pt]];
+    pt = (ext[0] != pt) ? ext[0] : ext[1];
+  }
+  C.push_back({INDICE_INVALIDO, orig});
+  reverse(C.begin(), C.end());
+}
+
+/// Converte um caminho em indices para um Caminho de identificadores
+void Planejador::converterCaminho(const CaminhoIndices &CI,
+                                  Caminho &C) const {
+  C.clear();
+  for (const Trecho &T : CI) {
+    pair<IDRota, IDPonto> par;
+    if (T.rota != INDICE_INVALIDO)
+      par.first.set(string(mapa.id_rotas[T.rota]));
+    par.second.set(string(mapa.id_pontos[T.ponto]));
+    C.push_back(std::move(par));
+  }
+}
+
+/// Converte um caminho em indices para um CaminhoContiguo
+void Planejador::converterCaminho(const CaminhoIndices &CI,
+                                  CaminhoContiguo &C) const {
+  C.resize(CI.size());
+  for (size_t i = 0; i < CI.size(); ++i) {
+    const Trecho &T = CI[i];
+    C[i].rota = (T.rota != INDICE_INVALIDO) ? mapa.id_rotas[T.rota]
+                                            : string_view();
+    C[i].ponto = mapa.id_pontos[T.ponto];
+  }
+}
 
 /// Calcula o caminho entre a origem e o destino do planejador usando o
 /// algoritmo A* Retorna o comprimento do caminho encontrado.
@@ -299,12 +675,75 @@ bool Planejador::ler(const std::string &arq_pontos,
 /// O parametro C retorna o caminho encontrado
 /// (vazio se  parametros invalidos ou nao existe caminho).
 /// O parametro NA retorna o numero de nos em aberto ao termino do algoritmo A*
-/// (<0 se parametros invalidos, retorna >0 mesmo quando nao existe caminho).
+/// (<0 se parametros invalidos, 0 se nao ha busca).
 /// O parametro NF retorna o numero de nos em fechado ao termino do algoritmo A*
-/// (<0 se parametros invalidos, retorna >0 mesmo quando nao existe caminho).
+/// (<0 se parametros invalidos, 0 se nao ha busca).
 double Planejador::calculaCaminho(const IDPonto &id_origem,
                                   const IDPonto &id_destino, Caminho &C,
-                                  int &NA, int &NF) {
+                                  int &NA, int &NF, ModoBusca modo) {
+  return calculaCaminho(id_origem, id_destino, C, NA, NF, espaco, modo);
+}
+
+/// Versao reentrante de calculaCaminho, que usa a area de trabalho E
+double Planejador::calculaCaminho(const IDPonto &id_origem,
+                                  const IDPonto &id_destino, Caminho &C,
+                                  int &NA, int &NF, EspacoBusca &E,
+                                  ModoBusca modo) const {
+  SemEstatisticas P;
+  return calcular(id_origem, id_destino, C, NA, NF, E, modo, P);
+}
+
+/// Versao de calculaCaminho que coleta estatisticas
+double Planejador::calculaCaminho(const IDPonto &id_origem,
+                                  const IDPonto &id_destino, Caminho &C,
+                                  EstatisticasBusca &est, ModoBusca modo) {
+  return calculaCaminho(id_origem, id_destino, C, est, espaco, modo);
+}
+
+/// Versao reentrante de calculaCaminho que coleta estatisticas
+double Planejador::calculaCaminho(const IDPonto &id_origem,
+                                  const IDPonto &id_destino, Caminho &C,
+                                  EstatisticasBusca &est, EspacoBusca &E,
+                                  ModoBusca modo) const {
+  ComEstatisticas P(est);
+  int NA, NF;
+  double compr = calcular(id_origem, id_destino, C, NA, NF, E, modo, P);
+  est.aberto_final = NA;
+  est.fechado_final = NF;
+  TotaisBusca::global().acumular(est);
+  return compr;
+}
+
+/// Versao reentrante de calculaCaminho com o caminho contiguo
+double Planejador::calculaCaminho(const IDPonto &id_origem,
+                                  const IDPonto &id_destino,
+                                  CaminhoContiguo &C, int &NA, int &NF,
+                                  EspacoBusca &E, ModoBusca modo) const {
+  SemEstatisticas P;
+  return calcular(id_origem, id_destino, C, NA, NF, E, modo, P);
+}
+
+/// Versao reentrante de calculaCaminho com o caminho contiguo que coleta
+/// estatisticas
+double Planejador::calculaCaminho(const IDPonto &id_origem,
+                                  const IDPonto &id_destino,
+                                  CaminhoContiguo &C, EstatisticasBusca &est,
+                                  EspacoBusca &E, ModoBusca modo) const {
+  ComEstatisticas P(est);
+  int NA, NF;
+  double compr = calcular(id_origem, id_destino, C, NA, NF, E, modo, P);
+  est.aberto_final = NA;
+  est.fechado_final = NF;
+  TotaisBusca::global().acumular(est);
+  return compr;
+}
+
+/// Implementacao de calculaCaminho, com a politica de estatisticas P
+template <class TipoCaminho, class Politica>
+double Planejador::calcular(const IDPonto &id_origem,
+                            const IDPonto &id_destino, TipoCaminho &C,
+                            int &NA, int &NF, EspacoBusca &E, ModoBusca modo,
+                            Politica &P) const {
   // Zera o caminho resultado
   C.clear();
 
@@ -313,110 +752,137 @@ double Planejador::calculaCaminho(const IDPonto &id_origem,
     if (empty())
       throw 1;
 
-    // Calcula o ponto que corresponde a id_origem.
+    // Calcula o indice do ponto que corresponde a id_origem.
     // Se nao existir, throw 4
-    Ponto pt_orig = getPonto(id_origem);
-    if (!pt_orig.valid())
+    Indice orig = mapa.id_pontos.find(id_origem.str());
+    if (orig == INDICE_INVALIDO)
       throw 4;
 
-    // Calcula o ponto que corresponde a id_destino.
+    // Calcula o indice do ponto que corresponde a id_destino.
     // Se nao existir, throw 5
-    Ponto pt_dest = getPonto(id_destino);
-    if (!pt_dest.valid())
+    Indice dest = mapa.id_pontos.find(id_destino.str());
+    if (dest == INDICE_INVALIDO)
       throw 5;
 
-    Noh atual(id_origem, IDRota(), 0.0, haversine(pt_orig, pt_dest));
-
-    list<Noh> aberto, fechado;
-    aberto.push_back(atual);
-
-    do {
-
-      atual = aberto.front();
-      aberto.pop_front();
-
-      fechado.push_back(atual);
-
-      if (atual.id_pt != id_destino) {
-        for (const auto &rota_suc : rotas) {
-          if (rota_suc.extremidade[0] == atual.id_pt ||
-              rota_suc.extremidade[1] == atual.id_pt) {
-
-            Noh suc;
-            suc.id_pt = (rota_suc.extremidade[0] == atual.id_pt)
-                            ? rota_suc.extremidade[1]
-                            : rota_suc.extremidade[0];
-            Ponto pt_suc = getPonto(suc.id_pt);
-            suc.id_rt = rota_suc.id;
-            suc.g = atual.g + rota_suc.comprimento;
-            suc.h = haversine(pt_suc, pt_dest);
+    // Hierarquia nao calculada
+    if (modo == ModoBusca::HIERARQUIA && mapa.ch.empty())
+      throw 6;
 
-            bool eh_inedito = true;
-
-            auto old = find(fechado.begin(), fechado.end(), suc);
-
-            if (old != fechado.end()) {
-              eh_inedito = false;
-            } else {
-              old = find(aberto.begin(), aberto.end(), suc);
-
-              if (old != aberto.end()) {
-                if (suc.f() < old->f()) {
-                  aberto.erase(old);
-                } else {
-                  eh_inedito = false;
-                }
-              }
-            }
+    // Componentes diferentes: nao existe caminho, e nao ha busca
+    if (!mapa.mesmaComponente(orig, dest)) {
+      NA = NF = 0;
+      return -1.0;
+    }
 
-            if (eh_inedito) {
-              auto big = upper_bound(aberto.begin(), aberto.end(), suc);
-              aberto.insert(big, suc);
-            }
-          }
-        }
-      }
-    } while (!aberto.empty() && atual.id_pt != id_destino);
+    // Consulta (ou consulta inversa) jah calculada
+    double compr;
+    if (cache.ativo() && cache.buscar(orig, dest, compr, E.caminho, NA, NF)) {
+      converterCaminho(E.caminho, C);
+      P.fimReconstrucao();
+      return compr;
+    }
 
-    NA = aberto.size();
-    NF = fechado.size();
+    // A busca trabalha apenas com indices; os identificadores soh sao
+    // consultados na conversao do caminho encontrado
+    if (modo == ModoBusca::HIERARQUIA)
+      compr = buscaHierarquia(orig, dest, E, NA, NF, P);
+    else if (modo == ModoBusca::BIDIRECIONAL)
+      compr = aEstrelaBidirecional(orig, dest, E, NA, NF, P);
+    else
+      compr = aEstrela<HeuristicaMarcos, CustoDouble>(orig, dest, E, NA, NF,
+                                                      P);
+    cache.incluir(orig, dest, compr, E.caminho, NA, NF);
+    converterCaminho(E.caminho, C);
+    P.fimReconstrucao();
 
-    double compr = -1.0;
+    // O try tem que terminar retornando o comprimento calculado
+    return compr;
+  } catch (int i) {
+    cerr << "Erro " << i << " no calculo do caminho\n";
+    P.erro(i);
+  }
 
-    if (atual.id_pt != id_destino) {
+  // Soh chega aqui se executou o catch, jah que o try termina sempre com
+  // return. Caminho C permanece vazio.
+  NA = NF = -1;
+  return -1.0;
+}
 
-      return compr;
-    } else {
-      compr = atual.g;
+/// Versao de calculaCaminho que escolhe a heuristica e o tipo dos custos
+/// do A*. Cada combinacao eh uma instanciacao de aEstrela, escolhida uma
+/// unica vez por consulta.
+double Planejador::calculaCaminho(const IDPonto &id_origem,
+                                  const IDPonto &id_destino,
+                                  CaminhoContiguo &C, int &NA, int &NF,
+                                  EspacoBusca &E, HeuristicaBusca heuristica,
+                                  CustoBusca custo) const {
+  using Busca = double (Planejador::*)(Indice, Indice, EspacoBusca &, int &,
+                                       int &, SemEstatisticas &) const;
+  // Indexadas por HeuristicaBusca e CustoBusca, na ordem das enumeracoes
+  static const Busca buscas[4][3] = {
+      {&Planejador::aEstrela<HeuristicaZero, CustoDouble, SemEstatisticas>,
+       &Planejador::aEstrela<HeuristicaZero, CustoFloat, SemEstatisticas>,
+       &Planejador::aEstrela<HeuristicaZero, CustoMetros, SemEstatisticas>},
+      {&Planejador::aEstrela<HeuristicaHaversine, CustoDouble,
+                             SemEstatisticas>,
+       &Planejador::aEstrela<HeuristicaHaversine, CustoFloat, SemEstatisticas>,
+       &Planejador::aEstrela<HeuristicaHaversine, CustoMetros,
+                             SemEstatisticas>},
+      {&Planejador::aEstrela<HeuristicaCorda, CustoDouble, SemEstatisticas>,
+       &Planejador::aEstrela<HeuristicaCorda, CustoFloat, SemEstatisticas>,
+       &Planejador::aEstrela<HeuristicaCorda, CustoMetros, SemEstatisticas>},
+      {&Planejador::aEstrela<HeuristicaMarcos, CustoDouble, SemEstatisticas>,
+       &Planejador::aEstrela<HeuristicaMarcos, CustoFloat, SemEstatisticas>,
+       &Planejador::aEstrela<HeuristicaMarcos, CustoMetros, SemEstatisticas>}};
 
-      while (atual.id_rt.valid()) {
-        C.push_front(make_pair(atual.id_rt, atual.id_pt));
+  // Zera o caminho resultado
+  C.clear();
 
-        Rota rota_ant = getRota(atual.id_rt);
-        IDPonto id_pt_ant = (rota_ant.extremidade[0] != atual.id_pt)
-                                ? rota_ant.extremidade[0]
-                                : rota_ant.extremidade[1];
-        atual = *find(fechado.begin(), fechado.end(), id_pt_ant);
-      }
+  try {
+    // Mapa vazio
+    if (empty())
+      throw 1;
+    Indice orig = mapa.id_pontos.find(id_origem.str());
+    if (orig == INDICE_INVALIDO)
+      throw 4;
+    Indice dest = mapa.id_pontos.find(id_destino.str());
+    if (dest == INDICE_INVALIDO)
+      throw 5;
 
-      C.push_front(make_pair(atual.id_rt, atual.id_pt));
+    // Componentes diferentes: nao existe caminho, e nao ha busca
+    if (!mapa.mesmaComponente(orig, dest)) {
+      NA = NF = 0;
+      return -1.0;
     }
 
-    /* *****************************  /
-    /  IMPLEMENTACAO DO ALGORITMO A*  /
-    /  ***************************** */
-    /* ***********  /
-    /  FALTA FAZER  /
-    /  *********** */
-
-    // O try tem que terminar retornando o comprimento calculado
-    return compr; // SUBSTITUA pelo return do valor correto
+    SemEstatisticas P;
+    const Busca busca = buscas[int(heuristica)][int(custo)];
+    double compr = (this->*busca)(orig, dest, E, NA, NF, P);
+    converterCaminho(E.caminho, C);
+    return compr;
   } catch (int i) {
     cerr << "Erro " << i << " no calculo do caminho\n";
   }
 
-  // Soh chega aqui se executou o catch, jah que o try termina sempre com
-  // return. Caminho C permanece vazio.
   NA = NF = -1;
   return -1.0;
 }
+
+/// Calcula os caminhos de um lote de consultas em paralelo.
+/// Cada thread do pool usa a sua propria area de trabalho, emprestada da
+/// reserva do Planejador; cada resultado eh gravado na posicao da sua
+/// consulta, o que mantem a ordem de entrada.
+vector<ResultadoCaminho> Planejador::calculaCaminhos(
+    const vector<pair<IDPonto, IDPonto>> &consultas, ModoBusca modo,
+    PoolThreads &pool) const {
+  vector<ResultadoCaminho> R(consultas.size());
+  ReservaEspacos::Emprestimo espacos(reserva, pool.size());
+
+  pool.paraCada(consultas.size(), [&](size_t i, unsigned t) {
+    ResultadoCaminho &res = R[i];
+    res.comprimento =
+        calculaCaminho(consultas[i].first, consultas[i].second, res.caminho,
+                       res.NA, res.NF, espacos[t], modo);
+  });
+  return R;
+}
@@ -1,8 +1,21 @@
 #ifndef _PLANEJADOR_H_
 #define _PLANEJADOR_H_
 
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <cstdint>
+#include <future>
+#include <iosfwd>
 #include <list>
+#include <memory>
+#include <mutex>
 #include <string>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+
+#include "pool.h"
 
 /* *************************
  * CLASSE IDPONTO        *
@@ -19,10 +32,15 @@ public:
   // Atribuicao de string
   void set(std::string &&S);
   // Teste de validade
-  bool valid() const { return (t.size() >= 2 && t[0] == '#'); }
+  bool valid() const { return valid(t); }
+  static bool valid(std::string_view S) {
+    return (S.size() >= 2 && S[0] == '#');
+  }
   // Comparacao
   bool operator==(const IDPonto &ID) const { return t == ID.t; }
   bool operator!=(const IDPonto &ID) const { return !operator==(ID); }
+  // Texto da identificacao
+  const std::string &str() const { return t; }
   // Impressao
   friend std::ostream &operator<<(std::ostream &X, const IDPonto &ID) {
     return X << ID.t;
@@ -44,10 +62,15 @@ public:
   // Atribuicao de string temporaria
   void set(std::string &&S);
   // Teste de validade
-  bool valid() const { return (t.size() >= 2 && t[0] == '&'); }
+  bool valid() const { return valid(t); }
+  static bool valid(std::string_view S) {
+    return (S.size() >= 2 && S[0] == '&');
+  }
   // Comparacao
   bool operator==(const IDRota &ID) const { return t == ID.t; }
   bool operator!=(const IDRota &ID) const { return !operator==(ID); }
+  // Texto da identificacao
+  const std::string &str() const { return t; }
   // Impressao
   friend std::ostream &operator<<(std::ostream &X, const IDRota &ID) {
     return X << ID.t;
@@ -80,6 +103,14 @@ struct Ponto {
 
 /// Distancia entre 2 pontos (formula de haversine)
 double haversine(const Ponto &P1, const Ponto &P2);
+/// Distancia entre 2 coordenadas em graus (formula de haversine)
+double haversine(double lat1, double lon1, double lat2, double lon2);
+/// Raio da Terra (em km) usado pela formula de haversine
+constexpr double RAIO_TERRA = 6371.0;
+/// Conversao de graus para radianos
+inline double radianos(double graus) {
+  return 3.14159265358979323846 * graus / 180.0;
+}
 
 /* *************************
  * CLASSE ROTA           *
@@ -116,23 +147,1324 @@ struct Rota {
 /// ultimo elemento, o ponto eh o destino.
 using Caminho = std::list<std::pair<IDRota, IDPonto>>;
 
-struct Noh {
-  IDPonto id_pt;
-  IDRota id_rt;
-  double g;
-  double h;
+/// Um trecho de um CaminhoContiguo: a id da rota que trouxe ateh o ponto
+/// (vazia no 1o trecho) e a id do ponto
+struct TrechoCaminho {
+  std::string_view rota;
+  std::string_view ponto;
+};
+
+/// Um caminho com os mesmos trechos do Caminho, mas contiguo na memoria e
+/// com as ids referenciando os textos do mapa, sem copia-los. O mesmo
+/// CaminhoContiguo pode ser reaproveitado entre consultas sem alocar
+/// memoria, mas as ids soh valem enquanto o mapa nao for alterado (ler,
+/// lerBinario, aplicar, clear, etc.).
+using CaminhoContiguo = std::vector<TrechoCaminho>;
+
+/// Indice denso de um Ponto ou de uma Rota no mapa: os pontos (e as rotas)
+/// sao numerados 0, 1, 2, ... na ordem em que foram lidos.
+using Indice = uint32_t;
+/// Valor de Indice que nao corresponde a nenhum Ponto ou Rota
+constexpr Indice INDICE_INVALIDO = UINT32_MAX;
+
+/* *************************
+ * CLASSE ARRANJO        *
+ ************************* */
+
+/// Arranjo contiguo de elementos do tipo T, que pode ser dono dos seus
+/// elementos (guardados em um std::vector) ou apenas referenciar elementos
+/// em memoria externa, como um arquivo binario mapeado na memoria.
+/// O acesso de leitura eh o mesmo nos dois casos e nao tem custo extra.
+/// Qualquer modificacao de um arranjo que referencia memoria externa copia
+/// antes os elementos, tornando o arranjo dono deles.
+template <class T> class Arranjo {
+private:
+  std::vector<T> dono; // Elementos proprios (vazio se externos)
+  const T *p;          // 1o elemento (proprio ou externo)
+  size_t n;            // Numero de elementos
+  bool externo;        // Se os elementos sao externos
+
+  void sincronizar() {
+    p = dono.data();
+    n = dono.size();
+  }
+  void tornarProprio() {
+    if (externo) {
+      dono.assign(p, p + n);
+      externo = false;
+      sincronizar();
+    }
+  }
+
+public:
+  using value_type = T;
+
+  // Construtores
+  Arranjo() : dono(), p(nullptr), n(0), externo(false) {}
+  Arranjo(const Arranjo &A)
+      : dono(A.dono), p(A.externo ? A.p : dono.data()), n(A.n),
+        externo(A.externo) {}
+  Arranjo(Arranjo &&A) noexcept
+      : dono(std::move(A.dono)), p(A.externo ? A.p : dono.data()), n(A.n),
+        externo(A.externo) {
+    A.clear();
+  }
+  // Atribuicao
+  Arranjo &operator=(const Arranjo &A) {
+    if (this != &A) {
+      dono = A.dono;
+      externo = A.externo;
+      p = externo ? A.p : dono.data();
+      n = A.n;
+    }
+    return *this;
+  }
+  Arranjo &operator=(Arranjo &&A) noexcept {
+    if (this != &A) {
+      dono = std::move(A.dono);
+      externo = A.externo;
+      p = externo ? A.p : dono.data();
+      n = A.n;
+      A.clear();
+    }
+    return *this;
+  }
+
+  // Leitura
+  size_t size() const { return n; }
+  bool empty() const { return n == 0; }
+  const T *data() const { return p; }
+  const T &operator[](size_t i) const { return p[i]; }
+  const T *begin() const { return p; }
+  const T *end() const { return p + n; }
+  /// Testa se os elementos sao externos
+  bool referenciaExterna() const { return externo; }
+
+  /// Faz o arranjo referenciar num elementos externos, que devem continuar
+  /// validos enquanto forem referenciados
+  void referenciar(const T *ext, size_t num) {
+    dono = std::vector<T>();
+    p = ext;
+    n = num;
+    externo = true;
+  }
+  /// Elementos modificaveis (o ponteiro retornado eh invalidado por
+  /// qualquer operacao que altere o tamanho do arranjo)
+  T *mutavel() {
+    tornarProprio();
+    return dono.data();
+  }
+
+  // Modificacao
+  void push_back(const T &x) {
+    tornarProprio();
+    dono.push_back(x);
+    sincronizar();
+  }
+  void append(const T *x, size_t num) {
+    tornarProprio();
+    dono.insert(dono.end(), x, x + num);
+    sincronizar();
+  }
+  void reserve(size_t num) {
+    tornarProprio();
+    dono.reserve(num);
+    sincronizar();
+  }
+  void resize(size_t num) {
+    tornarProprio();
+    dono.resize(num);
+    sincronizar();
+  }
+  void assign(size_t num, const T &x) {
+    externo = false;
+    dono.assign(num, x);
+    sincronizar();
+  }
+  void clear() {
+    externo = false;
+    dono.clear();
+    sincronizar();
+  }
+};
+
+/* *************************
+ * CLASSE TABELATEXTOS   *
+ ************************* */
+
+/// Sequencia de textos armazenados contiguamente em um unico bloco de
+/// caracteres (de ateh 4 GiB). O texto de indice i eh o intervalo faixas[i]
+/// do bloco.
+class TabelaTextos {
+public:
+  /// Posicao de um texto no bloco de caracteres
+  struct Faixa {
+    uint32_t inicio;
+    uint32_t tamanho;
+  };
+
+protected:
+  Arranjo<Faixa> faixas;
+  Arranjo<char> caracteres;
+  size_t descartados; // Caracteres de textos removidos, ainda no bloco
+
+  // Acesso aos arranjos para gravacao e leitura em arquivo binario
+  friend struct SecoesMapa;
+
+public:
+  // Construtor
+  TabelaTextos() : faixas(), caracteres(), descartados(0) {}
+  /// Numero de textos
+  Indice size() const { return Indice(faixas.size()); }
+  /// Texto de indice i
+  std::string_view operator[](Indice i) const {
+    return std::string_view(caracteres.data() + faixas[i].inicio,
+                            faixas[i].tamanho);
+  }
+  /// Acrescenta um texto ao final, retornando seu indice
+  Indice push_back(std::string_view S);
+  /// Reserva espaco para n textos com um total de c caracteres
+  void reserve(size_t n, size_t c);
+  /// Remove o texto de indice i, que passa a ser o do ultimo texto.
+  /// Os caracteres removidos ficam no bloco ateh que ocupem metade dele,
+  /// quando o bloco eh compactado.
+  void remover(Indice i);
+  /// Torna a tabela vazia
+  void clear();
+};
+
+/* *************************
+ * CLASSE TABELAIDS      *
+ ************************* */
+
+/// Tabela de internacao de identificadores: associa cada texto de
+/// identificacao a um Indice denso, na ordem de insercao.
+/// A busca texto -> Indice eh O(1), por uma tabela hash de enderecamento
+/// aberto (sondagem linear) que guarda apenas os indices.
+class TabelaIds : public TabelaTextos {
+private:
+  Arranjo<Indice> slots; // INDICE_INVALIDO == posicao livre
+
+  // Acesso aos arranjos para gravacao e leitura em arquivo binario
+  friend struct SecoesMapa;
+
+  /// Funcao hash (FNV-1a) dos identificadores
+  static uint64_t hash(std::string_view S);
+  /// Reconstroi a tabela hash com o numero de posicoes dado (potencia de 2)
+  void rehash(size_t num_slots);
+  /// Posicao da tabela hash que guarda o indice i
+  size_t slot(Indice i) const;
+
+public:
+  // Construtor
+  TabelaIds() : TabelaTextos(), slots() {}
+  /// Indice do identificador S (INDICE_INVALIDO se inexistente)
+  Indice find(std::string_view S) const;
+  /// Inclui o identificador S, caso ainda nao exista.
+  /// Retorna o indice de S e se ele foi incluido (true) ou jah existia (false)
+  std::pair<Indice, bool> insert(std::string_view S);
+  /// Remove o identificador de indice i, que passa a ser o do ultimo
+  void remover(Indice i);
+  /// Reserva espaco para n identificadores com um total de c caracteres
+  void reserve(size_t n, size_t c);
+  /// Torna a tabela vazia
+  void clear();
+};
+
+/* *************************
+ * CLASSE ADJACENCIA     *
+ ************************* */
+
+/// Lista de adjacencia das rotas do mapa, no formato CSR com folgas.
+/// As arestas que partem do ponto de indice i ocupam as posicoes
+/// [inicio[i], fim[i]) dos vetores vizinho, rota e comprimento.
+/// Cada rota gera duas arestas, uma a partir de cada extremidade.
+/// Logo apos construir, fim[i] == inicio[i+1]. As alteracoes incrementais
+/// do mapa deixam posicoes livres (vizinho == INDICE_INVALIDO): uma aresta
+/// nova ocupa a posicao livre logo apos as arestas do ponto ou, se nao
+/// houver, as arestas do ponto sao transferidas para o final dos vetores,
+/// com o dobro do espaco. Assim, incluir ou remover uma aresta custa
+/// O(grau) amortizado.
+struct Adjacencia {
+  Arranjo<Indice> inicio;      // 1a aresta de cada ponto (num. de pontos
+                               // + 1: o ultimo eh o numero de posicoes)
+  Arranjo<Indice> fim;         // Fim das arestas de cada ponto
+  Arranjo<Indice> vizinho;     // Indice do ponto na outra extremidade
+  Arranjo<Indice> rota;        // Indice da rota
+  Arranjo<double> comprimento; // Comprimento da rota (em km)
+
+  // Construtor default
+  Adjacencia() : inicio(), fim(), vizinho(), rota(), comprimento() {}
+  /// Constroi a adjacencia de um mapa com num_pontos pontos, a partir das
+  /// extremidades (2 indices de ponto por rota) e comprimentos das rotas.
+  void construir(Indice num_pontos, const Arranjo<Indice> &extremidades,
+                 const Arranjo<double> &comprimentos);
+  /// Grau (numero de arestas) do ponto p
+  Indice grau(Indice p) const { return fim[p] - inicio[p]; }
+  /// Inclui um ponto sem arestas, de indice igual ao numero de pontos
+  void incluirPonto();
+  /// Inclui a aresta da rota r a partir do ponto p ateh o ponto viz
+  void incluir(Indice p, Indice viz, Indice r, double compr);
+  /// Remove uma aresta da rota r que parte do ponto p
+  void remover(Indice p, Indice r);
+  /// Refaz os vetores sem posicoes livres, mantendo a ordem das arestas
+  void compactar();
+  /// Torna a adjacencia vazia
+  void clear();
+};
+
+/* *************************
+ * CLASSE TRIGPONTOS     *
+ ************************* */
+
+/// Coordenadas dos pontos pre-processadas para a formula de haversine, em
+/// estrutura de arranjos (SoA): cada grandeza de todos os pontos fica
+/// contigua na memoria. Sao calculadas uma vez, na leitura do mapa (ou lidas
+/// do arquivo binario), para que a heuristica da busca nao converta graus
+/// nem calcule senos e cossenos das latitudes a cada chamada.
+/// As coordenadas cartesianas (x, y, sen_lat) alimentam o calculo em lote,
+/// vetorizado com AVX2 quando o processador permite.
+struct TrigPontos {
+  Arranjo<double> lon;     // Longitude (em radianos)
+  Arranjo<double> sen_lat; // Seno da latitude (tambem a coordenada z)
+  Arranjo<double> cos_lat; // Cosseno da latitude
+  Arranjo<double> x;       // Coordenadas cartesianas na esfera de
+  Arranjo<double> y;       // raio 1: (x, y, sen_lat)
+
+  // Construtor default
+  TrigPontos() : lon(), sen_lat(), cos_lat(), x(), y() {}
+  /// Calcula as tabelas a partir das latitudes e longitudes (em graus)
+  void calcular(const Arranjo<double> &latitude,
+                const Arranjo<double> &longitude);
+  /// Calcula as tabelas do ponto i (i <= numero de pontos: i igual ao
+  /// numero de pontos inclui um ponto)
+  void definir(Indice i, double latitude, double longitude);
+  /// Remove o ponto i, que passa a ser o ultimo ponto
+  void remover(Indice i);
+  /// Distancia em linha reta entre os pontos i e j, com o mesmo resultado
+  /// (bit a bit) de ::haversine
+  double haversine(Indice i, Indice j) const {
+    double cosseno = sen_lat[i] * sen_lat[j] +
+                     cos_lat[i] * cos_lat[j] * std::cos(lon[i] - lon[j]);
+    if (cosseno > 1.0)
+      cosseno = 1.0;
+    if (cosseno < -1.0)
+      cosseno = -1.0;
+    return RAIO_TERRA * std::acos(cosseno);
+  }
+  /// Distancias em linha reta do ponto alvo ateh os pontos 0, ..., n-1,
+  /// gravadas em saida[0], ..., saida[n-1], com AVX2 se o processador
+  /// permitir. Usa a corda entre os pontos na esfera, e nao o cosseno do
+  /// angulo: os resultados diferem dos de ::haversine por menos de 1e-9 km
+  /// mais o erro de arredondamento da propria ::haversine, que cresce em
+  /// pontos muito proximos ou quase antipodas (o benchmark confere a
+  /// tolerancia; ver planejador-bench.cpp).
+  void haversineLote(Indice alvo, size_t n, double *saida) const;
+  /// Versao de haversineLote sem AVX2 (a usada quando o processador nao o
+  /// tem)
+  void haversineLoteEscalar(Indice alvo, size_t n, double *saida) const;
+  /// Testa se haversineLote usa AVX2 neste processador
+  static bool loteVetorizado();
+  /// Torna as tabelas vazias
+  void clear();
+};
+
+/* *************************
+ * CLASSE INDICEESPACIAL *
+ ************************* */
+
+/// Indice espacial dos pontos: arvore k-d sobre as coordenadas cartesianas
+/// dos pontos na esfera de raio 1 (as de TrigPontos). Nessas coordenadas, a
+/// distancia em linha reta (corda) cresce com a distancia pela superficie,
+/// e a arvore nao tem problemas nos polos nem na linha de data.
+/// A arvore eh completa e implicita: os nohs internos (o plano que divide
+/// cada um ao meio, no eixo de maior extensao) ficam em ordem de nivel, em
+/// que os filhos do noh i sao 2i e 2i+1, e os niveis de cima, visitados
+/// por todas as buscas, ocupam pouca memoria contigua. Os pontos ficam nas
+/// folhas, em grupos de ateh FOLHA pontos contiguos na memoria.
+/// As alteracoes incrementais do mapa nao reconstroem a arvore: um ponto
+/// removido eh apenas marcado na sua folha, e um ponto incluido vai para
+/// uma lista de pontos fora da arvore, que as buscas percorrem por inteiro.
+/// A arvore eh reconstruida quando os pontos pendentes (removidos e fora
+/// da arvore) passam de uma fracao dos pontos (ver desatualizado), o que
+/// custa O(log n) amortizado por alteracao e limita a lista percorrida.
+/// Os arranjos do indice sao gravados no arquivo binario, e a leitura nao
+/// reconstroi a arvore.
+class IndiceEspacial {
+public:
+  /// Um ponto encontrado: distancia em linha reta (em km) e indice
+  using Resultado = std::pair<double, Indice>;
+
+private:
+  /// Um noh interno: o plano perpendicular ao eixo na coordenada corte
+  struct Noh {
+    double corte;
+    uint32_t eixo;
+    uint32_t livre; // Completa os 16 bytes (gravados no arquivo binario)
+  };
+  Arranjo<Indice> ponto; // Pontos na ordem das folhas
+                         // (INDICE_INVALIDO: removido)
+  Arranjo<double> coord; // Coordenadas (x, y, z) na ordem das folhas
+  Arranjo<Noh> noh;      // Nohs internos (a raiz eh noh[1])
+  unsigned nivel_folhas; // Nivel das folhas (a raiz tem nivel 0)
+  Arranjo<Indice> extra;       // Pontos incluidos fora da arvore
+  Arranjo<double> coord_extra; // Coordenadas (x, y, z) de extra
+  Arranjo<Indice> posicao;     // Posicao de cada ponto: nas folhas
+                               // (< ponto.size()) ou em extra (a partir
+                               // de ponto.size())
+  size_t removidos;            // Pontos removidos das folhas
+
+  static constexpr size_t FOLHA = 16; // Tamanho maximo de uma folha
+  /// Fracao maxima de pontos pendentes antes de reconstruir a arvore
+  static constexpr size_t FRACAO_PENDENTES = 64;
+
+  // Acesso aos arranjos para gravacao e leitura em arquivo binario
+  friend struct SecoesMapa;
+
+  /// Nivel das folhas de uma arvore de n pontos: o menor em que as folhas
+  /// tem ateh FOLHA pontos
+  static unsigned nivelFolhas(size_t n) {
+    unsigned nivel = 0;
+    while ((n >> nivel) > FOLHA)
+      ++nivel;
+    return nivel;
+  }
+  /// Completa o indice cujos arranjos foram lidos de um arquivo binario
+  /// (nivel das folhas e pontos removidos) e testa se ele eh coerente com
+  /// n pontos: cada ponto em exatamente uma posicao, nas folhas ou fora
+  /// da arvore
+  bool restaurar(size_t n);
+
+  /// Inicio do intervalo do j-esimo noh do nivel na ordem das folhas
+  size_t inicio(size_t j, unsigned nivel) const {
+    return size_t((uint64_t(j) * ponto.size()) >> nivel);
+  }
+  /// Busca a partir do noh no (de nivel nivel) os pontos aceitos pelo
+  /// visitante V (ver planejador-espacial.cpp)
+  template <class Visitante>
+  void percorrer(size_t no, unsigned nivel, const double q[3], double dist2,
+                 double dif[3], Visitante &V) const;
+  /// Busca os pontos aceitos pelo visitante V, fora e dentro da arvore
+  template <class Visitante>
+  void buscar(const double q[3], Visitante &V) const;
+
+public:
+  // Construtor default
+  IndiceEspacial()
+      : ponto(), coord(), noh(), nivel_folhas(0), extra(), coord_extra(),
+        posicao(), removidos(0) {}
+  /// Constroi o indice dos pontos de T
+  void construir(const TrigPontos &T);
+  /// Numero de pontos indexados
+  size_t size() const { return posicao.size(); }
+  /// Inclui o ponto de indice igual ao numero de pontos indexados, com as
+  /// coordenadas de T, fora da arvore
+  void incluir(const TrigPontos &T);
+  /// Remove o ponto p. O ultimo ponto passa a ter o indice p.
+  void remover(Indice p);
+  /// Testa se os pontos pendentes passaram da fracao que justifica
+  /// reconstruir a arvore
+  bool desatualizado() const {
+    return removidos + extra.size() > ponto.size() / FRACAO_PENDENTES + FOLHA;
+  }
+  /// Os k pontos mais proximos da coordenada (em graus), em ordem
+  /// crescente de distancia, gravados em R. R fica vazio se a coordenada
+  /// for invalida.
+  void proximos(double latitude, double longitude, size_t k,
+                std::vector<Resultado> &R) const;
+  /// Os pontos a uma distancia em linha reta de ateh raio km da coordenada
+  /// (em graus), em ordem crescente de distancia, gravados em R
+  void noRaio(double latitude, double longitude, double raio,
+              std::vector<Resultado> &R) const;
+  /// Ponto mais proximo da coordenada (em graus). INDICE_INVALIDO se nao
+  /// ha pontos ou se a coordenada eh invalida.
+  Indice maisProximo(double latitude, double longitude) const;
+  /// Torna o indice vazio
+  void clear();
+};
+
+/* *************************
+ * CLASSE HIERARQUIA     *
+ ************************* */
+
+/// Contraction Hierarchies (CH) do mapa. Os pontos sao contraidos um a um,
+/// em ordem crescente de importancia (nivel): ao contrair um ponto, cada
+/// caminho mais curto que passava por ele eh substituido por um atalho
+/// entre dois de seus vizinhos. Cada arco (rota original ou atalho) liga um
+/// ponto (baixo) a um vizinho de nivel maior (alto), e os arcos de cada
+/// ponto ocupam as posicoes [inicio[i], inicio[i+1]) (formato CSR).
+/// Todo caminho mais curto pode ser percorrido subindo de nivel a partir
+/// das duas extremidades, o que limita a busca a poucos pontos.
+/// Um atalho equivale a dois arcos de nivel menor, que partem do ponto
+/// contraido (o meio do atalho): filho_baixo, ateh baixo, e filho_alto,
+/// ateh alto.
+struct Hierarquia {
+  Arranjo<Indice> nivel;       // Nivel (ordem de contracao) de cada ponto
+  Arranjo<Indice> inicio;      // Deslocamentos (num. de pontos + 1)
+  Arranjo<Indice> baixo;       // Ponto de menor nivel do arco
+  Arranjo<Indice> alto;        // Ponto de maior nivel do arco
+  Arranjo<double> peso;        // Comprimento do arco (em km)
+  Arranjo<Indice> rota;        // Rota original (INDICE_INVALIDO se atalho)
+  Arranjo<Indice> filho_baixo; // Atalho: arco do meio ateh baixo
+  Arranjo<Indice> filho_alto;  // Atalho: arco do meio ateh alto
+
+  // Construtor default
+  Hierarquia()
+      : nivel(), inicio(), baixo(), alto(), peso(), rota(), filho_baixo(),
+        filho_alto() {}
+  /// Testa se a hierarquia nao foi calculada
+  bool empty() const { return nivel.empty(); }
+  /// Torna a hierarquia vazia
+  void clear();
+};
+
+/* *************************
+ * CLASSE ARQUIVOMAPEADO *
+ ************************* */
+
+/// O conteudo de um arquivo, mapeado na memoria (somente leitura).
+/// Arquivos que nao podem ser mapeados (ex: pipes) sao copiados para a
+/// memoria.
+class ArquivoMapeado {
+private:
+  const char *dados;
+  size_t tamanho;
+  void *mapeamento;  // Endereco retornado por mmap (nullptr se copiado)
+  std::string copia; // Conteudo copiado, se nao foi mapeado
+
+public:
+  // Construtor
+  ArquivoMapeado() : dados(nullptr), tamanho(0), mapeamento(nullptr), copia() {}
+  // Nao eh copiavel
+  ArquivoMapeado(const ArquivoMapeado &) = delete;
+  ArquivoMapeado &operator=(const ArquivoMapeado &) = delete;
+  // Destrutor
+  ~ArquivoMapeado() { fechar(); }
+  /// Abre e mapeia o arquivo. Retorna false se nao conseguir abrir.
+  /// O parametro sequencial indica se o conteudo serah lido do inicio ao fim
+  /// (como um arquivo texto) ou consultado em ordem qualquer.
+  bool abrir(const std::string &nome, bool sequencial = true);
+  /// Desfaz o mapeamento
+  void fechar();
+  /// Conteudo do arquivo
+  const char *data() const { return dados; }
+  size_t size() const { return tamanho; }
+};
+
+/* *************************
+ * CLASSE MAPA           *
+ ************************* */
+
+/// Criterio de escolha dos marcos da heuristica ALT
+enum class SelecaoMarcos {
+  DISTANTES, // Cada marco eh o ponto mais distante dos marcos anteriores
+  EVITAR     // "Avoid": marcos nas regioes em que a heuristica eh pior
+};
+
+/// O conteudo de um mapa em tabelas densas, indexadas por Indice.
+/// Os identificadores sao internados em TabelaIds, de modo que a busca
+/// nao manipula nenhuma string: apenas indices e vetores de numeros.
+struct Mapa {
+  // Pontos
+  TabelaIds id_pontos;          // Identificadores dos pontos
+  TabelaTextos nome_pontos;     // Nomes dos pontos
+  Arranjo<double> latitude;     // Latitudes dos pontos (em graus)
+  Arranjo<double> longitude;    // Longitudes dos pontos (em graus)
+  TrigPontos trig;              // Coordenadas pre-processadas
+  IndiceEspacial espacial;      // Busca de pontos por coordenadas
+  // Rotas
+  TabelaIds id_rotas;           // Identificadores das rotas
+  TabelaTextos nome_rotas;      // Nomes das rotas
+  Arranjo<Indice> extremidades; // 2 indices de ponto por rota
+  Arranjo<double> comprimento;  // Comprimentos das rotas (em km)
+  // Rotas incidentes a cada ponto
+  Adjacencia adj;
+  // Componentes conexas, calculadas na leitura e mantidas pelas alteracoes
+  Arranjo<Indice> componente;     // Rotulo da componente de cada ponto
+  Arranjo<Indice> tam_componente; // Pontos de cada rotulo (0: sem uso)
+  Indice num_componentes;         // Rotulos jah usados (0 a este-1)
+  // Marcos (landmarks) da heuristica ALT (vazios se nao calculados)
+  Arranjo<Indice> marcos;     // Indices dos pontos escolhidos como marcos
+  Arranjo<float> dist_marcos; // Distancia de cada ponto a cada marco
+                              // (ponto i, marco k em i*marcos.size()+k)
+  SelecaoMarcos selecao_marcos; // Criterio usado na escolha dos marcos
+  // Contraction Hierarchies (vazia se nao calculada)
+  Hierarquia ch;
+  // Arquivo binario referenciado pelos arranjos (nullptr se nenhum)
+  std::shared_ptr<const ArquivoMapeado> arquivo;
+
+  /// Margem relativa descontada do limite dado por cada marco, para cobrir
+  /// o arredondamento das distancias para float (2 ulp da soma)
+  static constexpr double MARGEM_MARCOS = 1.0 / (1 << 23);
+
+  // Construtor default
+  Mapa()
+      : id_pontos(), nome_pontos(), latitude(), longitude(), trig(),
+        espacial(), id_rotas(), nome_rotas(), extremidades(), comprimento(),
+        adj(), componente(), tam_componente(), num_componentes(0), marcos(),
+        dist_marcos(), selecao_marcos(SelecaoMarcos::EVITAR), ch(),
+        arquivo() {}
+  /// Numero de pontos
+  Indice numPontos() const { return id_pontos.size(); }
+  /// Numero de rotas
+  Indice numRotas() const { return id_rotas.size(); }
+  /// Ponto de indice i
+  Ponto ponto(Indice i) const;
+  /// Rota de indice i
+  Rota rota(Indice i) const;
+  /// Distancia em linha reta entre os pontos de indices i e j
+  double haversine(Indice i, Indice j) const {
+    if (i == j)
+      return 0.0;
+    return trig.haversine(i, j);
+  }
+  /// Alteracoes incrementais (ver Planejador::aplicar), sem verificacao
+  /// dos parametros. Os indices continuam densos: o ponto (ou a rota)
+  /// removido eh substituido pelo ultimo. As Contraction Hierarchies sao
+  /// descartadas, assim como os marcos, caso deixem de dar um limite
+  /// inferior valido (rota incluida ou encurtada, marco removido). O
+  /// indice espacial e as componentes conexas sao mantidos.
+  Indice incluirPonto(const Ponto &P);
+  void removerPonto(Indice p); // O ponto nao pode ter rotas
+  Indice incluirRota(const Rota &R, Indice a, Indice b);
+  void removerRota(Indice r);
+  void alterarComprimento(Indice r, double compr);
+  /// Calcula a componente conexa de cada ponto (union-find em paralelo)
+  void calcularComponentes(PoolThreads &pool);
+  /// Une as componentes dos pontos a e b (rota incluida entre eles)
+  void unirComponentes(Indice a, Indice b);
+  /// Separa as componentes dos pontos a e b, se nao houver mais caminho
+  /// entre eles (rota removida entre eles)
+  void separarComponentes(Indice a, Indice b);
+  /// Testa se os pontos i e j estao na mesma componente conexa (se nao
+  /// estao, nao existe caminho entre eles)
+  bool mesmaComponente(Indice i, Indice j) const {
+    return componente[i] == componente[j];
+  }
+  /// Renumera os pontos ao longo de uma curva de Hilbert sobre as suas
+  /// coordenadas, e as rotas pela ordem dos seus pontos (ver
+  /// Planejador::reordenarMapa). Os marcos sao mantidos, e as Contraction
+  /// Hierarchies, descartadas.
+  void reordenar();
+  /// Limite inferior da distancia pelas rotas entre os pontos i e j dado
+  /// pelos marcos (desigualdade triangular): max |d(k,i) - d(k,j)|
+  double limiteMarcos(Indice i, Indice j) const {
+    const size_t K = marcos.size();
+    const float *di = dist_marcos.data() + size_t(i) * K;
+    const float *dj = dist_marcos.data() + size_t(j) * K;
+    double lim = 0.0;
+    for (size_t k = 0; k < K; ++k) {
+      double a = di[k], b = dj[k];
+      // Se um dos pontos nao alcanca o marco, d eh NaN e eh ignorado
+      double d = std::fabs(a - b) - MARGEM_MARCOS * (a + b);
+      if (d > lim)
+        lim = d;
+    }
+    return lim;
+  }
+  /// Heuristica da busca: limite inferior da distancia pelas rotas entre
+  /// os pontos i e j (o maior entre a haversine e o limite dos marcos)
+  double heuristica(Indice i, Indice j) const {
+    double h = haversine(i, j);
+    if (!marcos.empty()) {
+      double m = limiteMarcos(i, j);
+      if (m > h)
+        h = m;
+    }
+    return h;
+  }
+  /// Torna o mapa vazio
+  void clear();
+};
 
-  Noh() : id_pt(), id_rt(), g(0.0), h(0.0) {}
+/* *************************
+ * CLASSE HEAPINDEXADO   *
+ ************************* */
+
+/// Conjunto aberto do algoritmo A*: fila de prioridade (heap binario de
+/// minimo) de indices de pontos, que permite diminuir a chave de um ponto
+/// que jah estah na fila (decrease-key) em O(log n).
+/// Pontos com chaves iguais saem na ordem em que entraram (ou em que tiveram
+/// a chave diminuida), como na lista ordenada usada antes pelo A*.
+/// A chave eh do tipo dos custos da busca (ver CustoDouble, CustoFloat e
+/// CustoMetros); as versoes usadas sao instanciadas em planejador.cpp.
+template <class Chave> class HeapIndexadoT {
+private:
+  struct Item {
+    Chave chave;    // Prioridade (f = g + h no A*)
+    uint32_t ordem; // Desempate entre chaves iguais: ordem de entrada
+    Indice pt;      // Indice do ponto
+  };
+  std::vector<Item> itens;      // O heap propriamente dito
+  std::vector<Indice> posicao;  // Posicao de cada ponto em itens
+                                // (INDICE_INVALIDO se fora do heap)
+  uint32_t contador;            // Proximo valor de ordem
+
+  static bool menor(const Item &a, const Item &b) {
+    return a.chave < b.chave || (a.chave == b.chave && a.ordem < b.ordem);
+  }
+  void subir(size_t i);
+  void descer(size_t i);
+
+public:
+  // Construtor
+  HeapIndexadoT() : itens(), posicao(), contador(0) {}
+  /// Esvazia o heap e o prepara para pontos de indices 0 a num_pontos-1
+  void reset(Indice num_pontos);
+  /// Numero de pontos no heap
+  Indice size() const { return Indice(itens.size()); }
+  bool empty() const { return itens.empty(); }
+  /// Testa se o ponto pt estah no heap
+  bool contem(Indice pt) const { return posicao[pt] != INDICE_INVALIDO; }
+  /// Chave do ponto pt, que deve estar no heap
+  Chave chave(Indice pt) const { return itens[posicao[pt]].chave; }
+  /// Inclui o ponto pt, que nao pode estar no heap
+  void push(Indice pt, Chave chave);
+  /// Diminui a chave do ponto pt, que deve estar no heap
+  void diminuir(Indice pt, Chave chave);
+  /// Ponto da posicao k do heap (0 a size()-1, em ordem qualquer)
+  Indice operator[](Indice k) const { return itens[k].pt; }
+  /// Ponto de menor chave, sem remove-lo
+  Indice topo() const { return itens.front().pt; }
+  /// Remove e retorna o ponto de menor chave
+  Indice pop();
+};
+
+/// Heap com chaves double, o das buscas que nao escolhem o tipo dos custos
+using HeapIndexado = HeapIndexadoT<double>;
+
+/// Um trecho de caminho em indices: a rota que trouxe ateh o ponto
+struct Trecho {
+  Indice rota;  // INDICE_INVALIDO no 1o trecho (origem)
+  Indice ponto;
+};
+
+/// Um Caminho em indices do mapa, contiguo na memoria
+using CaminhoIndices = std::vector<Trecho>;
+
+/* *************************
+ * ESTATISTICAS DA BUSCA *
+ ************************* */
+
+/// Estatisticas de uma consulta de caminho (ver Planejador::calculaCaminho)
+struct EstatisticasBusca {
+  uint64_t expandidos;   // Pontos fechados (NF)
+  uint64_t relaxados;    // Arestas examinadas a partir dos pontos fechados
+  uint64_t diminuicoes;  // Chaves diminuidas no aberto (decrease-key)
+  uint64_t reabertos;    // Pontos fechados alcancados depois por caminho
+                         // mais curto (heuristica inconsistente); a busca
+                         // nao os reabre
+  uint64_t pico_aberto;  // Maior tamanho do conjunto aberto
+  uint64_t heuristicas;  // Avaliacoes da heuristica
+  int aberto_final;      // Tamanho do aberto ao termino (NA)
+  int fechado_final;     // Tamanho do fechado ao termino (NF)
+  int erro;              // Codigo do erro (0 se nenhum)
+  double t_preparo;      // Tempos (em segundos): busca das ids e preparo
+  double t_busca;        // da area de trabalho, busca propriamente dita e
+  double t_reconstrucao; // montagem do caminho encontrado
+
+  // Construtor
+  EstatisticasBusca()
+      : expandidos(0), relaxados(0), diminuicoes(0), reabertos(0),
+        pico_aberto(0), heuristicas(0), aberto_final(0), fechado_final(0),
+        erro(0), t_preparo(0.0), t_busca(0.0), t_reconstrucao(0.0) {}
+  /// Zera as estatisticas
+  void clear() { *this = EstatisticasBusca(); }
+};
 
-  Noh(const IDPonto &ponto, const IDRota &rota, double custo_passado,
-      double custo_heuristico)
-      : id_pt(ponto), id_rt(rota), g(custo_passado), h(custo_heuristico) {}
+/// Politica de estatisticas desligada. As buscas sao funcoes template que
+/// recebem a politica como parametro: com esta, todas as chamadas sao
+/// vazias e o compilador as elimina, sem nenhum custo para a busca.
+struct SemEstatisticas {
+  void expandiu() {}
+  void relaxou() {}
+  void diminuiu() {}
+  void alcancouFechado(double, double) {}
+  void aberto(size_t) {}
+  void avaliouHeuristica(unsigned = 1) {}
+  void fimPreparo() {}
+  void fimBusca() {}
+  void fimReconstrucao() {}
+  void erro(int) {}
+};
+
+/// Politica de estatisticas ligada: conta em um EstatisticasBusca
+class ComEstatisticas {
+private:
+  EstatisticasBusca &E;
+  std::chrono::steady_clock::time_point marca; // Inicio da fase atual
 
-  double f() const { return g + h; }
+  /// Segundos desde o inicio da fase atual, que termina
+  double fimFase() {
+    auto agora = std::chrono::steady_clock::now();
+    double t = std::chrono::duration<double>(agora - marca).count();
+    marca = agora;
+    return t;
+  }
 
-  bool operator<(const Noh &n) const { return f() < n.f(); }
-  bool operator==(const Noh &n) const { return id_pt == n.id_pt; }
-  bool operator==(const IDPonto &idPonto) const { return id_pt == idPonto; }
+public:
+  /// Zera as estatisticas e inicia a contagem do tempo de preparo
+  explicit ComEstatisticas(EstatisticasBusca &est)
+      : E(est), marca(std::chrono::steady_clock::now()) {
+    E.clear();
+  }
+  void expandiu() { ++E.expandidos; }
+  void relaxou() { ++E.relaxados; }
+  void diminuiu() { ++E.diminuicoes; }
+  /// Um ponto fechado com comprimento g_fechado foi alcancado de novo, com
+  /// comprimento g_novo
+  void alcancouFechado(double g_novo, double g_fechado) {
+    if (g_novo < g_fechado)
+      ++E.reabertos;
+  }
+  /// O aberto passou a ter tam pontos
+  void aberto(size_t tam) {
+    if (tam > E.pico_aberto)
+      E.pico_aberto = tam;
+  }
+  void avaliouHeuristica(unsigned n = 1) { E.heuristicas += n; }
+  void fimPreparo() { E.t_preparo = fimFase(); }
+  void fimBusca() { E.t_busca = fimFase(); }
+  void fimReconstrucao() { E.t_reconstrucao = fimFase(); }
+  void erro(int codigo) { E.erro = codigo; }
+};
+
+/// Totais das estatisticas de todas as consultas do processo que coletaram
+/// estatisticas. Varias threads podem acumular ao mesmo tempo: os contadores
+/// sao atomicos (os tempos sao somados em nanossegundos).
+class TotaisBusca {
+public:
+  /// Erros contados separadamente (codigos maiores contam como o ultimo)
+  static constexpr int NUM_ERROS = 8;
+
+private:
+  std::atomic<uint64_t> consultas;
+  std::atomic<uint64_t> erros[NUM_ERROS];
+  std::atomic<uint64_t> expandidos, relaxados, diminuicoes, reabertos;
+  std::atomic<uint64_t> heuristicas;
+  std::atomic<uint64_t> pico_aberto; // Maior pico de uma consulta
+  std::atomic<uint64_t> ns_preparo, ns_busca, ns_reconstrucao;
+
+public:
+  // Construtor
+  TotaisBusca() { clear(); }
+  // Nao eh copiavel
+  TotaisBusca(const TotaisBusca &) = delete;
+  TotaisBusca &operator=(const TotaisBusca &) = delete;
+
+  /// Soma as estatisticas de uma consulta aos totais
+  void acumular(const EstatisticasBusca &E);
+  /// Zera os totais
+  void clear();
+  /// Escreve os totais no formato de texto do Prometheus
+  void exportarPrometheus(std::ostream &X) const;
+
+  /// Totais do processo, acumulados por Planejador::calculaCaminho
+  static TotaisBusca &global();
+};
+
+/* *************************
+ * POLITICAS DO A*       *
+ ************************* */
+
+// O A* (Planejador::aEstrela) eh um template sobre a heuristica e o tipo
+// dos custos, alem da politica de estatisticas. As politicas sao classes
+// sem funcoes virtuais, com metodos inline: cada combinacao gera uma busca
+// propria, sem nenhuma chamada indireta por aresta relaxada. A versao de
+// calculaCaminho que recebe HeuristicaBusca e CustoBusca escolhe entre as
+// combinacoes jah instanciadas.
+
+/// Heuristica do A* (ver as classes Heuristica* abaixo)
+enum class HeuristicaBusca {
+  ZERO,      // Nenhuma: algoritmo de Dijkstra
+  HAVERSINE, // Distancia em linha reta pela superficie da Terra
+  CORDA,     // Distancia em linha reta pelo interior da Terra
+  MARCOS     // Maior entre a haversine e o limite dos marcos (a padrao)
+};
+
+/// Tipo dos custos acumulados pelo A* (ver as classes Custo* abaixo)
+enum class CustoBusca {
+  DOUBLE, // km em double
+  FLOAT,  // km em float
+  METROS  // Metros inteiros (uint32_t)
+};
+
+/// Heuristica nula: o A* se reduz ao algoritmo de Dijkstra
+struct HeuristicaZero {
+  explicit HeuristicaZero(const Mapa &) {}
+  double operator()(Indice, Indice) const { return 0.0; }
+};
+
+/// Heuristica haversine, sem os marcos
+struct HeuristicaHaversine {
+  const Mapa &M;
+  explicit HeuristicaHaversine(const Mapa &mapa) : M(mapa) {}
+  double operator()(Indice i, Indice j) const { return M.haversine(i, j); }
+};
+
+/// Heuristica da corda entre os pontos: soh somas, produtos e uma raiz
+/// quadrada sobre as coordenadas cartesianas de TrigPontos, sem o arco
+/// cosseno da haversine. A corda nunca eh maior que o arco, de modo que a
+/// heuristica continua admissivel e consistente, um pouco menos precisa
+/// (cerca de 0,4% de diferenca a 1000 km).
+struct HeuristicaCorda {
+  const TrigPontos &T;
+  explicit HeuristicaCorda(const Mapa &mapa) : T(mapa.trig) {}
+  double operator()(Indice i, Indice j) const {
+    const double dx = T.x[i] - T.x[j];
+    const double dy = T.y[i] - T.y[j];
+    const double dz = T.sen_lat[i] - T.sen_lat[j];
+    return RAIO_TERRA * std::sqrt(dx * dx + dy * dy + dz * dz);
+  }
+};
+
+/// Heuristica padrao (Mapa::heuristica): haversine e marcos ALT
+struct HeuristicaMarcos {
+  const Mapa &M;
+  explicit HeuristicaMarcos(const Mapa &mapa) : M(mapa) {}
+  double operator()(Indice i, Indice j) const { return M.heuristica(i, j); }
+};
+
+/// Custos em km, em double: o A* exato
+struct CustoDouble {
+  using Tipo = double;
+  /// Custo de uma aresta de km quilometros
+  static Tipo aresta(double km) { return km; }
+  /// Valor da heuristica de km quilometros
+  static Tipo limite(double km) { return km; }
+};
+
+/// Custos em km, em float: metade da memoria para g e um heap menor. Os
+/// arredondamentos podem levar a um caminho ligeiramente mais longo que o
+/// mais curto (em torno de 1e-7 do comprimento por aresta).
+struct CustoFloat {
+  using Tipo = float;
+  static Tipo aresta(double km) { return Tipo(km); }
+  static Tipo limite(double km) { return Tipo(km); }
+};
+
+/// Custos em metros inteiros. As arestas sao arredondadas para cima e a
+/// heuristica para baixo, o que a mantem admissivel e consistente, e o
+/// caminho encontrado excede o mais curto em no maximo 1 m por aresta.
+/// Caminhos de ateh 4 milhoes de km.
+struct CustoMetros {
+  using Tipo = uint32_t;
+  static Tipo aresta(double km) { return Tipo(std::ceil(km * 1000.0)); }
+  static Tipo limite(double km) { return Tipo(km * 1000.0); }
+};
+
+/* *************************
+ * CLASSE ESPACOBUSCA    *
+ ************************* */
+
+/// Algoritmo usado no calculo de um caminho
+enum class ModoBusca {
+  UNIDIRECIONAL, // A* da origem ateh o destino
+  BIDIRECIONAL,  // A* simultaneo a partir da origem e do destino
+  HIERARQUIA     // Busca nas Contraction Hierarchies (calcularHierarquia)
+};
+
+/// Area de trabalho de uma busca de caminho: o estado de cada ponto e o
+/// conjunto aberto. Os buffers sao reaproveitados de uma busca para a
+/// seguinte, de modo que consultas repetidas nao alocam memoria, e nao sao
+/// percorridos por inteiro a cada busca: o custo de preparar a area de
+/// trabalho depende apenas do numero de pontos alcancados pela busca
+/// anterior, e nao do tamanho do mapa.
+/// Um EspacoBusca soh pode ser usado por uma busca de cada vez: cada thread
+/// que faz consultas deve ter o seu.
+class EspacoBusca {
+private:
+  friend class Planejador;
+
+  /// Estado de uma das direcoes da busca.
+  /// O conjunto fechado eh marcado com o numero (geracao) da busca: um
+  /// ponto estah fechado se a sua marca eh a geracao da busca atual, e uma
+  /// nova busca soh precisa incrementar a geracao para esvazia-lo.
+  /// Custo eh o tipo dos custos g e das chaves do aberto.
+  template <class Custo> struct DirecaoT {
+    std::vector<Custo> g;          // Custo do caminho ateh o ponto
+    std::vector<Indice> pai;       // Rota que trouxe ateh o ponto
+    std::vector<uint32_t> marca;   // Geracao em que o ponto foi fechado
+    uint32_t geracao;              // Geracao da busca atual
+    HeapIndexadoT<Custo> aberto;   // Conjunto aberto, ordenado por f = g + h
+    int num_fechados;
+
+    /// Prepara os buffers para uma busca em um mapa com num_pontos pontos
+    void preparar(Indice num_pontos);
+    /// Testa se o ponto pt estah fechado
+    bool fechado(Indice pt) const { return marca[pt] == geracao; }
+    /// Inclui o ponto pt no conjunto fechado
+    void fechar(Indice pt) {
+      marca[pt] = geracao;
+      ++num_fechados;
+    }
+    /// Testa se o ponto pt jah foi alcancado (estah em aberto ou fechado)
+    bool alcancado(Indice pt) const {
+      return fechado(pt) || aberto.contem(pt);
+    }
+  };
+  using Direcao = DirecaoT<double>;
+
+  /// Estado de uma das direcoes da busca nas Contraction Hierarchies.
+  /// A busca alcanca poucos pontos: em vez de reiniciar os vetores
+  /// inteiros, soh os pontos alcancados (tocados) sao reiniciados.
+  struct DirecaoCH {
+    std::vector<double> dist; // Distancia ateh o ponto (HUGE_VAL se nao
+                              // alcancado)
+    std::vector<Indice> arco; // Arco que trouxe ateh o ponto
+    std::vector<std::pair<double, Indice>> heap; // Aberto (heap de minimo,
+                                                 // com entradas obsoletas)
+    std::vector<Indice> tocados; // Pontos com dist alterada
+    std::vector<Indice> arcos;   // Arcos do caminho (reconstrucao)
+    std::vector<std::pair<Indice, bool>> pilha; // Expansao dos atalhos
+    int num_fechados;
+
+    /// Prepara os buffers para uma busca em um mapa com num_pontos pontos
+    void preparar(Indice num_pontos);
+  };
+
+  /// Estado da busca anytime (Planejador::buscaAnytime). Cada iteracao
+  /// esvazia o fechado, mas os valores de g continuam validos ateh o fim da
+  /// consulta: alem da geracao em que foi fechado, cada ponto guarda a
+  /// geracao em que foi alcancado. A consulta comeca em uma nova geracao,
+  /// e cada iteracao passa para a geracao seguinte.
+  struct DirecaoAnytime {
+    std::vector<double> g;           // Custo do caminho ateh o ponto
+    std::vector<Indice> pai;         // Rota que trouxe ateh o ponto
+    std::vector<uint32_t> alcance;   // Geracao em que o ponto foi alcancado
+    std::vector<uint32_t> marca;     // Geracao em que o ponto foi fechado
+    std::vector<uint32_t> marca_inc; // Geracao em que entrou em incons
+    uint32_t consulta;               // Geracao do inicio da consulta
+    uint32_t geracao;                // Geracao da iteracao atual
+    HeapIndexado aberto;             // Ordenado por g + epsilon * h
+    std::vector<Indice> incons;      // Pontos fechados na iteracao cujo g
+                                     // diminuiu depois (inconsistentes)
+    int num_fechados;                // Pontos fechados em todas as iteracoes
+
+    /// Prepara os buffers para uma consulta de ateh num_iteracoes
+    /// iteracoes em um mapa com num_pontos pontos
+    void preparar(Indice num_pontos, uint32_t num_iteracoes);
+    /// Testa se o ponto pt foi alcancado na consulta (g valido)
+    bool alcancado(Indice pt) const { return alcance[pt] >= consulta; }
+    /// Testa se o ponto pt estah fechado na iteracao atual
+    bool fechado(Indice pt) const { return marca[pt] == geracao; }
+    /// Inclui o ponto pt no conjunto fechado
+    void fechar(Indice pt) {
+      marca[pt] = geracao;
+      ++num_fechados;
+    }
+    /// Inclui o ponto pt, fechado, nos inconsistentes (uma vez por iteracao)
+    void incluirIncons(Indice pt) {
+      if (marca_inc[pt] != geracao) {
+        marca_inc[pt] = geracao;
+        incons.push_back(pt);
+      }
+    }
+  };
+
+  Direcao ida;            // Busca a partir da origem
+  Direcao volta;          // Busca a partir do destino (soh bidirecional)
+  DirecaoCH ch_ida;       // Busca nas Contraction Hierarchies
+  DirecaoCH ch_volta;
+  DirecaoT<float> ida_float;     // A* com custos float (CustoFloat)
+  DirecaoT<uint32_t> ida_metros; // A* com custos em metros (CustoMetros)
+  DirecaoAnytime anytime;        // Busca anytime (ARA*)
+  CaminhoIndices caminho; // Caminho encontrado, em indices
+
+  /// Direcao do A* unidirecional com custos do tipo do argumento
+  DirecaoT<double> &idaCusto(double) { return ida; }
+  DirecaoT<float> &idaCusto(float) { return ida_float; }
+  DirecaoT<uint32_t> &idaCusto(uint32_t) { return ida_metros; }
+
+public:
+  // Construtor
+  EspacoBusca()
+      : ida(), volta(), ch_ida(), ch_volta(), ida_float(), ida_metros(),
+        anytime(), caminho() {}
+};
+
+/// Areas de trabalho guardadas para as consultas em lote de um Planejador
+/// (calculaCaminhos, calculaMatriz, ...): cada lote empresta uma area por
+/// thread do pool e as devolve ao terminar, de modo que lotes seguidos nao
+/// alocam e preparam areas do tamanho do mapa a cada chamada.
+/// Pode ser usado por varias threads ao mesmo tempo.
+class ReservaEspacos {
+private:
+  std::mutex m; // Protege livres
+  std::vector<std::unique_ptr<EspacoBusca>> livres;
+
+public:
+  /// Areas emprestadas por um lote, devolvidas a reserva no destrutor
+  class Emprestimo {
+  private:
+    ReservaEspacos &reserva;
+    std::vector<std::unique_ptr<EspacoBusca>> espacos;
+
+  public:
+    /// Empresta n areas de R (as que faltarem sao criadas)
+    Emprestimo(ReservaEspacos &R, size_t n);
+    /// Devolve as areas a reserva
+    ~Emprestimo();
+    Emprestimo(const Emprestimo &) = delete;
+    Emprestimo &operator=(const Emprestimo &) = delete;
+
+    /// Area da thread t
+    EspacoBusca &operator[](size_t t) { return *espacos[t]; }
+  };
+
+  // Construtor
+  ReservaEspacos() : m(), livres() {}
+  /// A copia comeca vazia (as areas sao dimensionadas para outro mapa)
+  ReservaEspacos(const ReservaEspacos &) : ReservaEspacos() {}
+  ReservaEspacos &operator=(const ReservaEspacos &) {
+    clear();
+    return *this;
+  }
+
+  /// Descarta as areas guardadas
+  void clear();
+};
+
+/// Resultado de uma consulta de caminho (ver Planejador::calculaCaminho)
+struct ResultadoCaminho {
+  double comprimento; // <0 se parametros invalidos ou nao existe caminho
+  Caminho caminho;    // Vazio se parametros invalidos ou nao existe caminho
+  int NA;             // <0 se parametros invalidos
+  int NF;             // <0 se parametros invalidos
+};
+
+/// Pedido de cancelamento de consultas em andamento (ver OpcoesAnytime),
+/// que pode ser feito por qualquer thread. Um Cancelamento pode ser
+/// compartilhado por varias consultas.
+class Cancelamento {
+private:
+  std::atomic<bool> pedido;
+
+public:
+  // Construtor
+  Cancelamento() : pedido(false) {}
+  /// Pede o cancelamento das consultas
+  void cancelar() { pedido.store(true, std::memory_order_relaxed); }
+  /// Desfaz o pedido, para novas consultas
+  void reiniciar() { pedido.store(false, std::memory_order_relaxed); }
+  /// Testa se o cancelamento foi pedido
+  bool cancelado() const { return pedido.load(std::memory_order_relaxed); }
+};
+
+/// Orcamento e parametros de uma consulta anytime (ver
+/// Planejador::calculaCaminhoAnytime)
+struct OpcoesAnytime {
+  double prazo_ms;                  // Tempo maximo da busca (0: sem limite)
+  uint64_t max_expansoes;           // Pontos fechados no maximo, somados em
+                                    // todas as iteracoes (0: sem limite)
+  const Cancelamento *cancelamento; // Interrompe a busca quando cancelado
+                                    // (nullptr: nunca)
+  double epsilon_inicial; // Peso da heuristica na 1a iteracao (>= 1)
+  double passo_epsilon;   // Reducao do peso a cada iteracao (> 0)
+
+  // Construtor
+  OpcoesAnytime()
+      : prazo_ms(0.0), max_expansoes(0), cancelamento(nullptr),
+        epsilon_inicial(3.0), passo_epsilon(0.5) {}
+};
+
+/// Qualidade do caminho de uma consulta anytime
+struct ResultadoAnytime {
+  double subotimalidade; // O comprimento eh no maximo este fator vezes o do
+                         // caminho mais curto (1: o mais curto; HUGE_VAL se
+                         // nenhum caminho foi encontrado)
+  bool completa;         // A busca terminou antes do fim do orcamento: o
+                         // caminho eh o mais curto, ou nao existe caminho
+  unsigned iteracoes;    // Iteracoes (valores do peso) completadas
+
+  // Construtor
+  ResultadoAnytime()
+      : subotimalidade(HUGE_VAL), completa(false), iteracoes(0) {}
+};
+
+/// Um dos caminhos alternativos entre dois pontos (ver
+/// Planejador::calculaCaminhosAlternativos)
+struct CaminhoAlternativo {
+  double comprimento;
+  Caminho caminho;
+};
+
+/// Um ponto do mapa encontrado a partir de uma coordenada (ver
+/// Planejador::pontosProximos e Planejador::pontosNoRaio)
+struct PontoProximo {
+  IDPonto id;
+  double distancia; // Distancia em linha reta ateh a coordenada (em km)
+};
+
+/// Um ponto do mapa alcancavel a partir de uma ou mais origens (ver
+/// Planejador::pontosAlcancaveis)
+struct PontoAlcancavel {
+  IDPonto id;
+  double distancia; // Distancia pelas rotas a partir da origem mais proxima
+};
+
+/// Matriz de distancias entre origens e destinos (ver
+/// Planejador::calculaMatriz), armazenada por linhas: o elemento (i,j), da
+/// origem i ao destino j, estah na posicao i*num_destinos + j.
+struct MatrizDistancias {
+  size_t num_origens;
+  size_t num_destinos;
+  std::vector<double> comprimento; // <0 se id invalida ou nao existe caminho
+  std::vector<Caminho> caminho;    // Vazio se nao foram pedidos os caminhos
+
+  /// Comprimento do caminho da origem i ao destino j
+  double operator()(size_t i, size_t j) const {
+    return comprimento[i * num_destinos + j];
+  }
+};
+
+/// Opcoes de Planejador::processarFluxo
+struct OpcoesFluxo {
+  ModoBusca modo;    // Algoritmo usado nas consultas
+  size_t tam_bloco;  // Consultas por bloco do pipeline
+  size_t max_blocos; // Blocos em uso ao mesmo tempo (limita a memoria)
+
+  // Construtor
+  OpcoesFluxo()
+      : modo(ModoBusca::UNIDIRECIONAL), tam_bloco(1024), max_blocos(4) {}
+};
+
+/* *************************
+ * CLASSE CACHECAMINHOS  *
+ ************************* */
+
+/// Contadores de um CacheCaminhos
+struct EstatisticasCache {
+  uint64_t acertos;  // Consultas respondidas pelo cache
+  uint64_t falhas;   // Consultas que precisaram de uma busca
+  size_t tamanho;    // Consultas armazenadas
+  size_t capacidade; // Maximo de consultas armazenadas (0 == desativado)
+};
+
+/// Cache LRU (least recently used) dos resultados de calculaCaminho. Cada
+/// entrada guarda o resultado de uma consulta, com o caminho em indices, e
+/// serve tanto para o par (origem, destino) quanto para (destino, origem),
+/// pois as rotas sao de mao dupla. Quando o cache estah cheio, a entrada
+/// usada ha mais tempo eh descartada.
+/// Pode ser usado por varias threads ao mesmo tempo.
+class CacheCaminhos {
+public:
+  /// Resultado de uma consulta
+  struct Entrada {
+    Indice origem;          // Origem da consulta que gerou a entrada
+    double comprimento;     // <0 se nao existe caminho
+    CaminhoIndices caminho; // A partir de origem
+    int NA, NF;             // Da busca que gerou a entrada
+  };
+
+private:
+  using Chave = uint64_t; // Menor e maior indice dos pontos do par
+  using Item = std::pair<Chave, std::shared_ptr<const Entrada>>;
+
+  mutable std::mutex m;   // Protege lista e posicao
+  std::list<Item> lista;  // Da entrada usada mais recentemente para a menos
+  std::unordered_map<Chave, std::list<Item>::iterator> posicao;
+  std::atomic<size_t> capacidade;
+  std::atomic<uint64_t> acertos, falhas;
+
+  static Chave chave(Indice a, Indice b) {
+    return a < b ? (Chave(a) << 32) | b : (Chave(b) << 32) | a;
+  }
+
+public:
+  /// Cria um cache desativado (capacidade 0)
+  CacheCaminhos()
+      : m(), lista(), posicao(), capacidade(0), acertos(0), falhas(0) {}
+  /// A copia tem a mesma capacidade, mas comeca vazia
+  CacheCaminhos(const CacheCaminhos &C) : CacheCaminhos() {
+    capacidade = C.capacidade.load();
+  }
+  CacheCaminhos &operator=(const CacheCaminhos &C);
+
+  /// Testa se o cache estah ativado (capacidade > 0)
+  bool ativo() const { return capacidade > 0; }
+  /// Altera a capacidade, descartando as entradas que excederem (0 desativa
+  /// o cache)
+  void setCapacidade(size_t cap);
+  /// Procura o resultado da consulta de orig a dest. Se encontrar, retorna
+  /// true e preenche compr, C (no sentido de orig a dest), NA e NF.
+  bool buscar(Indice orig, Indice dest, double &compr, CaminhoIndices &C,
+              int &NA, int &NF);
+  /// Armazena o resultado da consulta de orig a dest
+  void incluir(Indice orig, Indice dest, double compr,
+               const CaminhoIndices &C, int NA, int NF);
+  /// Descarta todas as entradas (os contadores sao mantidos)
+  void clear();
+  /// Contadores do cache
+  EstatisticasCache estatisticas() const;
+};
+
+/* *************************
+ * CLASSE LOTEALTERACOES *
+ ************************* */
+
+/// Lote de alteracoes incrementais do mapa, aplicadas de uma vez, na ordem
+/// em que foram incluidas, por Planejador::aplicar. Permite atualizar o
+/// mapa com dados ao vivo (ex: interdicoes e tempos de transito) sem reler
+/// os arquivos.
+class LoteAlteracoes {
+public:
+  enum class Tipo {
+    INCLUIR_PONTO,
+    REMOVER_PONTO,
+    INCLUIR_ROTA,
+    REMOVER_ROTA,
+    ALTERAR_COMPRIMENTO
+  };
+  /// Uma alteracao: soh os campos usados pelo tipo sao preenchidos
+  struct Alteracao {
+    Tipo tipo;
+    Ponto ponto; // INCLUIR_PONTO; soh a id em REMOVER_PONTO
+    Rota rota;   // INCLUIR_ROTA; soh a id (e o comprimento) nas demais
+  };
+
+private:
+  std::vector<Alteracao> alteracoes;
+
+public:
+  // Construtor
+  LoteAlteracoes() : alteracoes() {}
+
+  /// Inclui o ponto P, cuja id nao pode existir
+  void incluirPonto(const Ponto &P) {
+    alteracoes.push_back({Tipo::INCLUIR_PONTO, P, Rota()});
+  }
+  /// Remove o ponto de id Id, que nao pode ter rotas
+  void removerPonto(const IDPonto &Id) {
+    Ponto P;
+    P.id = Id;
+    alteracoes.push_back({Tipo::REMOVER_PONTO, P, Rota()});
+  }
+  /// Inclui a rota R, cuja id nao pode existir, entre pontos existentes
+  void incluirRota(const Rota &R) {
+    alteracoes.push_back({Tipo::INCLUIR_ROTA, Ponto(), R});
+  }
+  /// Remove a rota de id Id
+  void removerRota(const IDRota &Id) {
+    Rota R;
+    R.id = Id;
+    alteracoes.push_back({Tipo::REMOVER_ROTA, Ponto(), R});
+  }
+  /// Altera o comprimento da rota de id Id
+  void alterarComprimento(const IDRota &Id, double comprimento) {
+    Rota R;
+    R.id = Id;
+    R.comprimento = comprimento;
+    alteracoes.push_back({Tipo::ALTERAR_COMPRIMENTO, Ponto(), R});
+  }
+
+  /// Numero de alteracoes
+  size_t size() const { return alteracoes.size(); }
+  bool empty() const { return alteracoes.empty(); }
+  /// Alteracao de indice i
+  const Alteracao &operator[](size_t i) const { return alteracoes[i]; }
+  /// Torna o lote vazio
+  void clear() { alteracoes.clear(); }
 };
 
 /* *************************
@@ -141,14 +1473,88 @@ struct Noh {
 
 /// A classe que armazena os pontos e as rotas do mapa do Planejador
 /// e calcula caminho mais curto entre pontos.
+/// Os metodos const podem ser chamados simultaneamente por varias threads,
+/// desde que nenhum metodo nao const (ler, clear, etc.) execute ao mesmo
+/// tempo. Para trocar o mapa sem interromper as consultas, ver
+/// PlanejadorAoVivo.
 class Planejador {
 private:
-  std::list<Ponto> pontos;
-  std::list<Rota> rotas;
+  Mapa mapa;
+  EspacoBusca espaco; // Usado pela versao nao const de calculaCaminho
+  mutable CacheCaminhos cache; // Resultados de consultas anteriores
+  mutable ReservaEspacos reserva; // Areas de trabalho das consultas em lote
+
+  /// Algoritmo A* entre os pontos de indices orig e dest, usando a area de
+  /// trabalho E. Retorna o comprimento do caminho (<0 se nao existe
+  /// caminho) e preenche o caminho em indices E.caminho e os tamanhos NA e
+  /// NF dos conjuntos de busca.
+  /// A politica P (SemEstatisticas ou ComEstatisticas) recebe os eventos
+  /// da busca; Heuristica e Custo sao as politicas do A* (ver
+  /// HeuristicaMarcos e CustoDouble, as usadas por calculaCaminho).
+  template <class Heuristica, class Custo, class Politica>
+  double aEstrela(Indice orig, Indice dest, EspacoBusca &E, int &NA, int &NF,
+                  Politica &P) const;
+  /// Algoritmo A* bidirecional entre os pontos de indices orig e dest, com
+  /// os mesmos parametros e resultados de aEstrela.
+  template <class Politica>
+  double aEstrelaBidirecional(Indice orig, Indice dest, EspacoBusca &E,
+                              int &NA, int &NF, Politica &P) const;
+  /// Busca nas Contraction Hierarchies entre os pontos de indices orig e
+  /// dest, com os mesmos parametros e resultados de aEstrela.
+  template <class Politica>
+  double buscaHierarquia(Indice orig, Indice dest, EspacoBusca &E, int &NA,
+                         int &NF, Politica &P) const;
+  /// Busca anytime (ARA*) entre os pontos de indices orig e dest, com o
+  /// orcamento e os parametros O. Retorna o comprimento do melhor caminho
+  /// encontrado (<0 se nenhum), que fica em E.caminho, e a sua qualidade
+  /// em R; NA, NF e P como em aEstrela. Os parametros de O devem ser
+  /// validos (ver calcularAnytime).
+  template <class Politica>
+  double buscaAnytime(Indice orig, Indice dest, const OpcoesAnytime &O,
+                      EspacoBusca &E, int &NA, int &NF, ResultadoAnytime &R,
+                      Politica &P) const;
+  /// Implementacao de calculaCaminhoAnytime (ver calcular)
+  template <class TipoCaminho, class Politica>
+  double calcularAnytime(const IDPonto &id_origem, const IDPonto &id_destino,
+                         TipoCaminho &C, int &NA, int &NF, EspacoBusca &E,
+                         const OpcoesAnytime &O, ResultadoAnytime &R,
+                         Politica &P) const;
+  /// Implementacao de calculaCaminho, com a politica de estatisticas P.
+  /// O caminho C eh um Caminho ou um CaminhoContiguo.
+  template <class TipoCaminho, class Politica>
+  double calcular(const IDPonto &id_origem, const IDPonto &id_destino,
+                  TipoCaminho &C, int &NA, int &NF, EspacoBusca &E,
+                  ModoBusca modo, Politica &P) const;
+  /// Algoritmo de Dijkstra a partir do ponto de indice orig, usando a area
+  /// de trabalho E, que termina quando os num_alvos pontos com alvo[pt] ==
+  /// true estiverem fechados (ou quando nao houver mais pontos alcancaveis).
+  /// O comprimento e a rota de chegada de cada ponto fechado ficam em E.ida.
+  void buscaMultipla(Indice orig, const std::vector<bool> &alvo,
+                     Indice num_alvos, EspacoBusca &E) const;
+  /// Algoritmo A* do ponto de indice C[j].ponto ateh dest, usando a area de
+  /// trabalho E, que nao passa pelos pontos C[0..j-1] e nao sai de C[j]
+  /// pelas rotas de indices em bloqueadas (busca de desvio do algoritmo de
+  /// Yen). Retorna o comprimento do desvio (<0 se nao existe) e o preenche
+  /// em E.caminho.
+  double buscaDesvio(const CaminhoIndices &C, size_t j, Indice dest,
+                     const std::vector<Indice> &bloqueadas,
+                     EspacoBusca &E) const;
+  /// Potencial do ponto pt na busca bidirecional entre orig e dest
+  double potencial(Indice pt, Indice orig, Indice dest) const {
+    return 0.5 * (mapa.heuristica(pt, dest) - mapa.heuristica(pt, orig));
+  }
+  /// Refaz em C o caminho de orig ateh dest, voltando de dest pelas rotas
+  /// pai[pt] que trouxeram ateh cada ponto pt
+  void refazerCaminho(const std::vector<Indice> &pai, Indice orig,
+                      Indice dest, CaminhoIndices &C) const;
+  /// Converte um caminho em indices para um Caminho de identificadores
+  void converterCaminho(const CaminhoIndices &CI, Caminho &C) const;
+  /// Converte um caminho em indices para um CaminhoContiguo
+  void converterCaminho(const CaminhoIndices &CI, CaminhoContiguo &C) const;
 
 public:
   /// Cria um mapa vazio
-  Planejador() : pontos(), rotas() {}
+  Planejador() : mapa(), espaco(), cache(), reserva() {}
 
   /// Cria um mapa com o conteudo dos arquivos arq_pontos e arq_rotas
   Planejador(const std::string &arq_pontos, const std::string &arq_rotas)
@@ -163,7 +1569,7 @@ public:
   void clear();
 
   /// Testa se um mapa estah vazio
-  bool empty() const { return pontos.empty(); }
+  bool empty() const { return mapa.numPontos() == 0; }
 
   /// Retorna um Ponto do mapa, passando a id como parametro.
   /// Se a id for inexistente, retorna um Ponto vazio.
@@ -177,10 +1583,110 @@ public:
   void imprimirPontos() const;
   void imprimirRotas() const;
 
+  /// Retorna os k pontos do mapa mais proximos da coordenada (latitude e
+  /// longitude em graus), em ordem crescente de distancia em linha reta.
+  /// Retorna um vetor vazio se a coordenada for invalida.
+  std::vector<PontoProximo> pontosProximos(double latitude, double longitude,
+                                           size_t k = 1) const;
+  /// Retorna os pontos do mapa a uma distancia em linha reta de ateh raio
+  /// km da coordenada, em ordem crescente de distancia.
+  std::vector<PontoProximo> pontosNoRaio(double latitude, double longitude,
+                                         double raio) const;
+
   /// Leh um mapa dos arquivos arq_pontos e arq_rotas.
   /// Caso nao consiga ler dos arquivos, deixa o mapa inalterado e retorna
   /// false. Retorna true em caso de leitura bem sucedida.
-  bool ler(const std::string &arq_pontos, const std::string &arq_rotas);
+  /// Os arquivos sao mapeados na memoria; arquivos grandes sao divididos em
+  /// blocos lidos em paralelo por ateh num_threads threads (0 == todos os
+  /// nucleos do processador).
+  bool ler(const std::string &arq_pontos, const std::string &arq_rotas,
+           unsigned num_threads = 1);
+
+  /// Salva o mapa em um arquivo binario, que pode ser lido por lerBinario.
+  /// Retorna true em caso de sucesso. Em caso de erro, o arquivo nao eh
+  /// alterado e retorna false.
+  bool salvarBinario(const std::string &arq) const;
+
+  /// Leh um mapa de um arquivo binario gerado por salvarBinario.
+  /// O arquivo eh mapeado na memoria e suas tabelas sao usadas diretamente,
+  /// sem conversao: a leitura eh praticamente instantanea.
+  /// Se verificar for true, confere o checksum do conteudo (o que percorre o
+  /// arquivo inteiro uma vez). Mesmo sem o checksum, os indices das tabelas
+  /// sao conferidos (uma passada pelas rotas e arestas), e um arquivo com
+  /// indices fora dos intervalos eh recusado. Os dados derivados (ex: as
+  /// coordenadas pre-processadas) tambem sao lidos do arquivo, e soh sao
+  /// calculados se o arquivo, mais antigo, nao os tiver.
+  /// Caso nao consiga ler o arquivo, deixa o mapa inalterado e retorna false.
+  /// Retorna true em caso de leitura bem sucedida.
+  bool lerBinario(const std::string &arq, bool verificar = true);
+
+  /// Aplica ao mapa as alteracoes do lote L, na ordem em que foram
+  /// incluidas, como uma unica operacao: se alguma alteracao for invalida
+  /// (ex: id inexistente ou repetida), nenhuma eh aplicada, eh impressa uma
+  /// mensagem de erro e retorna false. Retorna true em caso de sucesso.
+  /// Cada alteracao custa O(grau) amortizado, sem reconstruir o mapa: o
+  /// indice espacial guarda os pontos incluidos fora da sua arvore e soh eh
+  /// reconstruido quando os pontos incluidos e removidos passam de uma
+  /// fracao do mapa (ver IndiceEspacial).
+  /// O cache eh esvaziado e as Contraction Hierarchies sao descartadas. Os
+  /// marcos da heuristica ALT sao mantidos se nenhuma rota for incluida ou
+  /// encurtada e nenhum marco for removido; caso contrario, sao descartados.
+  bool aplicar(const LoteAlteracoes &L);
+
+  /// Alteracoes avulsas: equivalem a aplicar um lote com uma so alteracao
+  bool incluirPonto(const Ponto &P);
+  bool removerPonto(const IDPonto &Id);
+  bool incluirRota(const Rota &R);
+  bool removerRota(const IDRota &Id);
+  bool alterarComprimento(const IDRota &Id, double comprimento);
+
+  /// Renumera os pontos do mapa ao longo de uma curva de Hilbert sobre a
+  /// latitude e a longitude, e as rotas pela ordem dos seus pontos, para
+  /// que pontos proximos no mapa fiquem proximos na memoria: as buscas
+  /// fazem menos acessos fora do cache do processador. Os identificadores
+  /// dos pontos e das rotas nao mudam, mas a ordem de impressao e a do
+  /// arquivo binario (salvarBinario) passam a ser a nova. Deve ser chamado
+  /// logo apos a leitura: os marcos sao mantidos, mas as Contraction
+  /// Hierarchies sao descartadas, e o cache eh esvaziado.
+  void reordenarMapa();
+
+  /// Prepara a heuristica ALT (A*, marcos e desigualdade triangular):
+  /// escolhe num_marcos pontos como marcos e calcula a distancia pelas
+  /// rotas de todos os pontos ateh cada um deles. A partir dai, as buscas
+  /// usam como heuristica o maior entre a haversine e o limite inferior
+  /// dado pelos marcos, que eh muito melhor quando as rotas contornam
+  /// obstaculos. Os marcos sao gravados por salvarBinario.
+  /// O custo eh de num_marcos (ou 2*num_marcos, com EVITAR) buscas que
+  /// percorrem o mapa inteiro e de num_marcos floats por ponto.
+  /// num_marcos == 0 descarta os marcos.
+  void calcularMarcos(unsigned num_marcos = 16,
+                      SelecaoMarcos selecao = SelecaoMarcos::EVITAR);
+
+  /// Numero de marcos da heuristica ALT (0 se nao calculados)
+  unsigned numMarcos() const { return unsigned(mapa.marcos.size()); }
+  /// Criterio usado na escolha dos marcos (ou EVITAR, se nao calculados)
+  SelecaoMarcos selecaoMarcos() const { return mapa.selecao_marcos; }
+
+  /// Prepara as Contraction Hierarchies do mapa, usadas pelas buscas no
+  /// modo ModoBusca::HIERARQUIA. A contracao eh feita em rodadas, e os
+  /// pontos de cada rodada sao processados em paralelo pelas threads do
+  /// pool. As buscas no modo HIERARQUIA encontram caminhos de mesmo
+  /// comprimento que o A*, expandindo uma fracao minima dos pontos.
+  void calcularHierarquia(PoolThreads &pool = PoolThreads::global());
+
+  /// Testa se as Contraction Hierarchies foram calculadas
+  bool temHierarquia() const { return !mapa.ch.empty(); }
+
+  /// Ativa o cache dos resultados de calculaCaminho (e calculaCaminhos),
+  /// que guarda as ultimas capacidade consultas distintas. Consultas
+  /// repetidas (ou invertidas) sao respondidas sem busca, com o mesmo
+  /// caminho, NA e NF da consulta original, qualquer que seja o modo de
+  /// busca. O cache eh esvaziado automaticamente quando o mapa muda (ler,
+  /// lerBinario, aplicar, clear). capacidade == 0 desativa o cache.
+  void ativarCache(size_t capacidade);
+
+  /// Contadores de acertos e falhas do cache
+  EstatisticasCache estatisticasCache() const { return cache.estatisticas(); }
 
   /// Calcula o caminho mais curto no mapa entre origem e destino, usando o
   /// algoritmo A* Retorna o comprimento do caminho encontrado.
@@ -189,12 +1695,267 @@ public:
   /// (vazio se parametros invalidos ou se nao existe caminho).
   /// O parametro NA retorna o numero de nos em aberto ao termino do algoritmo
   /// A*
-  /// (<0 se parametros invalidos, retorna >0 mesmo quando nao existe caminho).
+  /// (<0 se parametros invalidos; 0 se a origem e o destino estao em
+  /// componentes conexas diferentes, quando nao ha busca).
   /// O parametro NF retorna o numero de nos em fechado ao termino do algoritmo
   /// A*
-  /// (<0 se parametros invalidos, retorna >0 mesmo quando nao existe caminho).
+  /// (<0 se parametros invalidos; 0 se a origem e o destino estao em
+  /// componentes conexas diferentes, quando nao ha busca).
+  /// O parametro modo escolhe entre o A* comum e o A* bidirecional, que
+  /// costuma fechar muito menos nos em caminhos longos. No modo bidirecional,
+  /// NA e NF sao a soma dos conjuntos das duas buscas. O modo HIERARQUIA
+  /// exige calcularHierarquia (erro, caso contrario).
+  double calculaCaminho(const IDPonto &id_origem, const IDPonto &id_destino,
+                        Caminho &C, int &NA, int &NF,
+                        ModoBusca modo = ModoBusca::UNIDIRECIONAL);
+
+  /// Versao reentrante de calculaCaminho: a busca usa a area de trabalho E
+  /// em vez de uma interna ao Planejador. Varias threads podem calcular
+  /// caminhos ao mesmo tempo, cada uma com o seu EspacoBusca.
+  double calculaCaminho(const IDPonto &id_origem, const IDPonto &id_destino,
+                        Caminho &C, int &NA, int &NF, EspacoBusca &E,
+                        ModoBusca modo = ModoBusca::UNIDIRECIONAL) const;
+
+  /// Versoes de calculaCaminho que preenchem est com as estatisticas da
+  /// consulta (que incluem NA e NF) e as somam a TotaisBusca::global().
+  /// As demais versoes nao coletam estatisticas e nao tem custo extra.
+  double calculaCaminho(const IDPonto &id_origem, const IDPonto &id_destino,
+                        Caminho &C, EstatisticasBusca &est,
+                        ModoBusca modo = ModoBusca::UNIDIRECIONAL);
   double calculaCaminho(const IDPonto &id_origem, const IDPonto &id_destino,
-                        Caminho &C, int &NA, int &NF);
+                        Caminho &C, EstatisticasBusca &est, EspacoBusca &E,
+                        ModoBusca modo = ModoBusca::UNIDIRECIONAL) const;
+
+  /// Versoes reentrantes de calculaCaminho que retornam o caminho como um
+  /// CaminhoContiguo. Reaproveitando C e E, as consultas nao alocam memoria
+  /// depois que os buffers atingem o tamanho necessario (exceto ao incluir
+  /// resultados no cache, se ativo).
+  double calculaCaminho(const IDPonto &id_origem, const IDPonto &id_destino,
+                        CaminhoContiguo &C, int &NA, int &NF, EspacoBusca &E,
+                        ModoBusca modo = ModoBusca::UNIDIRECIONAL) const;
+  double calculaCaminho(const IDPonto &id_origem, const IDPonto &id_destino,
+                        CaminhoContiguo &C, EstatisticasBusca &est,
+                        EspacoBusca &E,
+                        ModoBusca modo = ModoBusca::UNIDIRECIONAL) const;
+
+  /// Versao de calculaCaminho com o A* unidirecional que escolhe a
+  /// heuristica e o tipo dos custos (ver HeuristicaBusca e CustoBusca).
+  /// O comprimento eh sempre somado em double. Com custos FLOAT ou METROS,
+  /// o caminho pode ser um pouco mais longo que o mais curto, em troca de
+  /// uma busca mais barata. Nao usa o cache.
+  double calculaCaminho(const IDPonto &id_origem, const IDPonto &id_destino,
+                        CaminhoContiguo &C, int &NA, int &NF, EspacoBusca &E,
+                        HeuristicaBusca heuristica, CustoBusca custo) const;
+
+  /// Versoes de calculaCaminho entre coordenadas (latitude e longitude em
+  /// graus), por exemplo de um GPS: a origem e o destino sao os pontos do
+  /// mapa mais proximos das coordenadas. Uma coordenada invalida equivale
+  /// a um ponto inexistente (erro 4 na origem, 5 no destino).
+  double calculaCaminho(double lat_origem, double lon_origem,
+                        double lat_destino, double lon_destino, Caminho &C,
+                        int &NA, int &NF,
+                        ModoBusca modo = ModoBusca::UNIDIRECIONAL);
+  double calculaCaminho(double lat_origem, double lon_origem,
+                        double lat_destino, double lon_destino, Caminho &C,
+                        int &NA, int &NF, EspacoBusca &E,
+                        ModoBusca modo = ModoBusca::UNIDIRECIONAL) const;
+
+  /// Versoes de calculaCaminho com orcamento, para consultas com prazo: a
+  /// busca anytime (ARA*) encontra primeiro um caminho com a heuristica
+  /// multiplicada por O.epsilon_inicial, que fecha poucos pontos, e o
+  /// melhora com pesos cada vez menores (reaproveitando o trabalho das
+  /// iteracoes anteriores) ateh provar que eh o mais curto. Quando o
+  /// orcamento de O acaba (prazo, expansoes ou cancelamento), retorna o
+  /// melhor caminho jah encontrado, e R informa o limite da sua
+  /// subotimalidade. Sem orcamento, o caminho eh sempre o mais curto.
+  /// Parametros invalidos em O: erro 7.
+  double calculaCaminhoAnytime(const IDPonto &id_origem,
+                               const IDPonto &id_destino, Caminho &C,
+                               int &NA, int &NF, EspacoBusca &E,
+                               const OpcoesAnytime &O,
+                               ResultadoAnytime &R) const;
+  double calculaCaminhoAnytime(const IDPonto &id_origem,
+                               const IDPonto &id_destino, CaminhoContiguo &C,
+                               EstatisticasBusca &est, EspacoBusca &E,
+                               const OpcoesAnytime &O,
+                               ResultadoAnytime &R) const;
+
+  /// Processa um fluxo de consultas, uma por linha da entrada, em JSON
+  /// ({"origem": "#1", "destino": "#2"}, com um campo "id" opcional, que eh
+  /// repetido no resultado) ou CSV ("#1;#2" ou "#1,#2", com cabecalho
+  /// opcional), e escreve em saida um resultado JSON por linha, na ordem
+  /// das consultas: linha, origem, destino, comprimento, ids dos pontos e
+  /// das rotas do caminho, NA, NF, arestas relaxadas, tempo e o codigo do
+  /// erro, se houver (-1 se a linha nao eh uma consulta).
+  /// Uma consulta JSON com o campo "prazo_ms" ou "max_expansoes" usa
+  /// calculaCaminhoAnytime com esse orcamento, e o resultado inclui os
+  /// campos "subotimalidade" (null se nenhum caminho foi encontrado) e
+  /// "completa".
+  /// A leitura, o calculo (em paralelo, pelas threads do pool) e a escrita
+  /// formam um pipeline de blocos de consultas. O numero de blocos eh
+  /// limitado, de modo que a memoria usada nao depende do tamanho da
+  /// entrada. Retorna o numero de resultados escritos.
+  size_t processarFluxo(std::istream &entrada, std::ostream &saida,
+                        const OpcoesFluxo &O = OpcoesFluxo(),
+                        PoolThreads &pool = PoolThreads::global()) const;
+
+  /// Calcula os caminhos de um lote de consultas (pares origem-destino) em
+  /// paralelo, usando as threads do pool. Retorna um resultado por
+  /// consulta, na mesma ordem das consultas.
+  std::vector<ResultadoCaminho> calculaCaminhos(
+      const std::vector<std::pair<IDPonto, IDPonto>> &consultas,
+      ModoBusca modo = ModoBusca::UNIDIRECIONAL,
+      PoolThreads &pool = PoolThreads::global()) const;
+
+  /// Calcula os k caminhos mais curtos sem ciclos entre origem e destino
+  /// (algoritmo de Yen), para oferecer alternativas ao caminho mais curto.
+  /// Retorna ateh k caminhos, em ordem crescente de comprimento (menos, se
+  /// nao houver k caminhos distintos). Cada caminho eh obtido a partir dos
+  /// anteriores por buscas A* de desvio, com a mesma heuristica das demais
+  /// buscas, que sao feitas em paralelo pelas threads do pool, cada uma
+  /// com a sua area de trabalho. Retorna um vetor vazio em caso de erro
+  /// (mapa vazio ou id inexistente).
+  std::vector<CaminhoAlternativo> calculaCaminhosAlternativos(
+      const IDPonto &id_origem, const IDPonto &id_destino, size_t k,
+      PoolThreads &pool = PoolThreads::global()) const;
+
+  /// Calcula a matriz de distancias entre todas as origens e todos os
+  /// destinos. Em vez de uma busca por par, faz uma unica busca a partir de
+  /// cada origem, que termina quando todos os destinos forem alcancados; as
+  /// origens sao processadas em paralelo pelas threads do pool.
+  /// Os caminhos soh sao montados se com_caminhos for true.
+  MatrizDistancias
+  calculaMatriz(const std::vector<IDPonto> &origens,
+                const std::vector<IDPonto> &destinos, bool com_caminhos = false,
+                PoolThreads &pool = PoolThreads::global()) const;
+
+  /// Retorna os pontos alcancaveis a partir da origem por caminhos de
+  /// comprimento ateh limite (em km), com as suas distancias pelas rotas,
+  /// em ordem crescente de distancia (a origem eh o primeiro, com distancia
+  /// 0). Faz uma unica busca de Dijkstra, que termina ao ultrapassar o
+  /// limite. Retorna um vetor vazio em caso de erro (mapa vazio, limite
+  /// invalido ou origem inexistente).
+  std::vector<PontoAlcancavel> pontosAlcancaveis(const IDPonto &origem,
+                                                 double limite);
+  /// Versao reentrante de pontosAlcancaveis, que usa a area de trabalho E
+  std::vector<PontoAlcancavel> pontosAlcancaveis(const IDPonto &origem,
+                                                 double limite,
+                                                 EspacoBusca &E) const;
+  /// Versao de pontosAlcancaveis com varias origens (por exemplo, as bases
+  /// de um servico): a distancia de cada ponto eh a partir da origem mais
+  /// proxima dele, e a busca ainda eh uma soh. Origens inexistentes geram
+  /// uma mensagem de erro e sao ignoradas.
+  std::vector<PontoAlcancavel>
+  pontosAlcancaveis(const std::vector<IDPonto> &origens, double limite,
+                    EspacoBusca &E) const;
+};
+
+/* *************************
+ * CLASSE PLANEJADORAOVIVO *
+ ************************* */
+
+/// Planejador para servico continuo, cujo mapa pode ser recarregado sem
+/// interromper as consultas. O mapa fica em um instantaneo (snapshot): um
+/// Planejador imutavel (grafo, indices, heuristica e cache), compartilhado
+/// por contagem de referencias. Uma recarga monta um novo instantaneo sem
+/// bloquear as consultas e o publica com uma unica troca de ponteiro. As
+/// consultas em andamento terminam no instantaneo antigo, que eh liberado
+/// quando deixa de ser usado, e as seguintes usam o novo. Cada novo
+/// instantaneo herda a heuristica do anterior (marcos e Contraction
+/// Hierarchies), calculada antes da publicacao.
+/// As consultas sao feitas por um Leitor (um por thread).
+class PlanejadorAoVivo {
+public:
+  /// Um instantaneo do mapa
+  using Instantaneo = std::shared_ptr<const Planejador>;
+
+  /// Acesso de uma thread ao instantaneo mais recente. O Leitor guarda uma
+  /// referencia ao instantaneo e a versao dele: cada acesso soh compara a
+  /// versao com a publicada (uma leitura atomica, sem mutex), e a
+  /// referencia soh eh trocada, com o mutex, uma vez depois de cada
+  /// recarga. Ex: Leitor L(vivo); L->calculaCaminho(o, d, C, NA, NF, E);
+  class Leitor {
+  private:
+    const PlanejadorAoVivo &fonte;
+    Instantaneo atual;
+    uint64_t versao; // Versao de atual (0 == nenhum)
+
+    /// Passa a referenciar o instantaneo publicado
+    void atualizar();
+
+  public:
+    // Construtor
+    explicit Leitor(const PlanejadorAoVivo &F)
+        : fonte(F), atual(), versao(0) {}
+
+    /// Instantaneo mais recente, que continua valido (mesmo que outro seja
+    /// publicado) ateh o proximo acesso por este Leitor
+    const Instantaneo &instantaneo() {
+      if (versao != fonte.versao.load(std::memory_order_acquire))
+        atualizar();
+      return atual;
+    }
+    const Planejador &operator*() { return *instantaneo(); }
+    const Planejador *operator->() { return instantaneo().get(); }
+    /// Deixa de referenciar o instantaneo (ex: em uma thread ociosa, para
+    /// nao reter um instantaneo antigo)
+    void liberar() {
+      atual.reset();
+      versao = 0;
+    }
+  };
+
+private:
+  mutable std::mutex m;         // Protege atual
+  std::mutex m_recarga;         // Serializa as recargas
+  Instantaneo atual;            // Instantaneo publicado
+  std::atomic<uint64_t> versao; // Incrementada a cada publicacao
+
+  /// Prepara o novo mapa P com a heuristica do instantaneo publicado: os
+  /// marcos (com o mesmo numero e criterio, se P nao tiver os seus) e as
+  /// Contraction Hierarchies (se o publicado as tiver), e com a mesma
+  /// capacidade de cache
+  void prepararComoAtual(Planejador &P) const;
+
+public:
+  /// Comeca com um mapa vazio
+  PlanejadorAoVivo()
+      : m(), m_recarga(), atual(std::make_shared<const Planejador>()),
+        versao(1) {}
+  PlanejadorAoVivo(const PlanejadorAoVivo &) = delete;
+  PlanejadorAoVivo &operator=(const PlanejadorAoVivo &) = delete;
+
+  /// Instantaneo publicado (usa o mutex: para consultas frequentes, usar
+  /// um Leitor)
+  Instantaneo instantaneo() const;
+  /// Numero de publicacoes (1 == mapa vazio inicial)
+  uint64_t numVersao() const { return versao.load(); }
+
+  /// Publica P como o novo instantaneo. Permite preparar o mapa (ex:
+  /// calcularMarcos, calcularHierarquia, ativarCache) antes de publica-lo.
+  void publicar(Instantaneo P);
+
+  /// Leh um novo mapa dos arquivos (ver Planejador::ler) e o publica, com
+  /// a mesma capacidade de cache e a mesma heuristica do atual: se o atual
+  /// tem marcos ou Contraction Hierarchies, eles sao calculados no novo
+  /// mapa antes da publicacao, e as consultas ALT e HIERARQUIA continuam
+  /// valendo. Retorna false (e mantem o mapa atual) em caso de erro. As
+  /// consultas continuam durante a leitura e o preparo.
+  bool ler(const std::string &arq_pontos, const std::string &arq_rotas,
+           unsigned num_threads = 1);
+  /// Versao de ler para um arquivo binario (ver Planejador::lerBinario)
+  bool lerBinario(const std::string &arq, bool verificar = true);
+  /// Versao de ler executada em segundo plano, por uma nova thread
+  std::future<bool> lerEmSegundoPlano(const std::string &arq_pontos,
+                                      const std::string &arq_rotas,
+                                      unsigned num_threads = 1);
+  /// Aplica o lote L (ver Planejador::aplicar) a uma copia do mapa atual e
+  /// a publica. Retorna false (e mantem o mapa atual) em caso de erro.
+  /// Como em ler, a heuristica descartada pelo lote eh recalculada antes
+  /// da publicacao. A copia custa O(tamanho do mapa), e o recalculo, se
+  /// houver, bem mais: para alteracoes frequentes, juntar as alteracoes em
+  /// lotes maiores.
+  bool aplicar(const LoteAlteracoes &L);
 };
 
 #endif // _PLANEJADOR_H_
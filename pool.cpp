@@ -0,0 +1,185 @@
+#include <algorithm>
+
+#include "pool.h"
+
+using namespace std;
+
+namespace {
+/// Numero da thread do pool que executa o codigo (-1 fora de um laco)
+thread_local int thread_atual = -1;
+/// Pool cujo laco a thread executa (nullptr fora de um laco): o numero
+/// thread_atual soh vale nesse pool
+thread_local const PoolThreads *pool_atual = nullptr;
+} // namespace
+
+/// Cria um pool com num_threads threads no total (0 == uma por nucleo)
+PoolThreads::PoolThreads(unsigned num)
+    : num_threads(num != 0 ? num : max(1u, thread::hardware_concurrency())),
+      filas(new Fila[num_threads]), threads(), m_laco(), m(), cv_inicio(),
+      cv_fim(), geracao(0), encerrar(false), ativas(0), tarefa(nullptr),
+      contexto(nullptr), grao(1), erro() {
+  for (unsigned t = 0; t < num_threads; ++t)
+    filas[t].ini = filas[t].fim = 0;
+  // A thread 0 eh a que chama paraCada
+  for (unsigned t = 1; t < num_threads; ++t)
+    threads.emplace_back(&PoolThreads::laco, this, t);
+}
+
+/// Destrutor: encerra as threads
+PoolThreads::~PoolThreads() {
+  {
+    lock_guard<mutex> lk(m);
+    encerrar = true;
+  }
+  cv_inicio.notify_all();
+  for (thread &T : threads)
+    T.join();
+}
+
+/// Pool compartilhado pelo programa, com uma thread por nucleo
+PoolThreads &PoolThreads::global() {
+  static PoolThreads pool;
+  return pool;
+}
+
+/// Executa tarefa(ctx, i, t) para todo i em [0, n)
+void PoolThreads::executar(size_t n, Tarefa tar, void *ctx) {
+  if (n == 0)
+    return;
+
+  // Laco dentro de um laco, ou pool sem threads: executa aqui mesmo.
+  // Dentro de um laco de outro pool, o numero da thread naquele pool pode
+  // nao existir neste (os dados por thread tem size() posicoes): aqui, a
+  // thread eh a 0.
+  if (thread_atual >= 0 || num_threads == 1 || n == 1) {
+    unsigned t = pool_atual == this ? unsigned(thread_atual) : 0;
+    for (size_t i = 0; i < n; ++i)
+      tar(ctx, i, t);
+    return;
+  }
+
+  lock_guard<mutex> lk_laco(m_laco);
+
+  // Divide as iteracoes igualmente entre as threads
+  for (unsigned t = 0; t < num_threads; ++t) {
+    filas[t].ini = n * t / num_threads;
+    filas[t].fim = n * (t + 1) / num_threads;
+  }
+  // Retira poucas iteracoes de cada vez, para equilibrar o final do laco
+  grao = max<size_t>(1, n / (16 * size_t(num_threads)));
+
+  // Acorda as demais threads
+  {
+    lock_guard<mutex> lk(m);
+    tarefa = tar;
+    contexto = ctx;
+    erro = nullptr;
+    ativas = num_threads - 1;
+    ++geracao;
+  }
+  cv_inicio.notify_all();
+
+  // Trabalha como thread 0
+  thread_atual = 0;
+  pool_atual = this;
+  trabalhar(0);
+  thread_atual = -1;
+  pool_atual = nullptr;
+
+  // Espera as demais terminarem
+  exception_ptr e;
+  {
+    unique_lock<mutex> lk(m);
+    cv_fim.wait(lk, [this] { return ativas == 0; });
+    e = erro;
+    erro = nullptr;
+  }
+  if (e)
+    rethrow_exception(e);
+}
+
+/// Retira um intervalo [ini, fim) de iteracoes da fila da thread t ou, se
+/// ela estiver vazia, rouba metade do que resta na fila de outra thread.
+/// Retorna false se nao ha mais iteracoes em nenhuma fila.
+bool PoolThreads::pegar(unsigned t, size_t &ini, size_t &fim) {
+  for (;;) {
+    {
+      lock_guard<mutex> lk(filas[t].m);
+      Fila &F = filas[t];
+      if (F.ini < F.fim) {
+        ini = F.ini;
+        fim = min(F.fim, F.ini + grao);
+        F.ini = fim;
+        return true;
+      }
+    }
+
+    // Procura a fila com mais iteracoes restantes
+    unsigned vitima = t;
+    size_t maior = 0;
+    for (unsigned k = 1; k < num_threads; ++k) {
+      unsigned v = (t + k) % num_threads;
+      lock_guard<mutex> lk(filas[v].m);
+      if (filas[v].fim - filas[v].ini > maior) {
+        maior = filas[v].fim - filas[v].ini;
+        vitima = v;
+      }
+    }
+    if (vitima == t)
+      return false;
+
+    // Rouba a metade final
+    size_t r_ini, r_fim;
+    {
+      lock_guard<mutex> lk(filas[vitima].m);
+      Fila &V = filas[vitima];
+      if (V.ini >= V.fim)
+        continue; // Alguem chegou antes: tenta de novo
+      r_fim = V.fim;
+      r_ini = V.ini + (V.fim - V.ini) / 2;
+      V.fim = r_ini;
+    }
+    lock_guard<mutex> lk(filas[t].m);
+    filas[t].ini = r_ini;
+    filas[t].fim = r_fim;
+  }
+}
+
+/// Executa iteracoes do laco atual enquanto houver
+void PoolThreads::trabalhar(unsigned t) {
+  size_t ini, fim;
+  while (pegar(t, ini, fim)) {
+    for (size_t i = ini; i < fim; ++i) {
+      try {
+        tarefa(contexto, i, t);
+      } catch (...) {
+        lock_guard<mutex> lk(m);
+        if (!erro)
+          erro = current_exception();
+      }
+    }
+  }
+}
+
+/// Laco principal das threads 1 a num_threads-1: espera um novo laco e
+/// trabalha nele
+void PoolThreads::laco(unsigned t) {
+  thread_atual = int(t);
+  pool_atual = this;
+  uint64_t vista = 0;
+  for (;;) {
+    {
+      unique_lock<mutex> lk(m);
+      cv_inicio.wait(lk, [&] { return encerrar || geracao != vista; });
+      if (encerrar)
+        return;
+      vista = geracao;
+    }
+    trabalhar(t);
+    {
+      lock_guard<mutex> lk(m);
+      if (--ativas == 0)
+        cv_fim.notify_all();
+    }
+  }
+}
@@ -0,0 +1,88 @@
+#ifndef _POOL_H_
+#define _POOL_H_
+
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <exception>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+/* *************************
+ * CLASSE POOLTHREADS    *
+ ************************* */
+
+/// Pool de threads para lacos paralelos, com roubo de trabalho (work
+/// stealing): paraCada(n, f) executa f(i, t) para i = 0, ..., n-1.
+/// As iteracoes sao divididas igualmente entre as threads; cada thread
+/// consome o seu intervalo pelo inicio e, quando ele acaba, rouba a metade
+/// final do intervalo de outra thread. Assim, iteracoes de custo muito
+/// diferente (ex: consultas curtas e longas) nao deixam threads ociosas.
+///
+/// O parametro t de f eh o numero (0 a size()-1) da thread que executa a
+/// iteracao, para que f possa usar dados proprios de cada thread.
+/// A thread que chama paraCada tambem trabalha, como thread 0.
+class PoolThreads {
+public:
+  /// Cria um pool com num_threads threads no total (0 == uma por nucleo)
+  explicit PoolThreads(unsigned num_threads = 0);
+  /// Destrutor: encerra as threads
+  ~PoolThreads();
+  // Nao eh copiavel
+  PoolThreads(const PoolThreads &) = delete;
+  PoolThreads &operator=(const PoolThreads &) = delete;
+
+  /// Numero de threads (incluindo a que chama paraCada)
+  unsigned size() const { return num_threads; }
+
+  /// Executa f(i, t) para todo i em [0, n), em paralelo, e retorna quando
+  /// todas as iteracoes terminarem. Se alguma iteracao lancar uma excecao,
+  /// ela eh relancada apos o termino das demais.
+  /// Chamadas de paraCada de dentro de uma iteracao sao executadas
+  /// sequencialmente pela propria thread: com o seu numero t, se forem do
+  /// mesmo pool, ou como thread 0, se forem de outro pool.
+  template <class Funcao> void paraCada(size_t n, Funcao f) {
+    executar(n, &chamar<Funcao>, &f);
+  }
+
+  /// Pool compartilhado pelo programa, com uma thread por nucleo
+  static PoolThreads &global();
+
+private:
+  /// Uma iteracao do laco: tarefa(contexto, i, t)
+  using Tarefa = void (*)(void *, size_t, unsigned);
+  template <class Funcao> static void chamar(void *f, size_t i, unsigned t) {
+    (*static_cast<Funcao *>(f))(i, t);
+  }
+
+  /// Intervalo de iteracoes ainda nao executadas de uma thread
+  struct alignas(64) Fila {
+    std::mutex m;
+    size_t ini;
+    size_t fim;
+  };
+
+  unsigned num_threads;
+  std::unique_ptr<Fila[]> filas; // Uma por thread
+  std::vector<std::thread> threads;
+
+  std::mutex m_laco; // Serializa as chamadas de paraCada
+  std::mutex m;      // Protege os dados abaixo
+  std::condition_variable cv_inicio, cv_fim;
+  uint64_t geracao; // Numero do laco atual
+  bool encerrar;
+  unsigned ativas; // Threads que ainda trabalham no laco atual
+  Tarefa tarefa;
+  void *contexto;
+  size_t grao; // Iteracoes retiradas da fila de cada vez
+  std::exception_ptr erro;
+
+  void executar(size_t n, Tarefa t, void *ctx);
+  bool pegar(unsigned t, size_t &ini, size_t &fim);
+  void trabalhar(unsigned t);
+  void laco(unsigned t);
+};
+
+#endif // _POOL_H_